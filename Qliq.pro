@@ -13,43 +13,24 @@
 # You should have received a copy of the GNU General Public License
 # along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
-TARGET = Qliq
-TEMPLATE = app
-QT       += core gui multimedia widgets
+# The GUI, the headless daemon and the offline tool share the capture
+# and processing pipeline (QliqCore.pri). Their project files live in
+# this directory, so each gets its own Makefile and object directory.
+# The benchmarks in benchmarks/ and the tests in tests/ build from the
+# same sources.
 
-include(Qliq.pri)
-VERSION = -$${QLIQ_VERSION}
-DEFINES += QLIQ_VERSION=\\\"$${QLIQ_VERSION}\\\"
+TEMPLATE = subdirs
 
-VERSION_PE_HEADER = 2.0
+SUBDIRS = gui daemon tool benchmarks tests
 
-win32-msvc* {
-  RC_FILE = Qliq.rc
-}
+gui.file = QliqGui.pro
+gui.makefile = Makefile.gui
 
-SOURCES += main.cpp\
-    mainwindow.cpp \
-    global.cpp \
-    volumerenderarea.cpp \
-    waverenderarea.cpp \
-    audioinputdevice.cpp \
-    util.cpp \
-    healthcheck.cpp
+daemon.file = qliqd.pro
+daemon.makefile = Makefile.qliqd
 
-HEADERS  += mainwindow.h \
-    global.h \
-    volumerenderarea.h \
-    waverenderarea.h \
-    audioinputdevice.h \
-    util.h \
-    healthcheck.h
-
-FORMS += mainwindow.ui
+tool.file = qliqtool.pro
+tool.makefile = Makefile.qliqtool
 
 DISTFILES += \
-    README.md \
-    Qliq.rc \
-    Qliq.rc
-
-RESOURCES += \
-    qliq.qrc
+    README.md
@@ -0,0 +1,72 @@
+# Copyright (c) 2015 Oliver Lau <ola@ct.de>
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# Everything from the audio input to the output files. Must not
+# depend on QtWidgets. Paths are relative to $$PWD, so that projects in
+# subdirectories (benchmarks/, tests/) can include it, too.
+
+include($$PWD/Qliq.pri)
+VERSION = -$${QLIQ_VERSION}
+DEFINES += QLIQ_VERSION=\\\"$${QLIQ_VERSION}\\\"
+
+QT += core multimedia concurrent network
+
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+    $$PWD/global.cpp \
+    $$PWD/audioinputdevice.cpp \
+    $$PWD/util.cpp \
+    $$PWD/healthcheck.cpp \
+    $$PWD/clickdetector.cpp \
+    $$PWD/sampledecoder.cpp \
+    $$PWD/entropyestimator.cpp \
+    $$PWD/bitextractor.cpp \
+    $$PWD/conditioner.cpp \
+    $$PWD/drbg.cpp \
+    $$PWD/entropyengine.cpp \
+    $$PWD/entropyserver.cpp \
+    $$PWD/replaysource.cpp \
+    $$PWD/pulsegenerator.cpp \
+    $$PWD/eventlog.cpp \
+    $$PWD/outputwriter.cpp \
+    $$PWD/capturedevice.cpp \
+    $$PWD/decimator.cpp \
+    $$PWD/pulsespectrum.cpp \
+    $$PWD/intervalstatistics.cpp
+
+HEADERS += \
+    $$PWD/global.h \
+    $$PWD/audioinputdevice.h \
+    $$PWD/util.h \
+    $$PWD/healthcheck.h \
+    $$PWD/clickdetector.h \
+    $$PWD/sampledecoder.h \
+    $$PWD/ringbuffer.h \
+    $$PWD/clickevent.h \
+    $$PWD/entropyestimator.h \
+    $$PWD/bitextractor.h \
+    $$PWD/conditioner.h \
+    $$PWD/drbg.h \
+    $$PWD/entropyengine.h \
+    $$PWD/entropyserver.h \
+    $$PWD/replaysource.h \
+    $$PWD/pulsegenerator.h \
+    $$PWD/eventlog.h \
+    $$PWD/outputwriter.h \
+    $$PWD/capturedevice.h \
+    $$PWD/decimator.h \
+    $$PWD/pulsespectrum.h \
+    $$PWD/intervalstatistics.h
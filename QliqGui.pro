@@ -0,0 +1,54 @@
+# Copyright (c) 2015 Oliver Lau <ola@ct.de>
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+TARGET = Qliq
+TEMPLATE = app
+QT       += core gui multimedia widgets concurrent network
+
+include(QliqCore.pri)
+
+OBJECTS_DIR = .obj/gui
+MOC_DIR = .moc/gui
+RCC_DIR = .rcc/gui
+UI_DIR = .ui/gui
+
+VERSION_PE_HEADER = 2.0
+
+win32-msvc* {
+  RC_FILE = Qliq.rc
+}
+
+SOURCES += main.cpp\
+    mainwindow.cpp \
+    volumerenderarea.cpp \
+    waverenderarea.cpp \
+    waverenderer.cpp \
+    spectrumrenderarea.cpp
+
+HEADERS  += mainwindow.h \
+    volumerenderarea.h \
+    waverenderarea.h \
+    waverenderer.h \
+    spectrumrenderarea.h
+
+FORMS += mainwindow.ui
+
+DISTFILES += \
+    README.md \
+    Qliq.rc \
+    Qliq.rc
+
+RESOURCES += \
+    qliq.qrc
@@ -19,44 +19,115 @@
 
 
 #include "audioinputdevice.h"
+#include "clickdetector.h"
+#include "sampledecoder.h"
+#include "outputwriter.h"
 #include <QDebug>
-#include <QtEndian>
-#include <QFile>
-#include <QVector>
+
+
+static const qint64 SampleRingDurationUs = 2 * 1000 * 1000;
+static const int DeinterleaveFrames = 1024;
+
 
 class AudioInputDevicePrivate {
 public:
-  AudioInputDevicePrivate(const QAudioFormat &format, QMutex *mutex)
+  AudioInputDevicePrivate(const QAudioFormat &format)
     : format(format)
+    , channels(qMax(1, format.channelCount()))
     , maxAmplitude(AudioInputDevice::maxAmplitudeForFormat(format))
+    , decode(sampleDecoderForFormat(format))
     , level(0.0)
-    , sampleBufferMutex(mutex)
-  { /* ... */ }
+    , clickDetectors(channels, Q_NULLPTR)
+    , captureStream(Q_NULLPTR)
+  {
+    const int ringSize = qMax(1, format.framesForDuration(SampleRingDurationUs));
+    for (int c = 0; c < channels; ++c) {
+      sampleRings.append(new SampleRingBuffer(ringSize));
+    }
+    if (channels > 1) {
+      interleaved.resize(DeinterleaveFrames * channels);
+    }
+  }
   ~AudioInputDevicePrivate()
-  { /* ... */ }
+  {
+    qDeleteAll(sampleRings);
+  }
   const QAudioFormat format;
+  const int channels;
   int maxAmplitude;
+  SampleDecodeFunction decode;
   qreal level;
-  SampleBufferType sampleBuffer;
-  QMutex *sampleBufferMutex;
-  QFile audioFile;
+  QVector<SampleRingBuffer*> sampleRings;
+  QVector<ClickDetector*> clickDetectors;
+  // decoded frames on their way to the per-channel rings
+  QVector<int> interleaved;
+  OutputStream *captureStream;
+
+  int decodeMono(const uchar *src, int nValues);
+  int decodeInterleaved(const uchar *src, int nValues);
 };
 
 
-AudioInputDevice::AudioInputDevice(const QAudioFormat &format, QMutex *mutex, QObject *parent)
+// Decodes straight into the ring
+int AudioInputDevicePrivate::decodeMono(const uchar *src, int nValues)
+{
+  const int channelBytes = format.sampleSize() / 8;
+  SampleRingBuffer *ring = sampleRings.first();
+  int maxValue = 0;
+  while (nValues > 0) {
+    int *dst;
+    const int n = ring->beginWrite(nValues, &dst);
+    maxValue = qMax(maxValue, decode(src, dst, n));
+    ring->endWrite(n);
+    src += n * channelBytes;
+    nValues -= n;
+  }
+  return maxValue;
+}
+
+
+// Decodes up to DeinterleaveFrames frames at a time and scatters them
+// into the rings, so that every detector sees a plain sample stream.
+int AudioInputDevicePrivate::decodeInterleaved(const uchar *src, int nValues)
+{
+  const int channelBytes = format.sampleSize() / 8;
+  int maxValue = 0;
+  while (nValues > 0) {
+    const int n = qMin(nValues, interleaved.size());
+    maxValue = qMax(maxValue, decode(src, interleaved.data(), n));
+    const int frames = n / channels;
+    for (int c = 0; c < channels; ++c) {
+      SampleRingBuffer *ring = sampleRings.at(c);
+      const int *s = interleaved.constData() + c;
+      int remaining = frames;
+      while (remaining > 0) {
+        int *dst;
+        const int m = ring->beginWrite(remaining, &dst);
+        for (int i = 0; i < m; ++i) {
+          dst[i] = *s;
+          s += channels;
+        }
+        ring->endWrite(m);
+        remaining -= m;
+      }
+    }
+    src += n * channelBytes;
+    nValues -= n;
+  }
+  return maxValue;
+}
+
+
+AudioInputDevice::AudioInputDevice(const QAudioFormat &format, QObject *parent)
   : QIODevice(parent)
-  , d_ptr(new AudioInputDevicePrivate(format, mutex))
+  , d_ptr(new AudioInputDevicePrivate(format))
 {
-  Q_D(AudioInputDevice);
-  d->audioFile.setFileName("D:\\Temp\\mic.raw");
-  d->audioFile.open(QIODevice::WriteOnly | QIODevice::Truncate);
+  /* ... */
 }
 
 
 AudioInputDevice::~AudioInputDevice()
 {
-  Q_D(AudioInputDevice);
-  d->audioFile.close();
   stop();
 }
 
@@ -122,6 +193,61 @@ void AudioInputDevice::stop(void)
 }
 
 
+void AudioInputDevice::setClickDetector(ClickDetector *clickDetector, int channel)
+{
+  Q_D(AudioInputDevice);
+  Q_ASSERT(channel >= 0 && channel < d->channels);
+  d->clickDetectors[channel] = clickDetector;
+  if (clickDetector != Q_NULLPTR) {
+    clickDetector->setChannel(channel);
+    clickDetector->setSampleRing(d->sampleRings.at(channel));
+  }
+}
+
+
+ClickDetector *AudioInputDevice::clickDetector(int channel) const
+{
+  return d_ptr->clickDetectors.value(channel, Q_NULLPTR);
+}
+
+
+qint64 AudioInputDevice::clickCount(void) const
+{
+  qint64 clicks = 0;
+  foreach (const ClickDetector *clickDetector, d_ptr->clickDetectors) {
+    if (clickDetector != Q_NULLPTR) {
+      clicks += clickDetector->clickRing()->writePosition();
+    }
+  }
+  return clicks;
+}
+
+
+void AudioInputDevice::setCaptureStream(OutputStream *stream)
+{
+  Q_D(AudioInputDevice);
+  d->captureStream = stream;
+}
+
+
+OutputStream *AudioInputDevice::captureStream(void) const
+{
+  return d_ptr->captureStream;
+}
+
+
+const QAudioFormat &AudioInputDevice::format(void) const
+{
+  return d_ptr->format;
+}
+
+
+int AudioInputDevice::channelCount(void) const
+{
+  return d_ptr->channels;
+}
+
+
 qreal AudioInputDevice::level(void) const
 {
   return d_ptr->level;
@@ -134,9 +260,9 @@ int AudioInputDevice::maxAmplitude(void) const
 }
 
 
-const SampleBufferType &AudioInputDevice::sampleBuffer(void) const
+const SampleRingBuffer *AudioInputDevice::sampleRing(int channel) const
 {
-  return d_ptr->sampleBuffer;
+  return d_ptr->sampleRings.value(channel, Q_NULLPTR);
 }
 
 
@@ -151,71 +277,25 @@ qint64 AudioInputDevice::readData(char *data, qint64 maxlen)
 qint64 AudioInputDevice::writeData(const char *data, qint64 len)
 {
   Q_D(AudioInputDevice);
-  d->sampleBufferMutex->lock();
-  if (d->audioFile.isOpen()) {
-    d->audioFile.write(data, len);
+  if (d->captureStream != Q_NULLPTR) {
+    d->captureStream->write(data, len);
   }
-  d->sampleBufferMutex->unlock();
-  if (d->maxAmplitude != 0) {
+  if (d->maxAmplitude != 0 && d->decode != Q_NULLPTR) {
     Q_ASSERT(d->format.sampleSize() % 8 == 0);
     const int channelBytes = d->format.sampleSize() / 8;
-    const int sampleBytes = d->format.channelCount() * channelBytes;
-    Q_ASSERT(len % sampleBytes == 0);
-    const int nSamples = len / sampleBytes;
-    d->sampleBuffer.resize(nSamples);
-    int maxValue = 0;
-    const uchar *ptr = reinterpret_cast<const uchar *>(data);
-    for (int i = 0; i < nSamples; ++i) {
-      for (int j = 0; j < d->format.channelCount(); ++j) {
-        int value = 0;
-        if (d->format.sampleSize() == 8 && d->format.sampleType() == QAudioFormat::UnSignedInt) {
-          value = *reinterpret_cast<const quint8*>(ptr);
-        }
-        else if (d->format.sampleSize() == 8 && d->format.sampleType() == QAudioFormat::SignedInt) {
-          value = *reinterpret_cast<const qint8*>(ptr);
-        }
-        else if (d->format.sampleSize() == 16 && d->format.sampleType() == QAudioFormat::UnSignedInt) {
-          if (d->format.byteOrder() == QAudioFormat::LittleEndian) {
-            value = qFromLittleEndian<quint16>(ptr);
-          }
-          else {
-            value = qFromBigEndian<quint16>(ptr);
-          }
-        }
-        else if (d->format.sampleSize() == 16 && d->format.sampleType() == QAudioFormat::SignedInt) {
-          if (d->format.byteOrder() == QAudioFormat::LittleEndian) {
-            value = qFromLittleEndian<qint16>(ptr);
-          }
-          else {
-            value = qFromBigEndian<qint16>(ptr);
-          }
-        }
-        else if (d->format.sampleSize() == 32 && d->format.sampleType() == QAudioFormat::UnSignedInt) {
-          if (d->format.byteOrder() == QAudioFormat::LittleEndian) {
-            value = qFromLittleEndian<quint32>(ptr);
-          }
-          else {
-            value = qFromBigEndian<quint32>(ptr);
-          }
-        }
-        else if (d->format.sampleSize() == 32 && d->format.sampleType() == QAudioFormat::SignedInt) {
-          if (d->format.byteOrder() == QAudioFormat::LittleEndian) {
-            value = qFromLittleEndian<qint32>(ptr);
-          }
-          else {
-            value = qFromBigEndian<qint32>(ptr);
-          }
-        }
-        else if (d->format.sampleSize() == 32 && d->format.sampleType() == QAudioFormat::Float) {
-          value = *reinterpret_cast<const float*>(ptr) * 0x7fffffff; // assumes 0-1.0
-        }
-        maxValue = qMax(qAbs(value), maxValue);
-        ptr += channelBytes;
-        d->sampleBuffer[i] = value;
-      }
-    }
+    Q_ASSERT(len % (d->channels * channelBytes) == 0);
+    const uchar *src = reinterpret_cast<const uchar *>(data);
+    const int nValues = int(len / channelBytes);
+    int maxValue = (d->channels == 1)
+        ? d->decodeMono(src, nValues)
+        : d->decodeInterleaved(src, nValues);
     maxValue = qMin(maxValue, d->maxAmplitude);
     d->level = qreal(maxValue) / d->maxAmplitude;
+    foreach (ClickDetector *clickDetector, d->clickDetectors) {
+      if (clickDetector != Q_NULLPTR) {
+        clickDetector->process();
+      }
+    }
   }
 
   emit update();
@@ -25,10 +25,11 @@
 #include <QIODevice>
 #include <QAudioFormat>
 #include <QScopedPointer>
-#include <QMutex>
-#include "global.h"
+#include "ringbuffer.h"
 
 class AudioInputDevicePrivate;
+class ClickDetector;
+class OutputStream;
 
 
 class AudioInputDevice : public QIODevice
@@ -36,15 +37,34 @@ class AudioInputDevice : public QIODevice
   Q_OBJECT
 
 public:
-  AudioInputDevice(const QAudioFormat &format, QMutex *mutex, QObject *parent);
+  AudioInputDevice(const QAudioFormat &format, QObject *parent);
   ~AudioInputDevice();
 
   void start(void);
   void stop(void);
 
+  // Every channel is searched for clicks by a detector of its own.
+  // The device doesn't take ownership.
+  void setClickDetector(ClickDetector *, int channel = 0);
+  ClickDetector *clickDetector(int channel = 0) const;
+  // Clicks found on all channels so far
+  qint64 clickCount(void) const;
+
+  // Every buffer written to the device is appended to this stream as
+  // is, so that it can be fed through the pipeline again later (see
+  // ReplaySource). Q_NULLPTR stops recording.
+  void setCaptureStream(OutputStream *);
+  OutputStream *captureStream(void) const;
+  const QAudioFormat &format(void) const;
+
+  int channelCount(void) const;
+  // Peak level of all channels in the last buffer
   qreal level(void) const;
   int maxAmplitude(void) const;
-  const SampleBufferType &sampleBuffer(void) const;
+  // Decoded samples of `channel`, one per frame, so that ring
+  // positions are frame numbers. Attach a SampleRingBuffer::Reader to
+  // consume them.
+  const SampleRingBuffer *sampleRing(int channel = 0) const;
 
   qint64 readData(char *data, qint64 maxlen);
   qint64 writeData(const char *data, qint64 len);
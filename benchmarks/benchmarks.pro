@@ -0,0 +1,35 @@
+# Copyright (c) 2015 Oliver Lau <ola@ct.de>
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# Microbenchmarks for the hot paths. `make check` runs them; pass
+# e.g. TESTARGS="-o bench.xml,xml" for machine-readable results.
+
+TARGET = qliqbench
+TEMPLATE = app
+QT += testlib gui
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+include(../QliqCore.pri)
+
+OBJECTS_DIR = .obj
+MOC_DIR = .moc
+
+SOURCES += \
+    tst_hotpaths.cpp \
+    ../waverenderer.cpp
+
+HEADERS += \
+    ../waverenderer.h
@@ -0,0 +1,358 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// Every input is synthetic and seeded, so results are comparable
+// between runs and machines. On machines without a display, run with
+// QT_QPA_PLATFORM=offscreen.
+
+#include <QtTest>
+#include <QAudioFormat>
+#include <QSettings>
+#include <QTemporaryDir>
+#include <QtEndian>
+#include <random>
+
+#include "audioinputdevice.h"
+#include "clickdetector.h"
+#include "pulsegenerator.h"
+#include "healthcheck.h"
+#include "bitextractor.h"
+#include "entropyengine.h"
+#include "waverenderer.h"
+#include "decimator.h"
+#include "intervalstatistics.h"
+
+
+static const quint64 Seed = 0x51u;
+static const int BlockBytes = 2500;
+
+
+static QAudioFormat makeFormat(int sampleRate, int sampleSize, QAudioFormat::SampleType sampleType, int channels = 1)
+{
+  QAudioFormat format;
+  format.setCodec("audio/pcm");
+  format.setByteOrder(QAudioFormat::LittleEndian);
+  format.setChannelCount(channels);
+  format.setSampleRate(sampleRate);
+  format.setSampleSize(sampleSize);
+  format.setSampleType(sampleType);
+  return format;
+}
+
+
+// `durationMs` of Geiger pulses at `rate` counts per second
+static QByteArray makePulses(const QAudioFormat &format, qreal rate, int durationMs)
+{
+  PulseGenerator generator(format);
+  generator.setRate(rate);
+  generator.setSeed(Seed);
+  generator.open(QIODevice::ReadOnly);
+  return generator.read(qint64(format.bytesForDuration(1000 * qint64(durationMs))));
+}
+
+
+static QByteArray makeRandomBytes(int n)
+{
+  std::mt19937_64 rng(Seed);
+  QByteArray bytes(n, Qt::Uninitialized);
+  for (int i = 0; i < n; ++i) {
+    bytes[i] = char(rng() & 0xff);
+  }
+  return bytes;
+}
+
+
+class CountingSink : public BitSink
+{
+public:
+  CountingSink(void)
+    : mBits(0)
+    , mOnes(0)
+  { /* ... */ }
+  void addBit(int bit)
+  {
+    ++mBits;
+    mOnes += bit;
+  }
+  qint64 mBits;
+  qint64 mOnes;
+};
+
+
+class HotPaths : public QObject
+{
+  Q_OBJECT
+
+private slots:
+  void writeData_data(void);
+  void writeData(void);
+  void waveRefresh_data(void);
+  void waveRefresh(void);
+  void decimate_data(void);
+  void decimate(void);
+  void monobit(void);
+  void entropy(void);
+  void extractor_data(void);
+  void extractor(void);
+  void intervalStatistics(void);
+  void pipeline_data(void);
+  void pipeline(void);
+};
+
+
+void HotPaths::writeData_data(void)
+{
+  QTest::addColumn<int>("sampleSize");
+  QTest::addColumn<int>("sampleType");
+  QTest::addColumn<int>("channels");
+  QTest::addColumn<bool>("detect");
+  QTest::addColumn<bool>("pulseAnalysis");
+  QTest::newRow("u8") << 8 << int(QAudioFormat::UnSignedInt) << 1 << false << false;
+  QTest::newRow("s16") << 16 << int(QAudioFormat::SignedInt) << 1 << false << false;
+  QTest::newRow("s32") << 32 << int(QAudioFormat::SignedInt) << 1 << false << false;
+  QTest::newRow("float") << 32 << int(QAudioFormat::Float) << 1 << false << false;
+  QTest::newRow("u8+detector") << 8 << int(QAudioFormat::UnSignedInt) << 1 << true << false;
+  QTest::newRow("s16+detector") << 16 << int(QAudioFormat::SignedInt) << 1 << true << false;
+  QTest::newRow("s32+detector") << 32 << int(QAudioFormat::SignedInt) << 1 << true << false;
+  QTest::newRow("float+detector") << 32 << int(QAudioFormat::Float) << 1 << true << false;
+  QTest::newRow("s16x4") << 16 << int(QAudioFormat::SignedInt) << 4 << false << false;
+  QTest::newRow("s16x4+detectors") << 16 << int(QAudioFormat::SignedInt) << 4 << true << false;
+  QTest::newRow("s16+spectrum") << 16 << int(QAudioFormat::SignedInt) << 1 << true << true;
+}
+
+
+// One 100 ms buffer of a 48 kHz stream at 1000 counts/s per channel,
+// the way QAudioInput delivers it
+void HotPaths::writeData(void)
+{
+  QFETCH(int, sampleSize);
+  QFETCH(int, sampleType);
+  QFETCH(int, channels);
+  QFETCH(bool, detect);
+  QFETCH(bool, pulseAnalysis);
+  const QAudioFormat &format = makeFormat(48000, sampleSize, QAudioFormat::SampleType(sampleType), channels);
+  const QByteArray &buffer = makePulses(format, 1000, 100);
+  AudioInputDevice device(format, Q_NULLPTR);
+  if (detect) {
+    for (int c = 0; c < channels; ++c) {
+      ClickDetector *detector = new ClickDetector(&device);
+      detector->setAudioFormat(format);
+      detector->setThreshold(AudioInputDevice::maxAmplitudeForFormat(format) / 4);
+      detector->setLockTimeNs(200 * 1000);
+      detector->setPulseFloor(AudioInputDevice::maxAmplitudeForFormat(format) / 64);
+      detector->setPulseAnalysis(pulseAnalysis);
+      device.setClickDetector(detector, c);
+    }
+  }
+  device.start();
+  QBENCHMARK {
+    device.write(buffer);
+  }
+}
+
+
+void HotPaths::waveRefresh_data(void)
+{
+  QTest::addColumn<int>("sampleRate");
+  QTest::newRow("11025") << 11025;
+  QTest::newRow("96000") << 96000;
+  QTest::newRow("192000") << 192000;
+}
+
+
+// Feeding a 10 ms buffer to the device, decimating it for display
+// and rendering a frame; writeData tells the device's share
+void HotPaths::waveRefresh(void)
+{
+  QFETCH(int, sampleRate);
+  const QAudioFormat &format = makeFormat(sampleRate, 16, QAudioFormat::SignedInt);
+  AudioInputDevice device(format, Q_NULLPTR);
+  ClickDetector detector;
+  detector.setAudioFormat(format);
+  detector.setThreshold(8000);
+  device.setClickDetector(&detector);
+  device.start();
+  const QByteArray &pulses = makePulses(format, 100, 2000);
+  const int chunkBytes = format.bytesForDuration(10 * 1000);
+
+  WaveRenderer renderer;
+  renderer.setAudioFormat(format);
+  renderer.setSampleRing(device.sampleRing());
+  renderer.setClickDetector(&detector);
+  renderer.setSize(QSize(800, 200));
+  int offset = 0;
+  QBENCHMARK {
+    device.write(pulses.constData() + offset, chunkBytes);
+    renderer.render();
+    offset += chunkBytes;
+    if (offset + chunkBytes > pulses.size()) {
+      offset = 0;
+    }
+  }
+}
+
+
+void HotPaths::decimate_data(void)
+{
+  QTest::addColumn<int>("factor");
+  QTest::newRow("2") << 2;
+  QTest::newRow("4") << 4;
+  QTest::newRow("8") << 8;
+}
+
+
+// One 100 ms buffer of a 192 kHz stream
+void HotPaths::decimate(void)
+{
+  QFETCH(int, factor);
+  const QAudioFormat &format = makeFormat(192000, 16, QAudioFormat::SignedInt);
+  const QByteArray &pulses = makePulses(format, 1000, 100);
+  const int n = pulses.size() / 2;
+  QVector<int> samples(n);
+  for (int i = 0; i < n; ++i) {
+    samples[i] = qFromLittleEndian<qint16>(reinterpret_cast<const uchar*>(pulses.constData()) + 2 * i);
+  }
+  QVector<int> decimated(n / factor + 1);
+  Decimator decimator(factor);
+  QBENCHMARK {
+    decimator.process(samples.constData(), n, decimated.data());
+  }
+}
+
+
+void HotPaths::monobit(void)
+{
+  const QByteArray &block = makeRandomBytes(BlockBytes);
+  int notPassed = 0;
+  int tests = 0;
+  QBENCHMARK {
+    testMonobit(block, notPassed, tests);
+  }
+}
+
+
+void HotPaths::entropy(void)
+{
+  const QByteArray &block = makeRandomBytes(BlockBytes);
+  qreal h = 0.0;
+  QBENCHMARK {
+    h = testEntropy(block);
+  }
+  QVERIFY(h > 7.0);
+}
+
+
+void HotPaths::extractor_data(void)
+{
+  QTest::addColumn<QString>("id");
+  foreach (const QString &id, BitExtractor::ids()) {
+    QTest::newRow(id.toLatin1().constData()) << id;
+  }
+}
+
+
+// 100000 exponentially distributed intervals with a mean of 500 frames
+void HotPaths::extractor(void)
+{
+  QFETCH(QString, id);
+  std::mt19937_64 rng(Seed);
+  std::exponential_distribution<double> wait(1.0 / 500);
+  QVector<qint64> dtFrames(100000);
+  for (int i = 0; i < dtFrames.size(); ++i) {
+    dtFrames[i] = 1 + qint64(wait(rng));
+  }
+  QScopedPointer<BitExtractor> extractor(BitExtractor::create(id));
+  QVERIFY(!extractor.isNull());
+  CountingSink sink;
+  QBENCHMARK {
+    extractor->reset();
+    for (int i = 0; i < dtFrames.size(); ++i) {
+      extractor->addInterval(dtFrames.at(i), &sink);
+    }
+  }
+  QVERIFY(sink.mBits > 0);
+}
+
+
+// The same intervals as extractor, through the moments, the histogram
+// and the quantile estimators
+void HotPaths::intervalStatistics(void)
+{
+  std::mt19937_64 rng(Seed);
+  std::exponential_distribution<double> wait(1.0 / 500);
+  QVector<qint64> dtFrames(100000);
+  for (int i = 0; i < dtFrames.size(); ++i) {
+    dtFrames[i] = 1 + qint64(wait(rng));
+  }
+  IntervalStatistics statistics;
+  QBENCHMARK {
+    statistics.reset();
+    for (int i = 0; i < dtFrames.size(); ++i) {
+      statistics.add(dtFrames.at(i));
+    }
+  }
+  QCOMPARE(statistics.count(), qint64(dtFrames.size()));
+  QVERIFY(qAbs(statistics.coefficientOfVariation() - 1.0) < 0.05);
+}
+
+
+void HotPaths::pipeline_data(void)
+{
+  QTest::addColumn<QString>("extractor");
+  QTest::addColumn<qreal>("rate");
+  QTest::newRow("pair@1k") << QString("pair") << qreal(1000);
+  QTest::newRow("pair@10k") << QString("pair") << qreal(10000);
+  QTest::newRow("peres@10k") << QString("peres") << qreal(10000);
+}
+
+
+// Everything behind the sound card: decoding, detection, extraction,
+// byte assembly, health tests, conditioning and the output files, for
+// one second of audio
+void HotPaths::pipeline(void)
+{
+  QFETCH(QString, extractor);
+  QFETCH(qreal, rate);
+  QTemporaryDir dir;
+  QVERIFY(dir.isValid());
+  QSettings settings(dir.path() + "/qliq.ini", QSettings::IniFormat);
+  settings.setValue("output/directory", dir.path());
+  settings.setValue("options/extractor", extractor);
+  settings.setValue("analysis/threshold", 8000);
+  settings.setValue("analysis/lockTimeNs", 50 * 1000);
+
+  const QAudioFormat &format = makeFormat(48000, 16, QAudioFormat::SignedInt);
+  const QByteArray &audio = makePulses(format, rate, 1000);
+  const int chunkBytes = format.bytesForDuration(100 * 1000);
+  EntropyEngine engine(format);
+  engine.restoreSettings(settings);
+  engine.audioInputDevice()->start();
+  engine.start();
+  QBENCHMARK {
+    for (int i = 0; i < audio.size(); i += chunkBytes) {
+      engine.audioInputDevice()->write(audio.constData() + i, qMin(chunkBytes, audio.size() - i));
+    }
+  }
+  engine.stop();
+  QVERIFY(engine.byteCount() > 0);
+}
+
+
+QTEST_MAIN(HotPaths)
+#include "tst_hotpaths.moc"
@@ -0,0 +1,303 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "bitextractor.h"
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QScopedPointer>
+
+
+QStringList BitExtractor::ids(void)
+{
+  return QStringList() << "pair" << "vonneumann" << "peres" << "lsb";
+}
+
+
+BitExtractor *BitExtractor::create(const QString &id)
+{
+  if (id == "pair")
+    return new PairComparisonExtractor;
+  if (id == "vonneumann")
+    return new VonNeumannExtractor;
+  if (id == "peres")
+    return new PeresExtractor;
+  if (id == "lsb")
+    return new LsbExtractor;
+  return Q_NULLPTR;
+}
+
+
+PairComparisonExtractor::PairComparisonExtractor(void)
+  : mPreventBias(true)
+{
+  reset();
+}
+
+
+QString PairComparisonExtractor::id(void) const
+{
+  return "pair";
+}
+
+
+QString PairComparisonExtractor::name(void) const
+{
+  return QObject::tr("Pair comparison");
+}
+
+
+void PairComparisonExtractor::addInterval(qint64 dtFrames, BitSink *sink)
+{
+  mDt[mIndex] = dtFrames;
+  if (++mIndex > 1) {
+    mIndex = 0;
+    const int bit = (mDt[1] > mDt[0]) ^ mFlipBit ? 0 : 1;
+    sink->addBit(bit);
+    if (mPreventBias) {
+      mFlipBit = !mFlipBit;
+    }
+  }
+}
+
+
+void PairComparisonExtractor::reset(void)
+{
+  mDt[0] = 0;
+  mDt[1] = 0;
+  mIndex = 0;
+  mFlipBit = false;
+}
+
+
+// A pair, and with bias prevention the pair that flips the bit back
+int PairComparisonExtractor::period(void) const
+{
+  return mPreventBias ? 4 : 2;
+}
+
+
+void PairComparisonExtractor::setPreventBias(bool preventBias)
+{
+  mPreventBias = preventBias;
+}
+
+
+VonNeumannExtractor::VonNeumannExtractor(void)
+{
+  reset();
+}
+
+
+QString VonNeumannExtractor::id(void) const
+{
+  return "vonneumann";
+}
+
+
+QString VonNeumannExtractor::name(void) const
+{
+  return QObject::tr("von Neumann");
+}
+
+
+void VonNeumannExtractor::addInterval(qint64 dtFrames, BitSink *sink)
+{
+  const int bit = int(dtFrames & 1);
+  if (mPending < 0) {
+    mPending = bit;
+  }
+  else {
+    if (mPending != bit) {
+      sink->addBit(mPending);
+    }
+    mPending = -1;
+  }
+}
+
+
+void VonNeumannExtractor::reset(void)
+{
+  mPending = -1;
+}
+
+
+int VonNeumannExtractor::period(void) const
+{
+  return 2;
+}
+
+
+PeresExtractor::PeresExtractor(int blockSize, int depth)
+  : mBlockSize(blockSize & ~1)
+  , mDepth(depth)
+  , mBlock(mBlockSize)
+  , mScratch(mBlockSize * (depth + 1))
+{
+  reset();
+}
+
+
+QString PeresExtractor::id(void) const
+{
+  return "peres";
+}
+
+
+QString PeresExtractor::name(void) const
+{
+  return QObject::tr("Iterated von Neumann (Peres)");
+}
+
+
+void PeresExtractor::addInterval(qint64 dtFrames, BitSink *sink)
+{
+  mBlock[mFill] = quint8(dtFrames & 1);
+  if (++mFill == mBlockSize) {
+    extract(mBlock.constData(), mBlockSize, mDepth, mScratch.data(), sink);
+    mFill = 0;
+  }
+}
+
+
+// Psi(x) = VN(x) | Psi(u) | Psi(v), with u the XOR of each pair and
+// v the common value of each pair of equal bits. u and v are built in
+// `scratch`; the recursion for u is finished before the one for v
+// starts, so both can use the same scratch space further up.
+void PeresExtractor::extract(const quint8 *bits, int n, int depth, quint8 *scratch, BitSink *sink)
+{
+  if (depth <= 0 || n < 2)
+    return;
+  const int pairs = n / 2;
+  quint8 *u = scratch;
+  quint8 *v = scratch + pairs;
+  int nv = 0;
+  for (int i = 0; i < pairs; ++i) {
+    const quint8 a = bits[2 * i];
+    const quint8 b = bits[2 * i + 1];
+    if (a != b) {
+      sink->addBit(a);
+    }
+    else {
+      v[nv++] = a;
+    }
+    u[i] = a ^ b;
+  }
+  extract(u, pairs, depth - 1, scratch + n, sink);
+  extract(v, nv, depth - 1, scratch + n, sink);
+}
+
+
+void PeresExtractor::reset(void)
+{
+  mFill = 0;
+}
+
+
+int PeresExtractor::period(void) const
+{
+  return mBlockSize;
+}
+
+
+LsbExtractor::LsbExtractor(int bits)
+  : mBits(bits)
+{
+  /* ... */
+}
+
+
+QString LsbExtractor::id(void) const
+{
+  return "lsb";
+}
+
+
+QString LsbExtractor::name(void) const
+{
+  return QObject::tr("Interval LSBs (%1 bit)").arg(mBits);
+}
+
+
+void LsbExtractor::addInterval(qint64 dtFrames, BitSink *sink)
+{
+  for (int i = 0; i < mBits; ++i) {
+    sink->addBit(int((dtFrames >> i) & 1));
+  }
+}
+
+
+void LsbExtractor::reset(void)
+{
+  /* ... */
+}
+
+
+int LsbExtractor::period(void) const
+{
+  return 1;
+}
+
+
+class CountingBitSink : public BitSink
+{
+public:
+  CountingBitSink(void)
+    : count(0)
+    , ones(0)
+  { /* ... */ }
+  void addBit(int bit)
+  {
+    ++count;
+    ones += bit;
+  }
+  qint64 count;
+  qint64 ones;
+};
+
+
+QVector<ExtractorBenchmarkResult> benchmarkExtractors(const QVector<qint64> &dtFrames, int sampleRate)
+{
+  QVector<ExtractorBenchmarkResult> results;
+  qint64 totalFrames = 0;
+  for (int i = 0; i < dtFrames.size(); ++i) {
+    totalFrames += dtFrames.at(i);
+  }
+  const qreal streamSeconds = qreal(totalFrames) / sampleRate;
+  foreach (const QString &id, BitExtractor::ids()) {
+    QScopedPointer<BitExtractor> extractor(BitExtractor::create(id));
+    CountingBitSink sink;
+    QElapsedTimer t;
+    t.start();
+    for (int i = 0; i < dtFrames.size(); ++i) {
+      extractor->addInterval(dtFrames.at(i), &sink);
+    }
+    const qint64 ns = qMax<qint64>(1, t.nsecsElapsed());
+    ExtractorBenchmarkResult result;
+    result.id = extractor->id();
+    result.name = extractor->name();
+    result.clicks = dtFrames.size();
+    result.bits = sink.count;
+    result.bitsPerClick = dtFrames.isEmpty() ? 0.0 : qreal(sink.count) / dtFrames.size();
+    result.bitsPerSecond = (streamSeconds > 0.0) ? sink.count / streamSeconds : 0.0;
+    result.extractionBitsPerSecond = 1e9 * sink.count / ns;
+    results.append(result);
+  }
+  return results;
+}
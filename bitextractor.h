@@ -0,0 +1,161 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef __BITEXTRACTOR_H_
+#define __BITEXTRACTOR_H_
+
+#include <QtGlobal>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+
+// Receives the bits a BitExtractor produces.
+class BitSink
+{
+public:
+  virtual ~BitSink() { /* ... */ }
+  virtual void addBit(int bit) = 0;
+};
+
+
+// Turns a stream of inter-arrival times into random bits. Times are
+// given in frames (see ClickEvent::dtFrames).
+class BitExtractor
+{
+public:
+  virtual ~BitExtractor() { /* ... */ }
+
+  // Short identifier, e.g. for the settings file
+  virtual QString id(void) const = 0;
+  // Human readable name
+  virtual QString name(void) const = 0;
+  virtual void addInterval(qint64 dtFrames, BitSink *sink) = 0;
+  virtual void reset(void) = 0;
+  // Number of intervals after which the extractor is back in its
+  // reset state. A stream cut into pieces of a multiple of this many
+  // intervals can be extracted piece by piece, e.g. in parallel, with
+  // the same result.
+  virtual int period(void) const = 0;
+
+  static QStringList ids(void);
+  // Returns Q_NULLPTR for unknown ids.
+  static BitExtractor *create(const QString &id);
+};
+
+
+// Compares two consecutive, non-overlapping intervals: one bit per
+// two clicks. To compensate for bias the result can be inverted on
+// every other bit.
+class PairComparisonExtractor : public BitExtractor
+{
+public:
+  PairComparisonExtractor(void);
+  QString id(void) const;
+  QString name(void) const;
+  void addInterval(qint64 dtFrames, BitSink *sink);
+  void reset(void);
+  int period(void) const;
+  void setPreventBias(bool);
+
+private:
+  qint64 mDt[2];
+  int mIndex;
+  bool mFlipBit;
+  bool mPreventBias;
+};
+
+
+// Takes the least significant bit of every interval and removes bias
+// with von Neumann's method: 01 -> 0, 10 -> 1, 00 and 11 are dropped.
+// At most one bit per two clicks, a quarter on average.
+class VonNeumannExtractor : public BitExtractor
+{
+public:
+  VonNeumannExtractor(void);
+  QString id(void) const;
+  QString name(void) const;
+  void addInterval(qint64 dtFrames, BitSink *sink);
+  void reset(void);
+  int period(void) const;
+
+private:
+  int mPending;
+};
+
+
+// Iterated von Neumann extraction (Peres 1992) on blocks of interval
+// LSBs. Reuses the information von Neumann throws away, so its yield
+// approaches the entropy of the raw bits as the depth grows.
+class PeresExtractor : public BitExtractor
+{
+public:
+  explicit PeresExtractor(int blockSize = 256, int depth = 8);
+  QString id(void) const;
+  QString name(void) const;
+  void addInterval(qint64 dtFrames, BitSink *sink);
+  void reset(void);
+  int period(void) const;
+
+private:
+  void extract(const quint8 *bits, int n, int depth, quint8 *scratch, BitSink *sink);
+  int mBlockSize;
+  int mDepth;
+  QVector<quint8> mBlock;
+  int mFill;
+  QVector<quint8> mScratch;
+};
+
+
+// Uses the `bits` least significant bits of every interval directly.
+// Highest yield, but only sound if the sampling clock is much finer
+// than the spread of the intervals.
+class LsbExtractor : public BitExtractor
+{
+public:
+  explicit LsbExtractor(int bits = 2);
+  QString id(void) const;
+  QString name(void) const;
+  void addInterval(qint64 dtFrames, BitSink *sink);
+  void reset(void);
+  int period(void) const;
+
+private:
+  int mBits;
+};
+
+
+struct ExtractorBenchmarkResult
+{
+  QString id;
+  QString name;
+  qint64 clicks;
+  qint64 bits;
+  qreal bitsPerClick;
+  // with the click rate of the recorded stream
+  qreal bitsPerSecond;
+  // how fast the extractor itself runs
+  qreal extractionBitsPerSecond;
+};
+
+// Runs every extractor on the same interval stream.
+extern QVector<ExtractorBenchmarkResult> benchmarkExtractors(const QVector<qint64> &dtFrames, int sampleRate);
+
+#endif // __BITEXTRACTOR_H_
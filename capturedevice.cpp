@@ -0,0 +1,156 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "capturedevice.h"
+#include "audioinputdevice.h"
+#include "clickdetector.h"
+
+#include <QDebug>
+#include <QAudioInput>
+#include <QVector>
+
+
+class CaptureDevicePrivate
+{
+public:
+  CaptureDevicePrivate(const QAudioDeviceInfo &deviceInfo, const QAudioFormat &format)
+    : deviceInfo(deviceInfo)
+    , format(format)
+    , audioInput(new AudioInputDevice(format, Q_NULLPTR))
+    , volume(1.0)
+  { /* ... */ }
+  ~CaptureDevicePrivate() { /* ... */ }
+  const QAudioDeviceInfo deviceInfo;
+  const QAudioFormat format;
+  // no parent, so that it can be moved to the capture thread
+  QScopedPointer<AudioInputDevice> audioInput;
+  QVector<ClickDetector*> clickDetectors;
+  qreal volume;
+};
+
+
+CaptureDevice::CaptureDevice(const QAudioDeviceInfo &deviceInfo, const QAudioFormat &format, QObject *parent)
+  : QThread(parent)
+  , d_ptr(new CaptureDevicePrivate(deviceInfo, format))
+{
+  Q_D(CaptureDevice);
+  qRegisterMetaType<QAudio::State>("QAudio::State");
+  for (int c = 0; c < d->audioInput->channelCount(); ++c) {
+    // children of the AudioInputDevice, so that they move along
+    ClickDetector *clickDetector = new ClickDetector(d->audioInput.data());
+    clickDetector->setAudioFormat(format);
+    d->audioInput->setClickDetector(clickDetector, c);
+    d->clickDetectors.append(clickDetector);
+  }
+}
+
+
+CaptureDevice::~CaptureDevice()
+{
+  stopCapture();
+}
+
+
+const QAudioDeviceInfo &CaptureDevice::deviceInfo(void) const
+{
+  return d_ptr->deviceInfo;
+}
+
+
+const QAudioFormat &CaptureDevice::format(void) const
+{
+  return d_ptr->format;
+}
+
+
+AudioInputDevice *CaptureDevice::audioInputDevice(void) const
+{
+  return d_ptr->audioInput.data();
+}
+
+
+int CaptureDevice::channelCount(void) const
+{
+  return d_ptr->clickDetectors.size();
+}
+
+
+ClickDetector *CaptureDevice::clickDetector(int channel) const
+{
+  return d_ptr->clickDetectors.value(channel, Q_NULLPTR);
+}
+
+
+void CaptureDevice::startCapture(void)
+{
+  Q_D(CaptureDevice);
+  if (isRunning())
+    return;
+  d->audioInput->moveToThread(this);
+  start(QThread::TimeCriticalPriority);
+}
+
+
+void CaptureDevice::stopCapture(void)
+{
+  // a quit() before run() has entered the event loop makes exec()
+  // return immediately, so there's no race with startCapture()
+  quit();
+  wait();
+}
+
+
+qreal CaptureDevice::volume(void) const
+{
+  return d_ptr->volume;
+}
+
+
+void CaptureDevice::setVolume(qreal volume)
+{
+  Q_D(CaptureDevice);
+  d->volume = volume;
+  emit volumeChanged(volume);
+}
+
+
+void CaptureDevice::run(void)
+{
+  Q_D(CaptureDevice);
+  QAudioInput audio(d->deviceInfo, d->format);
+  audio.setVolume(d->volume);
+  QObject::connect(this, &CaptureDevice::volumeChanged, &audio, &QAudioInput::setVolume);
+  QObject::connect(&audio, &QAudioInput::stateChanged, [this, &audio](QAudio::State state) {
+    if (state == QAudio::StoppedState && audio.error() != QAudio::NoError) {
+      emit message(tr("Audio input %1 stopped with error %2.")
+                   .arg(deviceInfo().deviceName())
+                   .arg(int(audio.error())));
+    }
+    emit stateChanged(state);
+  });
+  d->audioInput->start();
+  audio.start(d->audioInput.data());
+  exec();
+  audio.stop();
+  d->audioInput->stop();
+  // back to the owner's thread, so that replays and simulations can
+  // feed the device from there
+  d->audioInput->moveToThread(thread());
+}
@@ -0,0 +1,83 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef __CAPTUREDEVICE_H_
+#define __CAPTUREDEVICE_H_
+
+#include <QThread>
+#include <QString>
+#include <QAudio>
+#include <QAudioFormat>
+#include <QAudioDeviceInfo>
+#include <QScopedPointer>
+
+class AudioInputDevice;
+class ClickDetector;
+class CaptureDevicePrivate;
+
+
+// One sound card with a ClickDetector per channel. While capturing,
+// the QAudioInput, the AudioInputDevice it writes to and the detectors
+// live on a thread of their own, so that neither the GUI nor another
+// sound card can hold up the audio callbacks. Receivers on other
+// threads therefore read the clicks from the detectors' click rings
+// (see ClickDetector::clickRing()).
+//
+// When not capturing, the AudioInputDevice and the detectors belong
+// to the thread that created the CaptureDevice again and can be fed
+// from there, e.g. by a ReplaySource or a PulseGenerator.
+class CaptureDevice : public QThread
+{
+  Q_OBJECT
+
+public:
+  CaptureDevice(const QAudioDeviceInfo &deviceInfo, const QAudioFormat &format, QObject *parent = Q_NULLPTR);
+  ~CaptureDevice();
+
+  const QAudioDeviceInfo &deviceInfo(void) const;
+  const QAudioFormat &format(void) const;
+  AudioInputDevice *audioInputDevice(void) const;
+  int channelCount(void) const;
+  ClickDetector *clickDetector(int channel) const;
+
+  // Starts the capture thread, which opens the sound card
+  void startCapture(void);
+  // Closes the sound card and waits for the thread to finish
+  void stopCapture(void);
+
+  qreal volume(void) const;
+  void setVolume(qreal);
+
+signals:
+  // Emitted from the capture thread
+  void stateChanged(QAudio::State);
+  void message(const QString &);
+  void volumeChanged(qreal);
+
+protected:
+  void run(void);
+
+private:
+  QScopedPointer<CaptureDevicePrivate> d_ptr;
+  Q_DECLARE_PRIVATE(CaptureDevice)
+  Q_DISABLE_COPY(CaptureDevice)
+};
+
+#endif // __CAPTUREDEVICE_H_
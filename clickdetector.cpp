@@ -0,0 +1,284 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "clickdetector.h"
+#include "audioinputdevice.h"
+
+#include <QDebug>
+#include <QDateTime>
+#include <limits>
+#include <atomic>
+
+
+static const int ChunkSize = 1024;
+// a few seconds at the highest rates the detector can resolve, so
+// that a busy GUI thread doesn't lose clicks
+static const int ClickRingSize = 16384;
+// Pulses are measured up to this width; longer ones go to the last bin
+static const qint64 MaxPulseWidthUs = 2 * 1000;
+
+
+class ClickDetectorPrivate
+{
+public:
+  ClickDetectorPrivate(void)
+    : threshold(std::numeric_limits<int>::max())
+    , lockTimeNs(4 * 1000 * 1000)
+    , pulseAnalysis(false)
+    , pulseFloor(0)
+    , channel(0)
+    , lastClickFrame(0)
+    , nextClickFrame(0)
+    , chunk(ChunkSize)
+    , clickRing(ClickRingSize)
+    , pulsePeak(0)
+    , pulseWidth(0)
+    , pulseArea(0)
+  { /* ... */ }
+  ~ClickDetectorPrivate() { /* ... */ }
+  QAudioFormat format;
+  // may be changed from any thread, e.g. by the GUI while the
+  // detector runs on a capture thread
+  std::atomic<int> threshold;
+  std::atomic<qint64> lockTimeNs;
+  std::atomic<bool> pulseAnalysis;
+  std::atomic<int> pulseFloor;
+  int channel;
+  qint64 lastClickFrame;
+  qint64 nextClickFrame;
+  TimeAnchor anchor;
+  SampleRingBuffer::Reader sampleReader;
+  QVector<int> chunk;
+  ClickRingBuffer clickRing;
+  PulseSpectrum pulseSpectrum;
+  // the pulse being measured; pulseWidth is 0 between pulses
+  int pulsePeak;
+  int pulseWidth;
+  qint64 pulseArea;
+
+  // Longest inter-arrival time in frames that is still within the
+  // lock time, i.e. a click needs dtFrames > lockFrames().
+  inline qint64 lockFrames(void) const
+  {
+    return lockTimeNs * format.sampleRate() / Q_INT64_C(1000000000);
+  }
+};
+
+
+ClickDetector::ClickDetector(QObject *parent)
+  : QObject(parent)
+  , d_ptr(new ClickDetectorPrivate)
+{
+  qRegisterMetaType<ClickEvent>("ClickEvent");
+}
+
+
+ClickDetector::~ClickDetector()
+{
+  /* ... */
+}
+
+
+void ClickDetector::setAudioFormat(const QAudioFormat &format)
+{
+  Q_D(ClickDetector);
+  d->format = format;
+  const int maxHeight = qMax(1, AudioInputDevice::maxAmplitudeForFormat(format));
+  const int maxWidth = qMax(PulseSpectrum::Bins, format.framesForDuration(MaxPulseWidthUs));
+  // a pulse that stays at full scale for a quarter of the width range
+  d->pulseSpectrum.setRanges(maxHeight, maxWidth, qint64(maxHeight) * maxWidth / 4);
+  reset();
+}
+
+
+void ClickDetector::setSampleRing(const SampleRingBuffer *sampleRing)
+{
+  Q_D(ClickDetector);
+  d->sampleReader.attach(sampleRing);
+  reset();
+}
+
+
+void ClickDetector::setChannel(int channel)
+{
+  Q_D(ClickDetector);
+  d->channel = channel;
+}
+
+
+int ClickDetector::channel(void) const
+{
+  return d_ptr->channel;
+}
+
+
+void ClickDetector::reset(void)
+{
+  Q_D(ClickDetector);
+  d->lastClickFrame = d->sampleReader.position();
+  d->nextClickFrame = d->lastClickFrame;
+  d->anchor = TimeAnchor();
+  d->pulseWidth = 0;
+}
+
+
+void ClickDetector::process(void)
+{
+  Q_D(ClickDetector);
+  if (!d->format.isValid() || !d->sampleReader.isAttached())
+    return;
+  const int sampleRate = d->format.sampleRate();
+  const int channel = d->channel;
+  const int threshold = d->threshold;
+  const qint64 lockFrames = d->lockFrames();
+  const bool pulseAnalysis = d->pulseAnalysis;
+  const int pulseFloor = d->pulseFloor;
+  auto addClick = [&](qint64 frame) {
+    const ClickEvent event(frame, frame - d->lastClickFrame, sampleRate, channel);
+    d->lastClickFrame = frame;
+    d->nextClickFrame = frame + lockFrames + 1;
+    d->clickRing.write(&event, 1);
+    emit click(event);
+  };
+  int n;
+  while ((n = d->sampleReader.read(d->chunk.data(), ChunkSize)) > 0) {
+    const qint64 chunkFrame = d->sampleReader.position() - n;
+    if (!d->anchor.isValid()) {
+      d->anchor.frame = chunkFrame;
+      d->anchor.msecsSinceEpoch = QDateTime::currentMSecsSinceEpoch();
+    }
+    const int *samples = d->chunk.constData();
+    if (pulseAnalysis) {
+      // every sample belongs to the spectrum, so the lock time can't
+      // be skipped
+      for (int i = 0; i < n; ++i) {
+        const int value = samples[i];
+        if (value > pulseFloor) {
+          if (d->pulseWidth == 0) {
+            d->pulsePeak = value;
+            d->pulseArea = 0;
+          }
+          d->pulsePeak = qMax(d->pulsePeak, value);
+          d->pulseArea += value;
+          ++d->pulseWidth;
+        }
+        else if (d->pulseWidth > 0) {
+          d->pulseSpectrum.addPulse(d->pulsePeak, d->pulseWidth, d->pulseArea);
+          d->pulseWidth = 0;
+        }
+        if (value > threshold && chunkFrame + i >= d->nextClickFrame) {
+          addClick(chunkFrame + i);
+        }
+      }
+    }
+    else {
+      // forget a pulse left over from before analysis was switched off
+      d->pulseWidth = 0;
+      for (qint64 i = qMax(qint64(0), d->nextClickFrame - chunkFrame); i < n; ++i) {
+        if (samples[i] > threshold) {
+          addClick(chunkFrame + i);
+          i += lockFrames;
+        }
+      }
+    }
+  }
+}
+
+
+int ClickDetector::threshold(void) const
+{
+  return d_ptr->threshold;
+}
+
+
+void ClickDetector::setThreshold(int threshold)
+{
+  Q_D(ClickDetector);
+  d->threshold = threshold;
+  emit thresholdChanged(threshold);
+}
+
+
+qint64 ClickDetector::lockTimeNs(void) const
+{
+  return d_ptr->lockTimeNs;
+}
+
+
+void ClickDetector::setLockTimeNs(qint64 lockTimeNs)
+{
+  Q_D(ClickDetector);
+  d->lockTimeNs = lockTimeNs;
+  emit lockTimeChanged(lockTimeNs);
+}
+
+
+qint64 ClickDetector::elapsedNs(void) const
+{
+  const int sampleRate = d_ptr->format.sampleRate();
+  if (sampleRate <= 0)
+    return 0;
+  const qint64 frame = d_ptr->sampleReader.position();
+  return (frame / sampleRate) * Q_INT64_C(1000000000) + (frame % sampleRate) * Q_INT64_C(1000000000) / sampleRate;
+}
+
+
+TimeAnchor ClickDetector::anchor(void) const
+{
+  return d_ptr->anchor;
+}
+
+
+const ClickRingBuffer *ClickDetector::clickRing(void) const
+{
+  return &d_ptr->clickRing;
+}
+
+
+bool ClickDetector::pulseAnalysis(void) const
+{
+  return d_ptr->pulseAnalysis;
+}
+
+
+void ClickDetector::setPulseAnalysis(bool enabled)
+{
+  Q_D(ClickDetector);
+  d->pulseAnalysis = enabled;
+}
+
+
+int ClickDetector::pulseFloor(void) const
+{
+  return d_ptr->pulseFloor;
+}
+
+
+void ClickDetector::setPulseFloor(int floor)
+{
+  Q_D(ClickDetector);
+  d->pulseFloor = floor;
+}
+
+
+PulseSpectrum *ClickDetector::pulseSpectrum(void) const
+{
+  return &d_ptr->pulseSpectrum;
+}
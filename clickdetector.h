@@ -0,0 +1,104 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef __CLICKDETECTOR_H_
+#define __CLICKDETECTOR_H_
+
+#include <QObject>
+#include <QVector>
+#include <QAudioFormat>
+#include <QScopedPointer>
+#include "ringbuffer.h"
+#include "clickevent.h"
+#include "pulsespectrum.h"
+
+class ClickDetectorPrivate;
+
+typedef RingBuffer<ClickEvent> ClickRingBuffer;
+
+// Finds Geiger clicks in a stream of samples. The detector doesn't
+// know anything about widgets; it's fed directly from the audio path
+// (see AudioInputDevice::writeData()) so that detection keeps pace
+// with the sound card no matter how long painting takes.
+//
+// A detector watches a single channel: it reads the samples through
+// its own cursor into that channel's sample ring (see
+// AudioInputDevice::sampleRing()) and publishes every click into a
+// ring of its own, from which EntropyEngine and WaveRenderer pick them
+// up. Each channel has its own threshold and lock time.
+//
+// click() is emitted after the event has been written to the ring. It
+// carries nothing the ring doesn't: a queued signal costs a heap
+// allocation per click, so receivers on other threads should poll the
+// ring instead of connecting to it.
+//
+// Ring positions serve as a 64-bit frame counter, so click times are
+// exact multiples of 1 / sampleRate. The wall-clock time at which the
+// first frame arrived is recorded separately in anchor().
+//
+// With pulse analysis switched on, the detector also measures every
+// excursion above pulseFloor() in the same pass, whether it crosses
+// the threshold or not, and counts its height, width and area in
+// pulseSpectrum(). The spectrum shows where the pulses end and the
+// noise begins, to choose the threshold and lock time from.
+class ClickDetector : public QObject
+{
+  Q_OBJECT
+
+public:
+  explicit ClickDetector(QObject *parent = Q_NULLPTR);
+  ~ClickDetector();
+
+  void setAudioFormat(const QAudioFormat &format);
+  void setSampleRing(const SampleRingBuffer *);
+  // Channel stamped into the click events
+  void setChannel(int);
+  int channel(void) const;
+  void process(void);
+  void reset(void);
+
+  int threshold(void) const;
+  qint64 lockTimeNs(void) const;
+  qint64 elapsedNs(void) const;
+  TimeAnchor anchor(void) const;
+  const ClickRingBuffer *clickRing(void) const;
+
+  bool pulseAnalysis(void) const;
+  int pulseFloor(void) const;
+  PulseSpectrum *pulseSpectrum(void) const;
+
+public slots:
+  void setThreshold(int);
+  void setLockTimeNs(qint64);
+  void setPulseAnalysis(bool);
+  void setPulseFloor(int);
+
+signals:
+  void click(const ClickEvent &);
+  void thresholdChanged(int);
+  void lockTimeChanged(qint64);
+
+private:
+  QScopedPointer<ClickDetectorPrivate> d_ptr;
+  Q_DECLARE_PRIVATE(ClickDetector)
+  Q_DISABLE_COPY(ClickDetector)
+};
+
+#endif // __CLICKDETECTOR_H_
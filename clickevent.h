@@ -0,0 +1,90 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef __CLICKEVENT_H_
+#define __CLICKEVENT_H_
+
+#include <QtGlobal>
+#include <QMetaType>
+
+
+// A detected click. Times are kept as frame counts, so that the
+// exact time of a click is the rational number frame / sampleRate;
+// convert to seconds or nanoseconds only for display and logging.
+struct ClickEvent
+{
+  ClickEvent(void)
+    : frame(0)
+    , dtFrames(0)
+    , sampleRate(0)
+    , channel(0)
+  { /* ... */ }
+  ClickEvent(qint64 frame, qint64 dtFrames, int sampleRate, int channel = 0)
+    : frame(frame)
+    , dtFrames(dtFrames)
+    , sampleRate(sampleRate)
+    , channel(channel)
+  { /* ... */ }
+
+  // index of the sample that triggered the click, counted from the
+  // first sample the detector has seen
+  qint64 frame;
+  // frames elapsed since the previous click on the same channel
+  qint64 dtFrames;
+  int sampleRate;
+  // audio channel, i.e. counter tube, the click was detected on
+  int channel;
+
+  qreal seconds(void) const
+  {
+    return qreal(frame) / sampleRate;
+  }
+
+  // inter-arrival time rounded to the nearest nanosecond
+  qint64 dtNs(void) const
+  {
+    return (dtFrames * Q_INT64_C(1000000000) + sampleRate / 2) / sampleRate;
+  }
+};
+
+Q_DECLARE_METATYPE(ClickEvent)
+
+
+// Relates the frame counter to wall-clock time. Kept apart from the
+// click times so that clock adjustments can't distort them.
+struct TimeAnchor
+{
+  TimeAnchor(void)
+    : frame(-1)
+    , msecsSinceEpoch(0)
+  { /* ... */ }
+
+  qint64 frame;
+  qint64 msecsSinceEpoch;
+
+  bool isValid(void) const
+  {
+    return frame >= 0;
+  }
+};
+
+Q_DECLARE_METATYPE(TimeAnchor)
+
+#endif // __CLICKEVENT_H_
@@ -0,0 +1,132 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "conditioner.h"
+
+#include <QCryptographicHash>
+#include <QQueue>
+#include <QtMath>
+
+
+class EntropyConditionerPrivate {
+public:
+  EntropyConditionerPrivate(qreal minEntropyPerBit, int maxPendingSeeds)
+    : hash(QCryptographicHash::Sha256)
+    , minEntropyPerBit(minEntropyPerBit)
+    , maxPendingSeeds(maxPendingSeeds)
+    , entropy(0.0)
+    , seedCount(0)
+  { /* ... */ }
+  QCryptographicHash hash;
+  qreal minEntropyPerBit;
+  int maxPendingSeeds;
+  qreal entropy;
+  qint64 seedCount;
+  QQueue<QByteArray> seeds;
+};
+
+
+EntropyConditioner::EntropyConditioner(qreal minEntropyPerBit, int maxPendingSeeds)
+  : d_ptr(new EntropyConditionerPrivate(minEntropyPerBit, maxPendingSeeds))
+{
+  /* ... */
+}
+
+
+EntropyConditioner::~EntropyConditioner()
+{
+  /* ... */
+}
+
+
+void EntropyConditioner::setMinEntropyPerBit(qreal minEntropyPerBit)
+{
+  Q_D(EntropyConditioner);
+  d->minEntropyPerBit = minEntropyPerBit;
+}
+
+
+qreal EntropyConditioner::minEntropyPerBit(void) const
+{
+  return d_ptr->minEntropyPerBit;
+}
+
+
+void EntropyConditioner::addData(const QByteArray &raw)
+{
+  Q_D(EntropyConditioner);
+  const qreal entropyPerByte = 8 * d->minEntropyPerBit;
+  if (entropyPerByte <= 0.0)
+    return;
+  const char *p = raw.constData();
+  int remaining = raw.size();
+  while (remaining > 0) {
+    // feed only as many bytes as the current seed still needs, so that
+    // the entropy of a block is spread over as many seeds as possible
+    const int needed = qCeil((RequiredEntropyBits - d->entropy) / entropyPerByte);
+    const int n = qMin(remaining, qMax(1, needed));
+    d->hash.addData(p, n);
+    d->entropy += n * entropyPerByte;
+    p += n;
+    remaining -= n;
+    if (d->entropy >= RequiredEntropyBits) {
+      if (d->seeds.size() >= d->maxPendingSeeds) {
+        d->seeds.dequeue();
+      }
+      d->seeds.enqueue(d->hash.result());
+      d->hash.reset();
+      d->entropy = 0.0;
+      ++d->seedCount;
+    }
+  }
+}
+
+
+bool EntropyConditioner::seedAvailable(void) const
+{
+  return !d_ptr->seeds.isEmpty();
+}
+
+
+QByteArray EntropyConditioner::takeSeed(void)
+{
+  Q_D(EntropyConditioner);
+  return d->seeds.isEmpty() ? QByteArray() : d->seeds.dequeue();
+}
+
+
+qreal EntropyConditioner::pendingEntropy(void) const
+{
+  return d_ptr->entropy;
+}
+
+
+qint64 EntropyConditioner::seedCount(void) const
+{
+  return d_ptr->seedCount;
+}
+
+
+void EntropyConditioner::reset(void)
+{
+  Q_D(EntropyConditioner);
+  d->hash.reset();
+  d->entropy = 0.0;
+  d->seeds.clear();
+}
@@ -0,0 +1,66 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef __CONDITIONER_H_
+#define __CONDITIONER_H_
+
+#include <QtGlobal>
+#include <QByteArray>
+#include <QScopedPointer>
+
+
+class EntropyConditionerPrivate;
+
+// Vetted conditioning component after NIST SP 800-90B, section 3.1.5:
+// compresses raw source bytes with SHA-256 into 256 bit seeds. A seed
+// is only finished once the input has been credited with
+// SeedBytes * 8 + 64 bits of min-entropy, which SP 800-90C requires
+// for the output to count as full entropy.
+class EntropyConditioner
+{
+public:
+  static const int SeedBytes = 32;
+  static const int RequiredEntropyBits = SeedBytes * 8 + 64;
+
+  // `minEntropyPerBit` is the assessed entropy of one raw bit, as
+  // used for the continuous health tests.
+  explicit EntropyConditioner(qreal minEntropyPerBit = 1.0, int maxPendingSeeds = 16);
+  ~EntropyConditioner();
+
+  void setMinEntropyPerBit(qreal);
+  qreal minEntropyPerBit(void) const;
+
+  void addData(const QByteArray &raw);
+  bool seedAvailable(void) const;
+  // Returns an empty array if no seed is available. If the consumer
+  // falls behind, the oldest seeds are dropped.
+  QByteArray takeSeed(void);
+  // Entropy credited to the seed under construction, in bits
+  qreal pendingEntropy(void) const;
+  qint64 seedCount(void) const;
+  void reset(void);
+
+private:
+  QScopedPointer<EntropyConditionerPrivate> d_ptr;
+  Q_DECLARE_PRIVATE(EntropyConditioner)
+  Q_DISABLE_COPY(EntropyConditioner)
+};
+
+#endif // __CONDITIONER_H_
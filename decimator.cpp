@@ -0,0 +1,217 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "decimator.h"
+
+#include <QVector>
+#include <cstring>
+#include <qmath.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define QLIQ_SSE2
+#include <emmintrin.h>
+#endif
+
+
+namespace {
+
+// Cutoff frequency relative to the output's Nyquist frequency. What
+// lies above is transition band.
+const qreal Passband = 0.8;
+
+// Largest float below 2^31, so that an overshooting output doesn't
+// overflow when converted to int.
+const float MaxSample = 2147483520.0f;
+
+
+inline float dotScalar(const float *x, const float *h, int count)
+{
+  float sum = 0.0f;
+  for (int i = 0; i < count; ++i) {
+    sum += x[i] * h[i];
+  }
+  return sum;
+}
+
+
+inline void toFloatScalar(const int *src, float *dst, int count)
+{
+  for (int i = 0; i < count; ++i) {
+    dst[i] = float(src[i]);
+  }
+}
+
+
+#ifdef QLIQ_SSE2
+
+inline float dot(const float *x, const float *h, int count)
+{
+  __m128 acc = _mm_setzero_ps();
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(h + i)));
+  }
+  float sums[4];
+  _mm_storeu_ps(sums, acc);
+  return sums[0] + sums[1] + sums[2] + sums[3] + dotScalar(x + i, h + i, count - i);
+}
+
+
+inline void toFloat(const int *src, float *dst, int count)
+{
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm_storeu_ps(dst + i, _mm_cvtepi32_ps(v));
+  }
+  toFloatScalar(src + i, dst + i, count - i);
+}
+
+#else
+
+inline float dot(const float *x, const float *h, int count)
+{
+  return dotScalar(x, h, count);
+}
+
+
+inline void toFloat(const int *src, float *dst, int count)
+{
+  toFloatScalar(src, dst, count);
+}
+
+#endif // QLIQ_SSE2
+
+}
+
+
+class DecimatorPrivate
+{
+public:
+  DecimatorPrivate(void)
+    : factor(1)
+    , fill(0)
+    , next(0)
+  { /* ... */ }
+  ~DecimatorPrivate() { /* ... */ }
+  int factor;
+  // symmetric, so they needn't be reversed for the dot product
+  QVector<float> taps;
+  // the input the next outputs depend on, oldest first
+  QVector<float> history;
+  int fill;
+  // index in `history` of the newest input sample of the next output
+  int next;
+};
+
+
+Decimator::Decimator(int factor)
+  : d_ptr(new DecimatorPrivate)
+{
+  setFactor(factor);
+}
+
+
+Decimator::~Decimator() { /* ... */ }
+
+
+void Decimator::setFactor(int factor)
+{
+  Q_D(Decimator);
+  d->factor = qMax(1, factor);
+  d->taps.fill(1.0f, 1);
+  if (d->factor > 1) {
+    const int n = TapsPerPhase * d->factor;
+    const qreal cutoff = Passband * 0.5 / d->factor;
+    const qreal center = 0.5 * (n - 1);
+    QVector<qreal> h(n);
+    qreal sum = 0.0;
+    for (int k = 0; k < n; ++k) {
+      const qreal t = k - center;
+      const qreal window = 0.42 - 0.5 * qCos(2 * M_PI * k / (n - 1)) + 0.08 * qCos(4 * M_PI * k / (n - 1));
+      h[k] = window * qSin(2 * M_PI * cutoff * t) / (M_PI * t);
+      sum += h.at(k);
+    }
+    d->taps.resize(n);
+    for (int k = 0; k < n; ++k) {
+      // unity gain at DC
+      d->taps[k] = float(h.at(k) / sum);
+    }
+  }
+  reset();
+}
+
+
+int Decimator::factor(void) const
+{
+  return d_ptr->factor;
+}
+
+
+int Decimator::delay(void) const
+{
+  return (d_ptr->taps.size() - 1) / 2;
+}
+
+
+void Decimator::reset(void)
+{
+  Q_D(Decimator);
+  // start out with silence, so that the first outputs have a full
+  // history to work on
+  d->fill = d->taps.size() - 1;
+  d->next = d->fill;
+  d->history.fill(0.0f, d->fill);
+}
+
+
+int Decimator::process(const int *src, int count, int *dst)
+{
+  Q_D(Decimator);
+  if (d->factor == 1) {
+    memcpy(dst, src, count * sizeof(int));
+    return count;
+  }
+  if (d->history.size() < d->fill + count) {
+    d->history.resize(d->fill + count);
+  }
+  float *history = d->history.data();
+  toFloat(src, history + d->fill, count);
+  d->fill += count;
+  const int taps = d->taps.size();
+  const float *h = d->taps.constData();
+  int n = 0;
+  for (; d->next < d->fill; d->next += d->factor) {
+    const float y = dot(history + d->next - taps + 1, h, taps);
+    dst[n++] = qRound(qBound(-MaxSample, y, MaxSample));
+  }
+  // drop what no output to come depends on
+  const int first = d->next - taps + 1;
+  d->fill -= first;
+  d->next -= first;
+  memmove(history, history + first, d->fill * sizeof(float));
+  return n;
+}
+
+
+int Decimator::factorFor(int sampleRate, int maxRate)
+{
+  return qMax(1, (sampleRate + maxRate - 1) / maxRate);
+}
@@ -0,0 +1,68 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef __DECIMATOR_H_
+#define __DECIMATOR_H_
+
+#include <QtGlobal>
+#include <QScopedPointer>
+
+
+class DecimatorPrivate;
+
+// Low-pass filters a stream of samples and keeps every factor()-th of
+// them, so that consumers which don't need the full capture rate, like
+// the waveform display, get a stream at a fraction of it. The filter is
+// a Blackman windowed sinc of TapsPerPhase * factor() taps. Only the
+// outputs that are kept get computed, each as one dot product of the
+// taps with the most recent input.
+class Decimator
+{
+public:
+  // Multiple of 4, so that the taps fill whole SIMD registers
+  static const int TapsPerPhase = 16;
+
+  explicit Decimator(int factor = 1);
+  ~Decimator();
+
+  // Resets the filter
+  void setFactor(int);
+  int factor(void) const;
+  // Delay of the filter in input samples: output n corresponds to the
+  // n * factor()-th input sample since the last reset() minus delay().
+  int delay(void) const;
+  // Forgets the input seen so far, e.g. after a gap in the stream
+  void reset(void);
+
+  // Filters `count` samples from `src` and writes the decimated ones
+  // to `dst`, which must have room for count / factor() + 1 samples.
+  // Returns the number of samples written.
+  int process(const int *src, int count, int *dst);
+
+  // Smallest factor that brings `sampleRate` down to at most `maxRate`
+  static int factorFor(int sampleRate, int maxRate);
+
+private:
+  QScopedPointer<DecimatorPrivate> d_ptr;
+  Q_DECLARE_PRIVATE(Decimator)
+  Q_DISABLE_COPY(Decimator)
+};
+
+#endif // __DECIMATOR_H_
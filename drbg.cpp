@@ -0,0 +1,211 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "drbg.h"
+
+#include <QMessageAuthenticationCode>
+#include <QCryptographicHash>
+#include <QMutex>
+#include <QMutexLocker>
+
+
+static const int OutLen = 32;
+
+const quint64 HmacDrbg::MaxReseedInterval;
+const quint64 HmacDrbg::DefaultReseedInterval;
+
+
+class HmacDrbgPrivate {
+public:
+  HmacDrbgPrivate(quint64 reseedInterval)
+    : mac(QCryptographicHash::Sha256)
+    , reseedInterval(reseedInterval)
+    , reseedCounter(0)
+    , reseedCount(0)
+    , instantiated(false)
+  { /* ... */ }
+  QMutex mutex;
+  QMessageAuthenticationCode mac;
+  QByteArray K;
+  QByteArray V;
+  quint64 reseedInterval;
+  quint64 reseedCounter;
+  qint64 reseedCount;
+  bool instantiated;
+
+  // HMAC_DRBG_Update (SP 800-90A, 10.1.2.2)
+  void update(const QByteArray &provided)
+  {
+    mac.setKey(K);
+    mac.addData(V);
+    mac.addData("\x00", 1);
+    mac.addData(provided);
+    K = mac.result();
+    mac.setKey(K);
+    mac.addData(V);
+    V = mac.result();
+    if (provided.isEmpty())
+      return;
+    mac.reset();
+    mac.addData(V);
+    mac.addData("\x01", 1);
+    mac.addData(provided);
+    K = mac.result();
+    mac.setKey(K);
+    mac.addData(V);
+    V = mac.result();
+  }
+
+  HmacDrbg::Status generate(char *dst, int count, const QByteArray &additional)
+  {
+    if (!instantiated)
+      return HmacDrbg::NotInstantiated;
+    if (count > HmacDrbg::MaxBytesPerRequest)
+      return HmacDrbg::RequestTooLarge;
+    if (reseedCounter > reseedInterval)
+      return HmacDrbg::ReseedRequired;
+    if (!additional.isEmpty()) {
+      update(additional);
+    }
+    // K stays the same while the output is generated, so the key
+    // schedule is computed only once per request.
+    mac.setKey(K);
+    while (count > 0) {
+      mac.reset();
+      mac.addData(V);
+      V = mac.result();
+      const int n = qMin(count, OutLen);
+      memcpy(dst, V.constData(), n);
+      dst += n;
+      count -= n;
+    }
+    update(additional);
+    ++reseedCounter;
+    return HmacDrbg::Success;
+  }
+};
+
+
+HmacDrbg::HmacDrbg(quint64 reseedInterval)
+  : d_ptr(new HmacDrbgPrivate(qBound<quint64>(1, reseedInterval, MaxReseedInterval)))
+{
+  /* ... */
+}
+
+
+HmacDrbg::~HmacDrbg()
+{
+  uninstantiate();
+}
+
+
+void HmacDrbg::setReseedInterval(quint64 reseedInterval)
+{
+  Q_D(HmacDrbg);
+  QMutexLocker locker(&d->mutex);
+  d->reseedInterval = qBound<quint64>(1, reseedInterval, MaxReseedInterval);
+}
+
+
+quint64 HmacDrbg::reseedInterval(void) const
+{
+  return d_ptr->reseedInterval;
+}
+
+
+void HmacDrbg::instantiate(const QByteArray &entropy, const QByteArray &nonce, const QByteArray &personalization)
+{
+  Q_D(HmacDrbg);
+  QMutexLocker locker(&d->mutex);
+  d->K = QByteArray(OutLen, '\x00');
+  d->V = QByteArray(OutLen, '\x01');
+  d->update(entropy + nonce + personalization);
+  d->reseedCounter = 1;
+  d->instantiated = true;
+}
+
+
+void HmacDrbg::reseed(const QByteArray &entropy, const QByteArray &additional)
+{
+  Q_D(HmacDrbg);
+  QMutexLocker locker(&d->mutex);
+  if (!d->instantiated)
+    return;
+  d->update(entropy + additional);
+  d->reseedCounter = 1;
+  ++d->reseedCount;
+}
+
+
+void HmacDrbg::uninstantiate(void)
+{
+  Q_D(HmacDrbg);
+  QMutexLocker locker(&d->mutex);
+  d->K.fill('\x00');
+  d->V.fill('\x00');
+  d->mac.setKey(d->K);
+  d->instantiated = false;
+}
+
+
+HmacDrbg::Status HmacDrbg::generate(char *dst, int count, const QByteArray &additional)
+{
+  Q_D(HmacDrbg);
+  QMutexLocker locker(&d->mutex);
+  return d->generate(dst, count, additional);
+}
+
+
+qint64 HmacDrbg::read(char *dst, qint64 count)
+{
+  Q_D(HmacDrbg);
+  QMutexLocker locker(&d->mutex);
+  qint64 total = 0;
+  while (total < count) {
+    const int n = int(qMin<qint64>(count - total, MaxBytesPerRequest));
+    if (d->generate(dst + total, n, QByteArray()) != Success)
+      break;
+    total += n;
+  }
+  return total;
+}
+
+
+bool HmacDrbg::isInstantiated(void) const
+{
+  return d_ptr->instantiated;
+}
+
+
+bool HmacDrbg::needsReseed(void) const
+{
+  return d_ptr->reseedCounter > d_ptr->reseedInterval;
+}
+
+
+quint64 HmacDrbg::reseedCounter(void) const
+{
+  return d_ptr->reseedCounter;
+}
+
+
+qint64 HmacDrbg::reseedCount(void) const
+{
+  return d_ptr->reseedCount;
+}
@@ -0,0 +1,81 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef __DRBG_H_
+#define __DRBG_H_
+
+#include <QtGlobal>
+#include <QByteArray>
+#include <QScopedPointer>
+
+
+class HmacDrbgPrivate;
+
+// HMAC_DRBG with SHA-256 after NIST SP 800-90A, section 10.1.2. The
+// decay source only supplies seeds (see EntropyConditioner); output
+// is produced at hash speed. All methods are thread-safe, so any
+// number of consumers can pull from one instance.
+class HmacDrbg
+{
+public:
+  enum Status {
+    Success = 0,
+    NotInstantiated,
+    // The reseed interval is used up; no output until reseed()
+    ReseedRequired,
+    RequestTooLarge
+  };
+
+  static const int SecurityStrengthBytes = 32;
+  // max_number_of_bits_per_request = 2^19
+  static const int MaxBytesPerRequest = 1 << 16;
+  // SP 800-90A allows up to 2^48 requests between reseeds
+  static const quint64 MaxReseedInterval = Q_UINT64_C(1) << 48;
+  static const quint64 DefaultReseedInterval = Q_UINT64_C(1) << 20;
+
+  explicit HmacDrbg(quint64 reseedInterval = DefaultReseedInterval);
+  ~HmacDrbg();
+
+  void setReseedInterval(quint64);
+  quint64 reseedInterval(void) const;
+
+  // `entropy` must carry at least SecurityStrengthBytes * 8 bits.
+  void instantiate(const QByteArray &entropy, const QByteArray &nonce, const QByteArray &personalization = QByteArray());
+  void reseed(const QByteArray &entropy, const QByteArray &additional = QByteArray());
+  void uninstantiate(void);
+  // One SP 800-90A generate request of at most MaxBytesPerRequest bytes
+  Status generate(char *dst, int count, const QByteArray &additional = QByteArray());
+  // Splits `count` into as many requests as needed. Returns the number
+  // of bytes written, which is less than `count` if a reseed became
+  // due on the way.
+  qint64 read(char *dst, qint64 count);
+
+  bool isInstantiated(void) const;
+  bool needsReseed(void) const;
+  quint64 reseedCounter(void) const;
+  qint64 reseedCount(void) const;
+
+private:
+  QScopedPointer<HmacDrbgPrivate> d_ptr;
+  Q_DECLARE_PRIVATE(HmacDrbg)
+  Q_DISABLE_COPY(HmacDrbg)
+};
+
+#endif // __DRBG_H_
@@ -0,0 +1,1068 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "entropyengine.h"
+#include "audioinputdevice.h"
+#include "capturedevice.h"
+#include "clickdetector.h"
+#include "global.h"
+#include "healthcheck.h"
+#include "entropyestimator.h"
+#include "conditioner.h"
+#include "drbg.h"
+#include "entropyserver.h"
+#include "pulsegenerator.h"
+#include "eventlog.h"
+#include "outputwriter.h"
+#include "intervalstatistics.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QStandardPaths>
+#include <QSettings>
+#include <QElapsedTimer>
+#include <QDateTime>
+#include <QDataStream>
+#include <QFutureWatcher>
+#include <QTimer>
+#include <QThread>
+#include <limits>
+
+
+static const int DtEstimationSampleSize = 4096;
+static const int DtBitsPerSymbol = 8;
+static const int SimulationIntervalMs = 20;
+// The click rings hold a few seconds' worth of clicks, so this merely
+// keeps the latency low.
+static const int ClickPollIntervalMs = 10;
+
+const int EntropyEngine::BlockBytes = Fips140Test::BlockBytes;
+
+
+// With more than one channel, each detector has its settings in
+// analysis/channel<n>/, falling back to those in analysis/.
+static QString detectorKey(const QString &key, int channel, int channelCount)
+{
+  return (channelCount == 1)
+      ? QString("analysis/%1").arg(key)
+      : QString("analysis/channel%1/%2").arg(channel + 1).arg(key);
+}
+
+
+class EntropyEnginePrivate {
+public:
+  EntropyEnginePrivate(const QAudioFormat &format)
+    : audioFormat(format)
+    , currentByte(0)
+    , currentByteIndex(0)
+    , running(false)
+    , stopOnNextClick(false)
+    , continuousTestAlarm(false)
+    , keptFailedBits(false)
+    , preventBias(true)
+    , onlySaveHealthyData(false)
+    , pulseAnalysis(false)
+    , outputDirectory(isPortable()
+                      ? QDir::currentPath()
+                      : QStandardPaths::writableLocation(QStandardPaths::AppDataLocation))
+    , randomFileName("random-numbers.bin")
+    , dtLogFileName("dt.qdt")
+    , randomStream(Q_NULLPTR)
+    , captureStream(Q_NULLPTR)
+    , bps(std::numeric_limits<qreal>::min())
+    , byteCounter(0)
+    , server(Q_NULLPTR)
+    , serverSource(EntropyServer::DrbgSource)
+    , serverReservoirSize(EntropyServer::DefaultReservoirSize)
+    , simulation(Q_NULLPTR)
+    , simulationStartFrame(0)
+  {
+    if (!audioFormat.isValid()) {
+      const int channels = qMax(1, audioFormat.channelCount());
+      const int sampleRate = (audioFormat.sampleRate() > 0) ? audioFormat.sampleRate() : 11025;
+// #define USE_PREFERRED_AUDIO_FORMAT
+#ifdef USE_PREFERRED_AUDIO_FORMAT
+      audioFormat = QAudioDeviceInfo::defaultInputDevice().preferredFormat();
+#else
+      audioFormat.setSampleRate(sampleRate);
+      audioFormat.setChannelCount(channels);
+      audioFormat.setCodec("audio/pcm");
+      audioFormat.setSampleSize(16);
+      audioFormat.setByteOrder(QAudioFormat::LittleEndian);
+      audioFormat.setSampleType(QAudioFormat::SignedInt);
+#endif
+    }
+    // reused for every block and every estimate, so that the steady
+    // state doesn't allocate
+    randomBytes.reserve(EntropyEngine::BlockBytes);
+    dtHistory.reserve(DtEstimationSampleSize);
+  }
+  ~EntropyEnginePrivate()
+  {
+    qDeleteAll(dtLogs);
+    qDeleteAll(extractors);
+    qDeleteAll(intervalStatistics);
+  }
+  QAudioFormat audioFormat;
+  QVector<CaptureDevice*> devices;
+  // one per channel of all devices, like extractors, dtLogs and
+  // intervalStatistics
+  QVector<ClickDetector*> clickDetectors;
+  QVector<ClickRingBuffer::Reader> clickReaders;
+  QTimer clickTimer;
+  QVector<BitExtractor*> extractors;
+  QVector<IntervalStatistics*> intervalStatistics;
+  QByteArray randomBytes;
+  quint8 currentByte;
+  int currentByteIndex;
+  bool running;
+  bool stopOnNextClick;
+  // a continuous health test has failed since the last completed
+  // block
+  bool continuousTestAlarm;
+  // the current block holds bits that failed a continuous test
+  bool keptFailedBits;
+  bool preventBias;
+  bool onlySaveHealthyData;
+  bool pulseAnalysis;
+  // must outlive dtLogs, which close their streams on destruction
+  OutputWriter writer;
+  QString outputDirectory;
+  QString randomFileName;
+  QString dtLogFileName;
+  QString captureFileName;
+  OutputStream *randomStream;
+  OutputStream *captureStream;
+  QVector<EventLogWriter*> dtLogs;
+  QElapsedTimer timer;
+  qreal bps;
+  qint64 byteCounter;
+  QElapsedTimer totalTimer;
+  Fips140Test fipsTest;
+  RepetitionCountTest repetitionCountTest;
+  AdaptiveProportionTest adaptiveProportionTest;
+  QVector<qint64> dtHistory;
+  QFutureWatcher<MinEntropyEstimate> byteEntropyWatcher;
+  QFutureWatcher<MinEntropyEstimate> dtEntropyWatcher;
+  EntropyConditioner conditioner;
+  HmacDrbg drbg;
+  EntropyServer *server;
+  QString serverName;
+  EntropyServer::Source serverSource;
+  int serverReservoirSize;
+  PulseGenerator *simulation;
+  QTimer simulationTimer;
+  QElapsedTimer simulationClock;
+  qint64 simulationStartFrame;
+  QByteArray simulationBuffer;
+};
+
+
+EntropyEngine::EntropyEngine(QObject *parent)
+  : QObject(parent)
+  , d_ptr(new EntropyEnginePrivate(QAudioFormat()))
+{
+  init();
+}
+
+
+EntropyEngine::EntropyEngine(const QAudioFormat &format, QObject *parent)
+  : QObject(parent)
+  , d_ptr(new EntropyEnginePrivate(format))
+{
+  init();
+}
+
+
+void EntropyEngine::init(void)
+{
+  Q_D(EntropyEngine);
+
+  setDevices(QList<QAudioDeviceInfo>() << QAudioDeviceInfo::defaultInputDevice());
+
+  QObject::connect(&d->byteEntropyWatcher, SIGNAL(finished()), SLOT(onByteEntropyEstimated()));
+  QObject::connect(&d->dtEntropyWatcher, SIGNAL(finished()), SLOT(onDtEntropyEstimated()));
+
+  d->clickTimer.setInterval(ClickPollIntervalMs);
+  d->clickTimer.setTimerType(Qt::PreciseTimer);
+  QObject::connect(&d->clickTimer, SIGNAL(timeout()), SLOT(collectClicks()));
+
+  d->simulationTimer.setInterval(SimulationIntervalMs);
+  d->simulationTimer.setTimerType(Qt::PreciseTimer);
+  QObject::connect(&d->simulationTimer, SIGNAL(timeout()), SLOT(onSimulationTick()));
+
+  QObject::connect(&d->writer, SIGNAL(error(QString)), SIGNAL(message(QString)));
+  openOutputs();
+
+  setExtractor("pair");
+}
+
+
+EntropyEngine::~EntropyEngine()
+{
+  Q_D(EntropyEngine);
+  stopCapture();
+  audioInputDevice()->setCaptureStream(Q_NULLPTR);
+  d->byteEntropyWatcher.waitForFinished();
+  d->dtEntropyWatcher.waitForFinished();
+}
+
+
+void EntropyEngine::setDevices(const QList<QAudioDeviceInfo> &deviceInfos)
+{
+  Q_D(EntropyEngine);
+  stopCapture();
+  // new detectors start out with the settings of the old ones
+  QVector<int> thresholds;
+  QVector<qint64> lockTimes;
+  QVector<int> pulseFloors;
+  foreach (const ClickDetector *clickDetector, d->clickDetectors) {
+    thresholds.append(clickDetector->threshold());
+    lockTimes.append(clickDetector->lockTimeNs());
+    pulseFloors.append(clickDetector->pulseFloor());
+  }
+  if (!d->devices.isEmpty()) {
+    audioInputDevice()->setCaptureStream(Q_NULLPTR);
+  }
+  qDeleteAll(d->devices);
+  d->devices.clear();
+  d->clickDetectors.clear();
+  d->clickReaders.clear();
+  qDeleteAll(d->dtLogs);
+  d->dtLogs.clear();
+  qDeleteAll(d->intervalStatistics);
+  d->intervalStatistics.clear();
+  foreach (const QAudioDeviceInfo &deviceInfo, deviceInfos) {
+    if (!deviceInfo.isFormatSupported(d->audioFormat)) {
+      emit message(tr("%1 may not support capturing %2 channel(s) at %3 Hz.")
+                   .arg(deviceInfo.deviceName())
+                   .arg(d->audioFormat.channelCount())
+                   .arg(d->audioFormat.sampleRate()));
+    }
+    CaptureDevice *device = new CaptureDevice(deviceInfo, d->audioFormat, this);
+    QObject::connect(device, SIGNAL(message(QString)), SIGNAL(message(QString)));
+    QObject::connect(device, SIGNAL(stateChanged(QAudio::State)), SLOT(onAudioStateChanged(QAudio::State)));
+    for (int c = 0; c < device->channelCount(); ++c) {
+      const int channel = d->clickDetectors.size();
+      ClickDetector *clickDetector = device->clickDetector(c);
+      clickDetector->setChannel(channel);
+      if (!thresholds.isEmpty()) {
+        const int from = (channel < thresholds.size()) ? channel : 0;
+        clickDetector->setThreshold(thresholds.at(from));
+        clickDetector->setLockTimeNs(lockTimes.at(from));
+        clickDetector->setPulseFloor(pulseFloors.at(from));
+      }
+      clickDetector->setPulseAnalysis(d->pulseAnalysis);
+      // direct, because a queued signal would cost the capture thread
+      // an allocation per click; collectClicks() ignores calls from
+      // there and leaves the clicks to the timer
+      QObject::connect(clickDetector, SIGNAL(click(ClickEvent)), SLOT(collectClicks()), Qt::DirectConnection);
+      d->clickDetectors.append(clickDetector);
+      d->clickReaders.append(ClickRingBuffer::Reader(clickDetector->clickRing()));
+      d->dtLogs.append(new EventLogWriter);
+      d->intervalStatistics.append(new IntervalStatistics);
+    }
+    d->devices.append(device);
+  }
+  audioInputDevice()->setCaptureStream(d->captureStream);
+  if (!d->extractors.isEmpty()) {
+    createExtractors(extractorId());
+  }
+}
+
+
+bool EntropyEngine::setInputDevices(const QStringList &names)
+{
+  const QList<QAudioDeviceInfo> &available = QAudioDeviceInfo::availableDevices(QAudio::AudioInput);
+  QList<QAudioDeviceInfo> deviceInfos;
+  bool ok = true;
+  foreach (const QString &name, names) {
+    bool found = false;
+    foreach (const QAudioDeviceInfo &deviceInfo, available) {
+      if (deviceInfo.deviceName() == name) {
+        deviceInfos.append(deviceInfo);
+        found = true;
+        break;
+      }
+    }
+    if (!found) {
+      emit message(tr("Audio input %1 not found.").arg(name));
+      ok = false;
+    }
+  }
+  if (deviceInfos.isEmpty()) {
+    deviceInfos.append(QAudioDeviceInfo::defaultInputDevice());
+  }
+  setDevices(deviceInfos);
+  return ok;
+}
+
+
+QStringList EntropyEngine::inputDevices(void) const
+{
+  QStringList names;
+  foreach (const CaptureDevice *device, d_ptr->devices) {
+    names.append(device->deviceInfo().deviceName());
+  }
+  return names;
+}
+
+
+QStringList EntropyEngine::availableInputDevices(void)
+{
+  QStringList names;
+  foreach (const QAudioDeviceInfo &deviceInfo, QAudioDeviceInfo::availableDevices(QAudio::AudioInput)) {
+    names.append(deviceInfo.deviceName());
+  }
+  return names;
+}
+
+
+void EntropyEngine::restoreSettings(QSettings &settings)
+{
+  Q_D(EntropyEngine);
+  const int defaultThreshold = settings.value("analysis/threshold", 32000).toInt();
+  const qint64 defaultLockTimeNs = settings.value("analysis/lockTimeNs", 1600 * 1000).toLongLong();
+  const int channels = d->clickDetectors.size();
+  for (int c = 0; c < channels; ++c) {
+    ClickDetector *clickDetector = d->clickDetectors.at(c);
+    clickDetector->setThreshold(settings.value(detectorKey("threshold", c, channels), defaultThreshold).toInt());
+    clickDetector->setLockTimeNs(settings.value(detectorKey("lockTimeNs", c, channels), defaultLockTimeNs).toLongLong());
+    clickDetector->setPulseFloor(settings.value(detectorKey("pulseFloor", c, channels), clickDetector->threshold() / 4).toInt());
+  }
+  setPulseAnalysis(settings.value("analysis/pulseAnalysis", false).toBool());
+  setPreventBias(settings.value("options/preventBias", true).toBool());
+  setOnlySaveHealthyData(settings.value("options/onlySaveHealthyData", false).toBool());
+  setExtractor(settings.value("options/extractor", "pair").toString());
+  const qreal minEntropyPerBit = settings.value("health/minEntropyPerBit", 0.8).toReal();
+  d->repetitionCountTest = RepetitionCountTest(minEntropyPerBit);
+  d->adaptiveProportionTest = AdaptiveProportionTest(minEntropyPerBit);
+  d->conditioner.setMinEntropyPerBit(minEntropyPerBit);
+  d->drbg.setReseedInterval(settings.value("drbg/reseedInterval", HmacDrbg::DefaultReseedInterval).toULongLong());
+  d->serverName = settings.value("server/socket", "qliq-egd").toString();
+  d->serverSource = (settings.value("server/source", "drbg").toString() == "raw")
+      ? EntropyServer::RawSource
+      : EntropyServer::DrbgSource;
+  d->serverReservoirSize = settings.value("server/reservoirSize", EntropyServer::DefaultReservoirSize).toInt();
+  d->outputDirectory = settings.value("output/directory", d->outputDirectory).toString();
+  d->randomFileName = settings.value("output/randomFile", d->randomFileName).toString();
+  d->dtLogFileName = settings.value("output/dtLog", d->dtLogFileName).toString();
+  d->captureFileName = settings.value("capture/rawFile").toString();
+  d->writer.setSyncPolicy(OutputWriter::syncPolicyFromString(settings.value("output/sync", "close").toString()),
+                          settings.value("output/syncIntervalMs", 1000).toInt());
+  d->writer.setRotation(settings.value("output/rotateBytes", 0).toLongLong(),
+                        settings.value("output/rotateSeconds", 0).toInt());
+  d->writer.setPageSize(settings.value("output/pageSize", OutputWriter::DefaultPageSize).toInt());
+  d->writer.setFlushIntervalMs(settings.value("output/flushIntervalMs", 1000).toInt());
+  openOutputs();
+}
+
+
+void EntropyEngine::saveSettings(QSettings &settings) const
+{
+  const int channels = d_ptr->clickDetectors.size();
+  for (int c = 0; c < channels; ++c) {
+    settings.setValue(detectorKey("threshold", c, channels), d_ptr->clickDetectors.at(c)->threshold());
+    settings.setValue(detectorKey("lockTimeNs", c, channels), d_ptr->clickDetectors.at(c)->lockTimeNs());
+    settings.setValue(detectorKey("pulseFloor", c, channels), d_ptr->clickDetectors.at(c)->pulseFloor());
+  }
+  settings.setValue("analysis/pulseAnalysis", d_ptr->pulseAnalysis);
+  settings.setValue("options/preventBias", d_ptr->preventBias);
+  settings.setValue("options/onlySaveHealthyData", d_ptr->onlySaveHealthyData);
+  settings.setValue("options/extractor", extractorId());
+  settings.setValue("health/minEntropyPerBit", d_ptr->conditioner.minEntropyPerBit());
+  settings.setValue("drbg/reseedInterval", d_ptr->drbg.reseedInterval());
+  settings.setValue("server/socket", d_ptr->serverName);
+  settings.setValue("server/source", d_ptr->serverSource == EntropyServer::RawSource ? "raw" : "drbg");
+  settings.setValue("server/reservoirSize", d_ptr->serverReservoirSize);
+  settings.setValue("capture/rawFile", d_ptr->captureFileName);
+  settings.setValue("output/directory", d_ptr->outputDirectory);
+  settings.setValue("output/randomFile", d_ptr->randomFileName);
+  settings.setValue("output/dtLog", d_ptr->dtLogFileName);
+  settings.setValue("output/sync", OutputWriter::syncPolicyToString(d_ptr->writer.syncPolicy()));
+  settings.setValue("output/syncIntervalMs", d_ptr->writer.syncIntervalMs());
+  settings.setValue("output/rotateBytes", d_ptr->writer.rotationBytes());
+  settings.setValue("output/rotateSeconds", d_ptr->writer.rotationSeconds());
+  settings.setValue("output/pageSize", d_ptr->writer.pageSize());
+  settings.setValue("output/flushIntervalMs", d_ptr->writer.flushIntervalMs());
+}
+
+
+// Relative names are taken relative to the output directory. The
+// files themselves are only created once there's something to write.
+QString EntropyEngine::outputPath(const QString &fileName) const
+{
+  return QDir(d_ptr->outputDirectory).filePath(fileName);
+}
+
+
+// dt.qdt, or dt-ch1.qdt, dt-ch2.qdt, ... for multichannel captures
+QString EntropyEngine::dtLogPath(int channel) const
+{
+  const QString &path = outputPath(d_ptr->dtLogFileName);
+  if (d_ptr->dtLogs.size() == 1)
+    return path;
+  const QFileInfo fi(path);
+  const QString &suffix = fi.suffix().isEmpty() ? QString() : "." + fi.suffix();
+  return fi.absoluteDir().filePath(QString("%1-ch%2%3").arg(fi.completeBaseName()).arg(channel + 1).arg(suffix));
+}
+
+
+void EntropyEngine::openOutputs(void)
+{
+  Q_D(EntropyEngine);
+  d->writer.close(d->randomStream);
+  d->randomStream = d->writer.open(outputPath(d->randomFileName));
+  // reopened with the current detector settings on the next click
+  foreach (EventLogWriter *dtLog, d->dtLogs) {
+    dtLog->close();
+  }
+  setCaptureFile(d->captureFileName);
+}
+
+
+void EntropyEngine::setCaptureFile(const QString &fileName)
+{
+  Q_D(EntropyEngine);
+  // the stream is written on the capture thread
+  CaptureDevice *device = d->devices.first();
+  const bool capturing = device->isRunning();
+  device->stopCapture();
+  d->captureFileName = fileName;
+  device->audioInputDevice()->setCaptureStream(Q_NULLPTR);
+  d->writer.close(d->captureStream);
+  d->captureStream = fileName.isEmpty()
+      ? Q_NULLPTR
+      : d->writer.open(outputPath(fileName));
+  device->audioInputDevice()->setCaptureStream(d->captureStream);
+  if (capturing) {
+    device->startCapture();
+  }
+}
+
+
+QString EntropyEngine::captureFile(void) const
+{
+  return d_ptr->captureFileName;
+}
+
+
+QString EntropyEngine::outputDirectory(void) const
+{
+  return d_ptr->outputDirectory;
+}
+
+
+OutputWriter *EntropyEngine::outputWriter(void) const
+{
+  return &d_ptr->writer;
+}
+
+
+void EntropyEngine::startCapture(void)
+{
+  Q_D(EntropyEngine);
+  foreach (CaptureDevice *device, d->devices) {
+    device->startCapture();
+  }
+  d->clickTimer.start();
+}
+
+
+void EntropyEngine::stopCapture(void)
+{
+  Q_D(EntropyEngine);
+  foreach (CaptureDevice *device, d->devices) {
+    device->stopCapture();
+  }
+  d->clickTimer.stop();
+  // the clicks detected since the last tick
+  collectClicks();
+  d->simulationTimer.stop();
+  if (!d->devices.isEmpty()) {
+    audioInputDevice()->stop();
+  }
+}
+
+
+void EntropyEngine::startSimulation(PulseGenerator *generator)
+{
+  Q_D(EntropyEngine);
+  stopCapture();
+  if (d->simulation != generator) {
+    delete d->simulation;
+    d->simulation = generator;
+    d->simulation->setParent(this);
+  }
+  if (!d->simulation->isOpen()) {
+    d->simulation->open(QIODevice::ReadOnly);
+  }
+  // a tick reads at most a second of audio
+  d->simulationBuffer.reserve(d->audioFormat.bytesForFrames(d->audioFormat.sampleRate()));
+  audioInputDevice()->start();
+  d->simulationClock.start();
+  d->simulationStartFrame = d->simulation->framePosition();
+  d->simulationTimer.start();
+  emit message(tr("Simulating %1 counts/s (seed %2).")
+               .arg(d->simulation->rate())
+               .arg(d->simulation->seed()));
+}
+
+
+// Catches up with the wall clock, so that late timer events don't
+// slow the simulated time down.
+void EntropyEngine::onSimulationTick(void)
+{
+  Q_D(EntropyEngine);
+  if (d->simulation == Q_NULLPTR)
+    return;
+  const int frameBytes = d->audioFormat.bytesPerFrame();
+  if (frameBytes <= 0)
+    return;
+  qint64 frames = qint64(1e-9 * d->simulationClock.nsecsElapsed() * d->audioFormat.sampleRate())
+      - (d->simulation->framePosition() - d->simulationStartFrame);
+  if (frames > d->audioFormat.sampleRate()) {
+    // don't try to catch up with more than a second, e.g. after the
+    // machine has been suspended
+    frames = d->audioFormat.sampleRate();
+    d->simulationClock.start();
+    d->simulationStartFrame = d->simulation->framePosition() + frames;
+  }
+  if (frames <= 0)
+    return;
+  d->simulationBuffer.resize(int(frames * frameBytes));
+  const qint64 n = d->simulation->read(d->simulationBuffer.data(), d->simulationBuffer.size());
+  if (n > 0) {
+    audioInputDevice()->write(d->simulationBuffer.constData(), n);
+  }
+}
+
+
+const QAudioFormat &EntropyEngine::audioFormat(void) const
+{
+  return d_ptr->audioFormat;
+}
+
+
+const QAudioDeviceInfo &EntropyEngine::audioDeviceInfo(void) const
+{
+  return d_ptr->devices.first()->deviceInfo();
+}
+
+
+AudioInputDevice *EntropyEngine::audioInputDevice(void) const
+{
+  return d_ptr->devices.first()->audioInputDevice();
+}
+
+
+int EntropyEngine::deviceCount(void) const
+{
+  return d_ptr->devices.size();
+}
+
+
+CaptureDevice *EntropyEngine::captureDevice(int index) const
+{
+  return d_ptr->devices.value(index, Q_NULLPTR);
+}
+
+
+CaptureDevice *EntropyEngine::captureDeviceOfChannel(int channel, int *deviceChannel) const
+{
+  foreach (CaptureDevice *device, d_ptr->devices) {
+    if (channel < device->channelCount()) {
+      if (deviceChannel != Q_NULLPTR) {
+        *deviceChannel = channel;
+      }
+      return device;
+    }
+    channel -= device->channelCount();
+  }
+  return Q_NULLPTR;
+}
+
+
+int EntropyEngine::channelCount(void) const
+{
+  return d_ptr->clickDetectors.size();
+}
+
+
+ClickDetector *EntropyEngine::clickDetector(int channel) const
+{
+  return d_ptr->clickDetectors.value(channel, Q_NULLPTR);
+}
+
+
+const IntervalStatistics *EntropyEngine::intervalStatistics(int channel) const
+{
+  return d_ptr->intervalStatistics.value(channel, Q_NULLPTR);
+}
+
+
+HmacDrbg *EntropyEngine::drbg(void) const
+{
+  return &d_ptr->drbg;
+}
+
+
+EntropyServer *EntropyEngine::server(void) const
+{
+  return d_ptr->server;
+}
+
+
+bool EntropyEngine::startServer(const QString &name)
+{
+  Q_D(EntropyEngine);
+  if (d->server == Q_NULLPTR) {
+    d->server = new EntropyServer(&d->drbg, this);
+    QObject::connect(d->server, SIGNAL(message(QString)), SIGNAL(message(QString)));
+    QObject::connect(this, SIGNAL(healthyBlock(QByteArray)), d->server, SLOT(addHealthyBytes(QByteArray)));
+    QObject::connect(this, SIGNAL(drbgSeeded()), d->server, SLOT(onDrbgSeeded()));
+  }
+  d->server->close();
+  d->server->setSource(d->serverSource);
+  d->server->setReservoirSize(d->serverReservoirSize);
+  if (!name.isEmpty()) {
+    d->serverName = name;
+  }
+  return d->server->listen(d->serverName);
+}
+
+
+qreal EntropyEngine::volume(void) const
+{
+  return d_ptr->devices.first()->volume();
+}
+
+
+bool EntropyEngine::isRunning(void) const
+{
+  return d_ptr->running;
+}
+
+
+QString EntropyEngine::extractorId(void) const
+{
+  return d_ptr->extractors.first()->id();
+}
+
+
+bool EntropyEngine::preventBias(void) const
+{
+  return d_ptr->preventBias;
+}
+
+
+bool EntropyEngine::onlySaveHealthyData(void) const
+{
+  return d_ptr->onlySaveHealthyData;
+}
+
+
+bool EntropyEngine::pulseAnalysis(void) const
+{
+  return d_ptr->pulseAnalysis;
+}
+
+
+int EntropyEngine::bufferedBytes(void) const
+{
+  return d_ptr->randomBytes.size();
+}
+
+
+qint64 EntropyEngine::byteCount(void) const
+{
+  return d_ptr->byteCounter;
+}
+
+
+qint64 EntropyEngine::elapsedMs(void) const
+{
+  return d_ptr->totalTimer.isValid() ? d_ptr->totalTimer.elapsed() : 0;
+}
+
+
+qreal EntropyEngine::bytesPerSecond(void) const
+{
+  return d_ptr->bps;
+}
+
+
+void EntropyEngine::waitForEstimates(void)
+{
+  Q_D(EntropyEngine);
+  d->byteEntropyWatcher.waitForFinished();
+  d->dtEntropyWatcher.waitForFinished();
+}
+
+
+void EntropyEngine::start(void)
+{
+  Q_D(EntropyEngine);
+  d->timer.start();
+  d->totalTimer.start();
+  d->running = true;
+  d->stopOnNextClick = false;
+  d->byteCounter = 0;
+  emit started();
+}
+
+
+void EntropyEngine::stop(void)
+{
+  Q_D(EntropyEngine);
+  d->running = false;
+  d->stopOnNextClick = false;
+  foreach (EventLogWriter *dtLog, d->dtLogs) {
+    dtLog->flush();
+  }
+  d->randomStream->flush();
+  emit stopped();
+}
+
+
+void EntropyEngine::stopOnNextClick(void)
+{
+  Q_D(EntropyEngine);
+  d->stopOnNextClick = true;
+}
+
+
+void EntropyEngine::setVolume(qreal volume)
+{
+  Q_D(EntropyEngine);
+  foreach (CaptureDevice *device, d->devices) {
+    device->setVolume(volume);
+  }
+}
+
+
+void EntropyEngine::setExtractor(const QString &id)
+{
+  Q_D(EntropyEngine);
+  if (!d->extractors.isEmpty() && d->extractors.first()->id() == id)
+    return;
+  createExtractors(id);
+  emit message(tr("Extracting bits by %1.").arg(d->extractors.first()->name()));
+  emit extractorChanged(extractorId());
+}
+
+
+// One per channel, as extractors keep state between intervals
+void EntropyEngine::createExtractors(const QString &id)
+{
+  Q_D(EntropyEngine);
+  qDeleteAll(d->extractors);
+  d->extractors.clear();
+  for (int c = 0; c < d->clickDetectors.size(); ++c) {
+    BitExtractor *extractor = BitExtractor::create(id);
+    if (extractor == Q_NULLPTR) {
+      extractor = new PairComparisonExtractor;
+    }
+    d->extractors.append(extractor);
+  }
+  setPreventBias(d->preventBias);
+}
+
+
+void EntropyEngine::setPreventBias(bool preventBias)
+{
+  Q_D(EntropyEngine);
+  d->preventBias = preventBias;
+  foreach (BitExtractor *extractor, d->extractors) {
+    PairComparisonExtractor *pair = dynamic_cast<PairComparisonExtractor*>(extractor);
+    if (pair != Q_NULLPTR) {
+      pair->setPreventBias(preventBias);
+    }
+  }
+}
+
+
+void EntropyEngine::setOnlySaveHealthyData(bool onlySaveHealthyData)
+{
+  Q_D(EntropyEngine);
+  d->onlySaveHealthyData = onlySaveHealthyData;
+}
+
+
+void EntropyEngine::setPulseAnalysis(bool pulseAnalysis)
+{
+  Q_D(EntropyEngine);
+  d->pulseAnalysis = pulseAnalysis;
+  foreach (ClickDetector *clickDetector, d->clickDetectors) {
+    clickDetector->setPulseAnalysis(pulseAnalysis);
+  }
+}
+
+
+void EntropyEngine::resetIntervalStatistics(void)
+{
+  Q_D(EntropyEngine);
+  foreach (IntervalStatistics *statistics, d->intervalStatistics) {
+    statistics->reset();
+  }
+}
+
+
+void EntropyEngine::addBit(int bit)
+{
+  Q_D(EntropyEngine);
+  const bool rctPassed = d->repetitionCountTest.addSample(bit);
+  const bool aptPassed = d->adaptiveProportionTest.addSample(bit);
+  if (!rctPassed || !aptPassed) {
+    discardBlock(rctPassed ? tr("SP 800-90B Adaptive Proportion Test") : tr("SP 800-90B Repetition Count Test"));
+    // otherwise the bit is kept, like the rest of the block
+    if (d->onlySaveHealthyData)
+      return;
+    d->keptFailedBits = true;
+  }
+  d->currentByte |= bit << d->currentByteIndex;
+  ++d->currentByteIndex;
+  if (d->currentByteIndex > 7) {
+    d->randomBytes.append(d->currentByte);
+    ++d->byteCounter;
+    emit byteAdded(d->currentByte);
+    if (d->fipsTest.addByte(d->currentByte)) {
+      d->bps = 1e9 * BlockBytes / d->timer.nsecsElapsed();
+      d->timer.restart();
+      const bool healthy = healthCheck(d->randomBytes);
+      d->continuousTestAlarm = false;
+      d->keptFailedBits = false;
+      if (healthy || !d->onlySaveHealthyData) {
+        d->randomStream->write(d->randomBytes);
+      }
+      if (healthy) {
+        seedDrbg(d->randomBytes);
+        emit healthyBlock(d->randomBytes);
+      }
+      clearRandomBytes();
+    }
+    emit bufferedBytesChanged(d->randomBytes.size());
+    d->currentByte = 0;
+    d->currentByteIndex = 0;
+  }
+}
+
+
+// Empties the block buffer but keeps its capacity, unless the block
+// is still shared, e.g. by a receiver of healthyBlock()
+void EntropyEngine::clearRandomBytes(void)
+{
+  Q_D(EntropyEngine);
+  d->randomBytes.resize(0);
+  d->randomBytes.reserve(BlockBytes);
+}
+
+
+void EntropyEngine::seedDrbg(const QByteArray &rawBytes)
+{
+  Q_D(EntropyEngine);
+  d->conditioner.addData(rawBytes);
+  int seeds = 0;
+  while (d->conditioner.seedAvailable()) {
+    const QByteArray &seed = d->conditioner.takeSeed();
+    if (d->drbg.isInstantiated()) {
+      d->drbg.reseed(seed);
+    }
+    else {
+      // the nonce need not be secret, only unique
+      QByteArray nonce;
+      QDataStream(&nonce, QIODevice::WriteOnly) << QDateTime::currentMSecsSinceEpoch() << d->byteCounter;
+      d->drbg.instantiate(seed, nonce, AppName.toUtf8());
+      emit message(tr("DRBG instantiated."));
+    }
+    ++seeds;
+  }
+  if (seeds > 0) {
+    emit message(tr("DRBG reseeded with %1 seed(s) of %2 bits entropy each (%3 reseeds so far).")
+                 .arg(seeds).arg(EntropyConditioner::RequiredEntropyBits).arg(d->drbg.reseedCount()));
+    emit drbgSeeded();
+  }
+}
+
+
+// A stuck source trips the tests every few bits, so the alarm is only
+// raised on the first failure until a block completes.
+void EntropyEngine::discardBlock(const QString &failedTest)
+{
+  Q_D(EntropyEngine);
+  const bool alarm = !d->continuousTestAlarm;
+  d->continuousTestAlarm = true;
+  if (alarm) {
+    emit healthChanged(false);
+  }
+  d->repetitionCountTest.reset();
+  d->adaptiveProportionTest.reset();
+  if (d->onlySaveHealthyData) {
+    if (alarm) {
+      emit message(tr("%1 failed. Discarding %2 bytes.").arg(failedTest).arg(d->randomBytes.size()));
+    }
+    clearRandomBytes();
+    d->fipsTest.reset();
+    d->currentByte = 0;
+    d->currentByteIndex = 0;
+    emit bufferedBytesChanged(0);
+  }
+  else if (alarm) {
+    emit message(tr("%1 failed.").arg(failedTest));
+  }
+}
+
+
+// Called by the timer while capturing, and by the detectors whenever
+// audio is fed to them on the engine's thread
+void EntropyEngine::collectClicks(void)
+{
+  Q_D(EntropyEngine);
+  if (QThread::currentThread() != thread())
+    return;
+  static const int BatchSize = 64;
+  ClickEvent clicks[BatchSize];
+  for (int c = 0; c < d->clickReaders.size(); ++c) {
+    ClickRingBuffer::Reader &reader = d->clickReaders[c];
+    const qint64 lostBefore = reader.lost();
+    int n;
+    while ((n = reader.read(clicks, BatchSize)) > 0) {
+      for (int i = 0; i < n; ++i) {
+        processClick(clicks[i]);
+      }
+    }
+    if (reader.lost() > lostBefore) {
+      emit message(tr("Lost %1 click(s) on channel %2.").arg(reader.lost() - lostBefore).arg(c + 1));
+    }
+  }
+}
+
+
+void EntropyEngine::processClick(const ClickEvent &click)
+{
+  Q_D(EntropyEngine);
+  if (!d->running)
+    return;
+  // the surplus is dropped while an estimate is running, so that the
+  // history never outgrows its capacity
+  if (d->dtHistory.size() < DtEstimationSampleSize) {
+    d->dtHistory.append(click.dtFrames);
+  }
+  if (d->dtHistory.size() >= DtEstimationSampleSize && !d->dtEntropyWatcher.isRunning()) {
+    d->dtEntropyWatcher.setFuture(estimateMinEntropyAsync(symbolsFromIntervals(d->dtHistory, DtBitsPerSymbol), DtBitsPerSymbol));
+    // unlike clear(), keeps the capacity
+    d->dtHistory.resize(0);
+  }
+  d->intervalStatistics.at(click.channel)->add(click.dtFrames);
+  // Each channel's intervals go through an extractor of their own,
+  // all of which feed the same bit stream.
+  d->extractors.at(click.channel)->addInterval(click.dtFrames, this);
+  EventLogWriter *dtLog = d->dtLogs.at(click.channel);
+  if (!dtLog->isOpen()) {
+    // opened on the first click, when the detector is set up and
+    // anchored in wall-clock time
+    const ClickDetector *clickDetector = d->clickDetectors.at(click.channel);
+    EventLogHeader header;
+    header.sampleRate = d->audioFormat.sampleRate();
+    header.channelCount = d->audioFormat.channelCount();
+    header.sampleSize = d->audioFormat.sampleSize();
+    header.threshold = clickDetector->threshold();
+    header.lockTimeNs = clickDetector->lockTimeNs();
+    header.anchor = clickDetector->anchor();
+    header.channel = click.channel;
+    dtLog->open(&d->writer, dtLogPath(click.channel), header);
+  }
+  dtLog->append(click);
+  if (d->stopOnNextClick) {
+    stop();
+  }
+}
+
+
+bool EntropyEngine::healthCheck(const QByteArray &randomBytes)
+{
+  Q_D(EntropyEngine);
+  qreal entropy = testEntropy(randomBytes);
+  emit message(tr("Entropy: %1").arg(entropy, 0, 'f'));
+  // The FIPS tests have been updated with every byte in addBit(),
+  // so the verdict is ready without another pass over the block.
+  const int failed = d->fipsTest.failedTests();
+  emit message(tr("FIPS 140-2 Monobit test %1 (%2 ones).")
+               .arg((failed & Fips140Test::Monobit) ? tr("failed") : tr("passed"))
+               .arg(d->fipsTest.ones()));
+  emit message(tr("FIPS 140-2 Poker test %1 (X = %2).")
+               .arg((failed & Fips140Test::Poker) ? tr("failed") : tr("passed"))
+               .arg(d->fipsTest.pokerStatistic(), 0, 'f', 2));
+  emit message(tr("FIPS 140-2 Runs test %1.")
+               .arg((failed & Fips140Test::Runs) ? tr("failed") : tr("passed")));
+  emit message(tr("FIPS 140-2 Long run test %1 (longest run: %2).")
+               .arg((failed & Fips140Test::LongRun) ? tr("failed") : tr("passed"))
+               .arg(d->fipsTest.longestRun()));
+  // a block that kept bits failing the continuous tests isn't healthy
+  // either
+  const bool healthy = d->fipsTest.passed() && !d->keptFailedBits;
+  emit healthChanged(healthy);
+  if (!d->byteEntropyWatcher.isRunning()) {
+    d->byteEntropyWatcher.setFuture(estimateMinEntropyAsync(symbolsFromBytes(randomBytes), 8));
+  }
+  return healthy;
+}
+
+
+void EntropyEngine::logMinEntropy(const QString &source, const MinEntropyEstimate &estimate)
+{
+  emit message(tr("SP 800-90B min-entropy of %1 (%2 samples): %3 bit/sample "
+                  "(MCV %4, t-tuple %5, collision %6, Markov %7, compression %8)")
+               .arg(source)
+               .arg(estimate.sampleCount)
+               .arg(estimate.minEntropy, 0, 'f', 3)
+               .arg(estimate.mostCommonValue, 0, 'f', 3)
+               .arg(estimate.tTuple, 0, 'f', 3)
+               .arg(estimate.collision * estimate.bitsPerSymbol, 0, 'f', 3)
+               .arg(estimate.markov * estimate.bitsPerSymbol, 0, 'f', 3)
+               .arg(estimate.compression * estimate.bitsPerSymbol, 0, 'f', 3));
+}
+
+
+void EntropyEngine::onByteEntropyEstimated(void)
+{
+  Q_D(EntropyEngine);
+  logMinEntropy(tr("random bytes"), d->byteEntropyWatcher.result());
+}
+
+
+void EntropyEngine::onDtEntropyEstimated(void)
+{
+  Q_D(EntropyEngine);
+  logMinEntropy(tr("dt (lowest %1 bits)").arg(DtBitsPerSymbol), d->dtEntropyWatcher.result());
+}
+
+
+void EntropyEngine::onAudioStateChanged(QAudio::State audioState)
+{
+  Q_D(EntropyEngine);
+  // errors are reported by the CaptureDevice itself
+  switch (audioState) {
+  case QAudio::ActiveState:
+    d->timer.start();
+    break;
+  default:
+    break;
+  }
+}
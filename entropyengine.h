@@ -0,0 +1,203 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef __ENTROPYENGINE_H_
+#define __ENTROPYENGINE_H_
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QAudioFormat>
+#include <QAudioDeviceInfo>
+#include <QAudio>
+#include <QScopedPointer>
+#include "clickevent.h"
+#include "bitextractor.h"
+
+class QSettings;
+class AudioInputDevice;
+class CaptureDevice;
+class ClickDetector;
+class HmacDrbg;
+class EntropyServer;
+class PulseGenerator;
+class OutputWriter;
+class IntervalStatistics;
+struct MinEntropyEstimate;
+
+class EntropyEnginePrivate;
+
+// The complete pipeline from the microphone to the output files:
+// capture, click detection, bit extraction, health tests,
+// conditioning and the DRBG. Doesn't depend on QtWidgets, so it runs
+// in the GUI as well as in the headless daemon.
+//
+// With a multichannel audio interface, every channel is treated as a
+// counter of its own: it has its own click detector, bit extractor
+// and dt log, and the bits of all channels are merged into one
+// stream before the health tests.
+//
+// Several sound cards can be used at once (see setInputDevices()).
+// Each captures on a thread of its own (see CaptureDevice). The engine
+// collects their clicks from the detectors' click rings on its own
+// thread, so that the extractors, the health tests and the output
+// files are only ever touched from there and need no locking, and the
+// capture threads don't allocate memory for every click. Audio fed to
+// a device on the engine's thread, e.g. by a replay or a simulation,
+// is processed before the write returns.
+class EntropyEngine : public QObject, private BitSink
+{
+  Q_OBJECT
+
+public:
+  explicit EntropyEngine(QObject *parent = Q_NULLPTR);
+  // For replaying recordings in a format other than the default one.
+  // If only the channel count of `format` is set, the default format
+  // with that many channels is used.
+  EntropyEngine(const QAudioFormat &format, QObject *parent = Q_NULLPTR);
+  ~EntropyEngine();
+
+  void restoreSettings(QSettings &);
+  void saveSettings(QSettings &) const;
+
+  // Captures from the audio inputs named `names` (see
+  // availableInputDevices()), all in audioFormat(), or from the
+  // default input if `names` is empty. Stops capturing. Returns false
+  // if a device wasn't found; the others are used nevertheless.
+  bool setInputDevices(const QStringList &names);
+  QStringList inputDevices(void) const;
+  static QStringList availableInputDevices(void);
+
+  // Opens the audio devices. Bits are only collected while the
+  // engine is running (see start() and stop()).
+  void startCapture(void);
+  void stopCapture(void);
+  // Feeds the pipeline from `generator` in real time instead of from
+  // the audio devices, e.g. on machines without a sound card. The
+  // generator must produce audioFormat(); the engine takes ownership.
+  // Stopped by stopCapture().
+  void startSimulation(PulseGenerator *generator);
+
+  const QAudioFormat &audioFormat(void) const;
+  const QAudioDeviceInfo &audioDeviceInfo(void) const;
+  // Of the first device, which replays and simulations are fed into
+  AudioInputDevice *audioInputDevice(void) const;
+  int deviceCount(void) const;
+  CaptureDevice *captureDevice(int index = 0) const;
+  // Channels are numbered across all devices, in the order of
+  // inputDevices()
+  int channelCount(void) const;
+  ClickDetector *clickDetector(int channel = 0) const;
+  // Statistics of the intervals `channel` delivered while the engine
+  // was running, since the devices were set up or the statistics
+  // were reset. Updated on the engine's thread.
+  const IntervalStatistics *intervalStatistics(int channel = 0) const;
+  // The device `channel` belongs to, and its number on that device
+  CaptureDevice *captureDeviceOfChannel(int channel, int *deviceChannel = Q_NULLPTR) const;
+  HmacDrbg *drbg(void) const;
+  // Q_NULLPTR until startServer() has been called
+  EntropyServer *server(void) const;
+  // Writes random-numbers.bin, the dt log and the raw capture
+  OutputWriter *outputWriter(void) const;
+  QString outputDirectory(void) const;
+
+  // Records every audio buffer of the first device to `fileName`
+  // (relative to the output directory); an empty name stops
+  // recording.
+  void setCaptureFile(const QString &fileName);
+  QString captureFile(void) const;
+
+  // Starts the EGD server on `name`, or on the socket from the
+  // settings ("server/socket") if `name` is empty.
+  bool startServer(const QString &name = QString());
+
+  qreal volume(void) const;
+  bool isRunning(void) const;
+  QString extractorId(void) const;
+  bool preventBias(void) const;
+  bool onlySaveHealthyData(void) const;
+  // Whether the click detectors record pulse-height spectra
+  bool pulseAnalysis(void) const;
+
+  // Bytes collected for the current FIPS 140-2 block
+  int bufferedBytes(void) const;
+  qint64 byteCount(void) const;
+  qint64 elapsedMs(void) const;
+  // Byte rate measured over the last completed block
+  qreal bytesPerSecond(void) const;
+
+  // Blocks until the running min-entropy estimates have finished.
+  // Their results are reported once control returns to the event
+  // loop, e.g. after a replay.
+  void waitForEstimates(void);
+
+  static const int BlockBytes;
+
+public slots:
+  void start(void);
+  void stop(void);
+  // Stops after the next click, so that no interval is cut in half.
+  void stopOnNextClick(void);
+  void setVolume(qreal);
+  void setExtractor(const QString &id);
+  void setPreventBias(bool);
+  void setOnlySaveHealthyData(bool);
+  void setPulseAnalysis(bool);
+  void resetIntervalStatistics(void);
+
+signals:
+  void started(void);
+  void stopped(void);
+  void message(const QString &);
+  void byteAdded(quint8);
+  void bufferedBytesChanged(int);
+  void healthChanged(bool healthy);
+  void healthyBlock(const QByteArray &);
+  void drbgSeeded(void);
+  void extractorChanged(const QString &id);
+
+private slots:
+  void collectClicks(void);
+  void onAudioStateChanged(QAudio::State);
+  void onByteEntropyEstimated(void);
+  void onDtEntropyEstimated(void);
+  void onSimulationTick(void);
+
+private:
+  void init(void);
+  void setDevices(const QList<QAudioDeviceInfo> &);
+  void createExtractors(const QString &id);
+  void openOutputs(void);
+  QString outputPath(const QString &fileName) const;
+  QString dtLogPath(int channel) const;
+  void processClick(const ClickEvent &);
+  void addBit(int);
+  void clearRandomBytes(void);
+  void seedDrbg(const QByteArray &rawBytes);
+  void discardBlock(const QString &failedTest);
+  bool healthCheck(const QByteArray &randomBytes);
+  void logMinEntropy(const QString &source, const MinEntropyEstimate &);
+
+  QScopedPointer<EntropyEnginePrivate> d_ptr;
+  Q_DECLARE_PRIVATE(EntropyEngine)
+  Q_DISABLE_COPY(EntropyEngine)
+};
+
+#endif // __ENTROPYENGINE_H_
@@ -0,0 +1,340 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "entropyestimator.h"
+
+#include <QDebug>
+#include <QHash>
+#include <QtMath>
+#include <QtConcurrent>
+#include <limits>
+
+
+// z value of the upper 99.5% confidence bound used throughout SP 800-90B
+static const qreal ZAlpha = 2.576;
+
+
+static qreal upperBound(qreal p, int n)
+{
+  return qMin(1.0, p + ZAlpha * qSqrt(p * (1.0 - p) / (n - 1)));
+}
+
+
+static qreal negLog2(qreal p)
+{
+  return -qLn(p) * M_LOG2E;
+}
+
+
+// Solves f(p) = target for p in [lo, hi], with f falling monotonically.
+// Returns -1 if there's no solution.
+template <typename F>
+static qreal solveFalling(F f, qreal target, qreal lo, qreal hi)
+{
+  if (target > f(lo) || target < f(hi))
+    return -1.0;
+  for (int i = 0; i < 64; ++i) {
+    const qreal mid = 0.5 * (lo + hi);
+    if (f(mid) > target) {
+      lo = mid;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  return 0.5 * (lo + hi);
+}
+
+
+QVector<quint8> toBits(const QVector<quint8> &symbols, int bitsPerSymbol)
+{
+  QVector<quint8> bits(symbols.size() * bitsPerSymbol);
+  quint8 *dst = bits.data();
+  for (int i = 0; i < symbols.size(); ++i) {
+    for (int j = bitsPerSymbol - 1; j >= 0; --j) {
+      *dst++ = (symbols.at(i) >> j) & 1;
+    }
+  }
+  return bits;
+}
+
+
+QVector<quint8> symbolsFromBytes(const QByteArray &bytes)
+{
+  QVector<quint8> symbols(bytes.size());
+  memcpy(symbols.data(), bytes.constData(), bytes.size());
+  return symbols;
+}
+
+
+QVector<quint8> symbolsFromIntervals(const QVector<qint64> &dtFrames, int bitsPerSymbol)
+{
+  const qint64 mask = (Q_INT64_C(1) << bitsPerSymbol) - 1;
+  QVector<quint8> symbols(dtFrames.size());
+  for (int i = 0; i < dtFrames.size(); ++i) {
+    symbols[i] = quint8(dtFrames.at(i) & mask);
+  }
+  return symbols;
+}
+
+
+// SP 800-90B, 6.3.1
+qreal estimateMostCommonValue(const QVector<quint8> &symbols, int bitsPerSymbol)
+{
+  const int L = symbols.size();
+  if (L < 2)
+    return 0.0;
+  QVector<int> histo(1 << bitsPerSymbol, 0);
+  for (int i = 0; i < L; ++i) {
+    ++histo[symbols.at(i)];
+  }
+  int maxCount = 0;
+  for (int i = 0; i < histo.size(); ++i) {
+    maxCount = qMax(maxCount, histo.at(i));
+  }
+  return negLog2(upperBound(qreal(maxCount) / L, L));
+}
+
+
+// Expected distance to the first collision of a binary source
+// with P(most likely bit) = p (SP 800-90B, 6.3.2, step 7).
+static qreal expectedCollisionTime(qreal p)
+{
+  const qreal q = 1.0 - p;
+  // F(q) = Gamma(3, 1/q) q^3 e^(1/q), in closed form
+  const qreal F = 2 * q * q * q + 2 * q * q + q;
+  const qreal d = 0.5 * (1.0 / p - 1.0 / q);
+  return p / (q * q) * (1.0 + d) * F - p / q * d;
+}
+
+
+// SP 800-90B, 6.3.2
+qreal estimateCollision(const QVector<quint8> &bits)
+{
+  const int L = bits.size();
+  QVector<int> t;
+  t.reserve(L / 2);
+  int i = 0;
+  while (i + 1 < L) {
+    if (bits.at(i) == bits.at(i + 1)) {
+      t.append(2);
+      i += 2;
+    }
+    else if (i + 2 < L) {
+      // out of three bits at least two are equal
+      t.append(3);
+      i += 3;
+    }
+    else {
+      break;
+    }
+  }
+  const int v = t.size();
+  if (v < 2)
+    return 0.0;
+  qreal mean = 0.0;
+  for (int j = 0; j < v; ++j) {
+    mean += t.at(j);
+  }
+  mean /= v;
+  qreal var = 0.0;
+  for (int j = 0; j < v; ++j) {
+    var += (t.at(j) - mean) * (t.at(j) - mean);
+  }
+  const qreal sigma = qSqrt(var / (v - 1));
+  const qreal meanLower = mean - ZAlpha * sigma / qSqrt(v);
+  const qreal p = solveFalling(expectedCollisionTime, meanLower, 0.5, 1.0 - 1e-12);
+  return (p > 0.0) ? negLog2(p) : 1.0;
+}
+
+
+// SP 800-90B, 6.3.3
+qreal estimateMarkov(const QVector<quint8> &bits)
+{
+  const int L = bits.size();
+  if (L < 2)
+    return 0.0;
+  qreal ones = 0;
+  qreal o[2][2] = { { 0, 0 }, { 0, 0 } };
+  for (int i = 0; i < L - 1; ++i) {
+    ++o[bits.at(i)][bits.at(i + 1)];
+    ones += bits.at(i);
+  }
+  ones += bits.at(L - 1);
+  const qreal P1 = ones / L;
+  const qreal P0 = 1.0 - P1;
+  const qreal from0 = o[0][0] + o[0][1];
+  const qreal from1 = o[1][0] + o[1][1];
+  const qreal P00 = (from0 > 0) ? o[0][0] / from0 : 0.0;
+  const qreal P01 = (from0 > 0) ? o[0][1] / from0 : 0.0;
+  const qreal P10 = (from1 > 0) ? o[1][0] / from1 : 0.0;
+  const qreal P11 = (from1 > 0) ? o[1][1] / from1 : 0.0;
+  // probabilities of the most likely 128 bit sequences
+  const qreal p[6] = {
+    P0 * qPow(P00, 127),
+    P0 * qPow(P01, 64) * qPow(P10, 63),
+    P0 * P01 * qPow(P11, 126),
+    P1 * P10 * qPow(P00, 126),
+    P1 * qPow(P10, 64) * qPow(P01, 63),
+    P1 * qPow(P11, 127)
+  };
+  qreal pMax = 0.0;
+  for (int i = 0; i < 6; ++i) {
+    pMax = qMax(pMax, p[i]);
+  }
+  if (pMax <= 0.0)
+    return 1.0;
+  return qMin(1.0, negLog2(pMax) / 128);
+}
+
+
+// SP 800-90B, 6.3.4
+qreal estimateCompression(const QVector<quint8> &bits)
+{
+  static const int B = 6;
+  static const int Q = 1000;
+  const int d = bits.size() / B;
+  const int K = d - Q;
+  if (K < 2)
+    return 0.0;
+  QVector<int> dict(1 << B, 0);
+  qreal sum = 0.0;
+  qreal sumSq = 0.0;
+  for (int i = 1; i <= d; ++i) {
+    int s = 0;
+    for (int j = 0; j < B; ++j) {
+      s = (s << 1) | bits.at((i - 1) * B + j);
+    }
+    if (i > Q) {
+      const qreal D = (dict.at(s) != 0) ? qLn(i - dict.at(s)) * M_LOG2E : qLn(i) * M_LOG2E;
+      sum += D;
+      sumSq += D * D;
+    }
+    dict[s] = i;
+  }
+  static const qreal c = 0.5907;
+  const qreal mean = sum / K;
+  const qreal sigma = c * qSqrt(qMax(0.0, sumSq / (K - 1) - mean * mean));
+  const qreal meanLower = mean - ZAlpha * sigma / qSqrt(K);
+  // G(z) from step 6, rearranged from a double sum over t and u
+  // into a single sum over u so that it takes O(d) time.
+  QVector<qreal> logs(d + 1);
+  for (int u = 1; u <= d; ++u) {
+    logs[u] = qLn(u) * M_LOG2E;
+  }
+  auto G = [&](qreal z) -> qreal {
+    qreal result = 0.0;
+    qreal r = 1.0; // (1 - z)^(u - 1)
+    for (int u = 1; u <= d; ++u) {
+      if (u < d) {
+        result += logs.at(u) * z * z * r * (d - qMax(u, Q));
+      }
+      if (u > Q) {
+        result += logs.at(u) * z * r;
+      }
+      r *= 1.0 - z;
+      if (r < std::numeric_limits<qreal>::min())
+        break;
+    }
+    return result / K;
+  };
+  static const int N = (1 << B) - 1;
+  auto expected = [&](qreal p) -> qreal {
+    return G(p) + N * G((1.0 - p) / N);
+  };
+  const qreal p = solveFalling(expected, meanLower, 1.0 / (1 << B), 1.0 - 1e-12);
+  return (p > 0.0) ? negLog2(p) / B : 1.0;
+}
+
+
+// SP 800-90B, 6.3.5
+qreal estimateTTuple(const QVector<quint8> &symbols, int bitsPerSymbol)
+{
+  static const int Cutoff = 35;
+  const int L = symbols.size();
+  if (L < 2)
+    return 0.0;
+  const int maxT = qMin(64 / bitsPerSymbol, L);
+  qreal pMax = 0.0;
+  QHash<quint64, int> counts;
+  for (int t = 1; t <= maxT; ++t) {
+    counts.clear();
+    counts.reserve(qMin(L, 1 << qMin(20, t * bitsPerSymbol)));
+    const quint64 mask = (t * bitsPerSymbol == 64) ? ~Q_UINT64_C(0) : ((Q_UINT64_C(1) << (t * bitsPerSymbol)) - 1);
+    quint64 tuple = 0;
+    int maxCount = 0;
+    for (int i = 0; i < L; ++i) {
+      tuple = ((tuple << bitsPerSymbol) | symbols.at(i)) & mask;
+      if (i + 1 >= t) {
+        maxCount = qMax(maxCount, ++counts[tuple]);
+      }
+    }
+    if (maxCount < Cutoff)
+      break;
+    const qreal P = qreal(maxCount) / (L - t + 1);
+    pMax = qMax(pMax, qPow(P, 1.0 / t));
+  }
+  if (pMax <= 0.0)
+    return qreal(bitsPerSymbol);
+  return negLog2(upperBound(pMax, L));
+}
+
+
+MinEntropyEstimate estimateMinEntropy(const QVector<quint8> &symbols, int bitsPerSymbol)
+{
+  Q_ASSERT(bitsPerSymbol >= 1 && bitsPerSymbol <= 8);
+  MinEntropyEstimate result;
+  result.sampleCount = symbols.size();
+  result.bitsPerSymbol = bitsPerSymbol;
+  const QVector<quint8> bits = (bitsPerSymbol == 1) ? symbols : toBits(symbols, bitsPerSymbol);
+  QFuture<qreal> mcv = QtConcurrent::run(estimateMostCommonValue, symbols, bitsPerSymbol);
+  QFuture<qreal> tTuple = QtConcurrent::run(estimateTTuple, symbols, bitsPerSymbol);
+  QFuture<qreal> collision = QtConcurrent::run(estimateCollision, bits);
+  QFuture<qreal> markov = QtConcurrent::run(estimateMarkov, bits);
+  QFuture<qreal> compression = QtConcurrent::run(estimateCompression, bits);
+  QFuture<qreal> bitMcv;
+  QFuture<qreal> bitTTuple;
+  if (bitsPerSymbol > 1) {
+    bitMcv = QtConcurrent::run(estimateMostCommonValue, bits, 1);
+    bitTTuple = QtConcurrent::run(estimateTTuple, bits, 1);
+  }
+  result.mostCommonValue = mcv.result();
+  result.tTuple = tTuple.result();
+  result.collision = collision.result();
+  result.markov = markov.result();
+  result.compression = compression.result();
+  if (bitsPerSymbol > 1) {
+    result.bitMostCommonValue = bitMcv.result();
+    result.bitTTuple = bitTTuple.result();
+  }
+  else {
+    result.bitMostCommonValue = result.mostCommonValue;
+    result.bitTTuple = result.tTuple;
+  }
+  const qreal hSymbols = qMin(result.mostCommonValue, result.tTuple);
+  const qreal hBits = qMin(qMin(qMin(result.bitMostCommonValue, result.bitTTuple), qMin(result.collision, result.markov)), result.compression);
+  result.minEntropy = qMin(hSymbols, bitsPerSymbol * hBits);
+  return result;
+}
+
+
+QFuture<MinEntropyEstimate> estimateMinEntropyAsync(const QVector<quint8> &symbols, int bitsPerSymbol)
+{
+  return QtConcurrent::run(estimateMinEntropy, symbols, bitsPerSymbol);
+}
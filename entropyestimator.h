@@ -0,0 +1,91 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef __ENTROPYESTIMATOR_H_
+#define __ENTROPYESTIMATOR_H_
+
+#include <QtGlobal>
+#include <QVector>
+#include <QByteArray>
+#include <QFuture>
+#include <QMetaType>
+
+// Min-entropy estimators from NIST SP 800-90B, section 6.3. Samples
+// are symbols of 1 to 8 bits. All estimates are in bits per symbol
+// of the data they're given. Collision, Markov and compression are
+// only defined for binary data; pass them the output of toBits().
+
+extern qreal estimateMostCommonValue(const QVector<quint8> &symbols, int bitsPerSymbol);
+extern qreal estimateCollision(const QVector<quint8> &bits);
+extern qreal estimateMarkov(const QVector<quint8> &bits);
+extern qreal estimateCompression(const QVector<quint8> &bits);
+extern qreal estimateTTuple(const QVector<quint8> &symbols, int bitsPerSymbol);
+
+// Expands every symbol to `bitsPerSymbol` binary symbols, MSB first.
+extern QVector<quint8> toBits(const QVector<quint8> &symbols, int bitsPerSymbol);
+
+extern QVector<quint8> symbolsFromBytes(const QByteArray &bytes);
+
+// Inter-arrival times carry most of their entropy in the least
+// significant bits, so keep the lowest `bitsPerSymbol` bits of each.
+extern QVector<quint8> symbolsFromIntervals(const QVector<qint64> &dtFrames, int bitsPerSymbol);
+
+
+struct MinEntropyEstimate
+{
+  MinEntropyEstimate(void)
+    : sampleCount(0)
+    , bitsPerSymbol(0)
+    , mostCommonValue(0.0)
+    , tTuple(0.0)
+    , bitMostCommonValue(0.0)
+    , bitTTuple(0.0)
+    , collision(0.0)
+    , markov(0.0)
+    , compression(0.0)
+    , minEntropy(0.0)
+  { /* ... */ }
+
+  int sampleCount;
+  int bitsPerSymbol;
+  // bits per symbol, estimated on the symbols
+  qreal mostCommonValue;
+  qreal tTuple;
+  // bits per bit, estimated on the expanded bit string
+  qreal bitMostCommonValue;
+  qreal bitTTuple;
+  qreal collision;
+  qreal markov;
+  qreal compression;
+  // bits per symbol: min(estimates on symbols, bitsPerSymbol * estimates on bits)
+  qreal minEntropy;
+};
+
+Q_DECLARE_METATYPE(MinEntropyEstimate)
+
+// Runs all estimators on the global QThreadPool and waits for them.
+// Doesn't touch any GUI objects, so it can be called from a batch
+// tool as well as from a worker thread.
+extern MinEntropyEstimate estimateMinEntropy(const QVector<quint8> &symbols, int bitsPerSymbol);
+
+// Same, but returns immediately. Watch the result with a QFutureWatcher.
+extern QFuture<MinEntropyEstimate> estimateMinEntropyAsync(const QVector<quint8> &symbols, int bitsPerSymbol);
+
+#endif // __ENTROPYESTIMATOR_H_
@@ -0,0 +1,410 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "entropyserver.h"
+#include "drbg.h"
+
+#include <QDebug>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QCoreApplication>
+#include <QList>
+#include <QtEndian>
+
+
+// EGD commands
+static const quint8 CmdEntropyLevel = 0x00;
+static const quint8 CmdReadNonBlocking = 0x01;
+static const quint8 CmdReadBlocking = 0x02;
+static const quint8 CmdWriteEntropy = 0x03;
+static const quint8 CmdReportPid = 0x04;
+
+static const int SocketReadBufferSize = 4096;
+static const int ProbeTimeoutMs = 1000;
+
+
+struct EgdClient
+{
+  EgdClient(QLocalSocket *socket)
+    : socket(socket)
+    , pending(0)
+  { /* ... */ }
+  QLocalSocket *socket;
+  // received, but not yet parsed
+  QByteArray input;
+  // bytes still owed to a blocking read
+  int pending;
+};
+
+
+class EntropyServerPrivate {
+public:
+  EntropyServerPrivate(HmacDrbg *drbg)
+    : drbg(drbg)
+    , source(EntropyServer::DrbgSource)
+    , reservoirSize(EntropyServer::DefaultReservoirSize)
+    , head(0)
+    , next(0)
+  { /* ... */ }
+  ~EntropyServerPrivate()
+  {
+    qDeleteAll(clients);
+  }
+  HmacDrbg *drbg;
+  QLocalServer server;
+  EntropyServer::Source source;
+  int reservoirSize;
+  QByteArray reservoir;
+  int head;
+  QList<EgdClient*> clients;
+  int next;
+
+  int available(void) const
+  {
+    return reservoir.size() - head;
+  }
+
+  bool drbgReady(void) const
+  {
+    return source == EntropyServer::DrbgSource
+        && drbg != Q_NULLPTR
+        && drbg->isInstantiated()
+        && !drbg->needsReseed();
+  }
+
+  void compact(void)
+  {
+    if (head > 0) {
+      reservoir.remove(0, head);
+      head = 0;
+    }
+  }
+
+  void refill(void)
+  {
+    if (!drbgReady() || available() >= reservoirSize / 4)
+      return;
+    compact();
+    const int filled = reservoir.size();
+    reservoir.resize(reservoirSize);
+    const qint64 n = drbg->read(reservoir.data() + filled, reservoirSize - filled);
+    reservoir.resize(filled + int(n));
+  }
+
+  // Moves up to `count` bytes from the reservoir to the client.
+  int give(EgdClient *client, int count)
+  {
+    refill();
+    const int n = qMin(count, available());
+    if (n > 0) {
+      client->socket->write(reservoir.constData() + head, n);
+      // never hand out the same bytes twice
+      memset(reservoir.data() + head, 0, n);
+      head += n;
+    }
+    return n;
+  }
+
+  EgdClient *clientFor(QObject *socket) const
+  {
+    foreach (EgdClient *client, clients) {
+      if (client->socket == socket)
+        return client;
+    }
+    return Q_NULLPTR;
+  }
+
+  // Parses and answers commands until a blocking read can't be
+  // satisfied right away. Returns false on a protocol error.
+  //
+  // A command may arrive split across several reads, so whatever has
+  // been received is appended to the unparsed rest of the last one.
+  // Nothing is read while a blocking read is pending, which leaves
+  // the socket's read buffer to throttle the client.
+  bool process(EgdClient *client)
+  {
+    while (client->pending == 0) {
+      if (client->socket->bytesAvailable() > 0) {
+        client->input.append(client->socket->readAll());
+      }
+      if (client->input.isEmpty())
+        break;
+      const quint8 cmd = quint8(client->input.at(0));
+      const int size = client->input.size();
+      switch (cmd) {
+      case CmdEntropyLevel:
+      {
+        const int bytes = drbgReady() ? reservoirSize : available();
+        uchar level[4];
+        qToBigEndian<quint32>(quint32(bytes) * 8, level);
+        client->socket->write(reinterpret_cast<const char *>(level), sizeof(level));
+        client->input.remove(0, 1);
+        break;
+      }
+      case CmdReadNonBlocking:
+      {
+        if (size < 2)
+          return true;
+        const int requested = quint8(client->input.at(1));
+        refill();
+        const char n = char(qMin(requested, available()));
+        client->socket->write(&n, 1);
+        give(client, quint8(n));
+        client->input.remove(0, 2);
+        break;
+      }
+      case CmdReadBlocking:
+        if (size < 2)
+          return true;
+        client->pending = quint8(client->input.at(1));
+        client->input.remove(0, 2);
+        break;
+      case CmdWriteEntropy:
+      {
+        // Clients can't be trusted to deliver entropy, so the data is
+        // accepted for compatibility and dropped.
+        if (size < 4)
+          return true;
+        const int len = 4 + quint8(client->input.at(3));
+        if (size < len)
+          return true;
+        client->input.remove(0, len);
+        break;
+      }
+      case CmdReportPid:
+      {
+        const QByteArray &pid = QByteArray::number(QCoreApplication::applicationPid());
+        client->socket->write(QByteArray(1, char(pid.size())) + pid);
+        client->input.remove(0, 1);
+        break;
+      }
+      default:
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+
+EntropyServer::EntropyServer(HmacDrbg *drbg, QObject *parent)
+  : QObject(parent)
+  , d_ptr(new EntropyServerPrivate(drbg))
+{
+  Q_D(EntropyServer);
+  d->server.setSocketOptions(QLocalServer::UserAccessOption);
+  QObject::connect(&d->server, SIGNAL(newConnection()), SLOT(onNewConnection()));
+}
+
+
+EntropyServer::~EntropyServer()
+{
+  close();
+}
+
+
+bool EntropyServer::listen(const QString &name)
+{
+  Q_D(EntropyServer);
+  // A socket file left over from a crashed instance would make
+  // listen() fail, but that of a running instance, e.g. the GUI next
+  // to qliqd, must be left alone. Only a stale file refuses
+  // connections.
+  QLocalSocket probe;
+  probe.connectToServer(name);
+  if (probe.waitForConnected(ProbeTimeoutMs)) {
+    probe.abort();
+    emit message(tr("EGD server cannot listen on %1: already in use.").arg(name));
+    return false;
+  }
+  if (probe.error() == QLocalSocket::ConnectionRefusedError) {
+    QLocalServer::removeServer(name);
+  }
+  const bool ok = d->server.listen(name);
+  if (ok) {
+    emit message(tr("EGD server listening on %1.").arg(d->server.fullServerName()));
+  }
+  else {
+    emit message(tr("EGD server cannot listen on %1: %2").arg(name).arg(d->server.errorString()));
+  }
+  return ok;
+}
+
+
+void EntropyServer::close(void)
+{
+  Q_D(EntropyServer);
+  d->server.close();
+  foreach (EgdClient *client, d->clients) {
+    client->socket->abort();
+  }
+}
+
+
+bool EntropyServer::isListening(void) const
+{
+  return d_ptr->server.isListening();
+}
+
+
+QString EntropyServer::fullServerName(void) const
+{
+  return d_ptr->server.fullServerName();
+}
+
+
+QString EntropyServer::errorString(void) const
+{
+  return d_ptr->server.errorString();
+}
+
+
+void EntropyServer::setSource(EntropyServer::Source source)
+{
+  Q_D(EntropyServer);
+  if (source != d->source) {
+    d->source = source;
+    d->reservoir.fill('\0');
+    d->reservoir.clear();
+    d->head = 0;
+  }
+}
+
+
+EntropyServer::Source EntropyServer::source(void) const
+{
+  return d_ptr->source;
+}
+
+
+void EntropyServer::setReservoirSize(int size)
+{
+  Q_D(EntropyServer);
+  d->reservoirSize = qMax(int(Quantum), size);
+}
+
+
+int EntropyServer::reservoirSize(void) const
+{
+  return d_ptr->reservoirSize;
+}
+
+
+int EntropyServer::reservoirLevel(void) const
+{
+  return d_ptr->available();
+}
+
+
+int EntropyServer::clientCount(void) const
+{
+  return d_ptr->clients.size();
+}
+
+
+void EntropyServer::addHealthyBytes(const QByteArray &bytes)
+{
+  Q_D(EntropyServer);
+  if (d->source != RawSource)
+    return;
+  d->compact();
+  const int n = qMin(bytes.size(), d->reservoirSize - d->reservoir.size());
+  d->reservoir.append(bytes.constData(), n);
+  serve();
+}
+
+
+void EntropyServer::onDrbgSeeded(void)
+{
+  serve();
+}
+
+
+void EntropyServer::onNewConnection(void)
+{
+  Q_D(EntropyServer);
+  while (d->server.hasPendingConnections()) {
+    QLocalSocket *socket = d->server.nextPendingConnection();
+    socket->setReadBufferSize(SocketReadBufferSize);
+    d->clients.append(new EgdClient(socket));
+    QObject::connect(socket, SIGNAL(readyRead()), SLOT(onReadyRead()));
+    QObject::connect(socket, SIGNAL(bytesWritten(qint64)), SLOT(onBytesWritten()));
+    QObject::connect(socket, SIGNAL(disconnected()), SLOT(onDisconnected()));
+  }
+}
+
+
+void EntropyServer::onReadyRead(void)
+{
+  Q_D(EntropyServer);
+  EgdClient *client = d->clientFor(sender());
+  if (client == Q_NULLPTR || client->pending > 0)
+    return;
+  if (!d->process(client)) {
+    client->socket->abort();
+    return;
+  }
+  serve();
+}
+
+
+void EntropyServer::onBytesWritten(void)
+{
+  serve();
+}
+
+
+void EntropyServer::onDisconnected(void)
+{
+  Q_D(EntropyServer);
+  EgdClient *client = d->clientFor(sender());
+  if (client == Q_NULLPTR)
+    return;
+  d->clients.removeOne(client);
+  client->socket->deleteLater();
+  delete client;
+}
+
+
+// Deals out the reservoir round-robin to all clients waiting in a
+// blocking read.
+void EntropyServer::serve(void)
+{
+  Q_D(EntropyServer);
+  bool progress = true;
+  while (progress && !d->clients.isEmpty()) {
+    progress = false;
+    const int count = d->clients.size();
+    for (int i = 0; i < count; ++i) {
+      EgdClient *client = d->clients.at((d->next + i) % count);
+      if (client->pending == 0 || client->socket->bytesToWrite() > MaxPendingBytes)
+        continue;
+      const int n = d->give(client, qMin(client->pending, int(Quantum)));
+      if (n == 0)
+        return;
+      client->pending -= n;
+      progress = true;
+      if (client->pending == 0 && !d->process(client)) {
+        client->socket->abort();
+        return;
+      }
+    }
+    d->next = (d->next + 1) % count;
+  }
+}
@@ -0,0 +1,99 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef __ENTROPYSERVER_H_
+#define __ENTROPYSERVER_H_
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QScopedPointer>
+
+class HmacDrbg;
+class EntropyServerPrivate;
+
+// Hands out random bytes over a local socket (a Unix domain socket on
+// Unix, a named pipe on Windows) speaking the Entropy Gathering Daemon
+// protocol, so that OpenSSL, GnuPG and friends can use it directly.
+//
+// Bytes come from a reservoir that is refilled either from the DRBG
+// or with raw blocks that passed the health tests. Blocking requests
+// are served round-robin, at most Quantum bytes per client and round,
+// so one greedy client can't starve the others. A client whose
+// unsent output exceeds MaxPendingBytes is skipped, and while it
+// has a request outstanding nothing more is read from its socket, so
+// the kernel socket buffer pushes back on it.
+class EntropyServer : public QObject
+{
+  Q_OBJECT
+
+public:
+  enum Source {
+    DrbgSource,
+    RawSource
+  };
+
+  static const int Quantum = 256;
+  static const int MaxPendingBytes = 64 * 1024;
+  static const int DefaultReservoirSize = 64 * 1024;
+
+  EntropyServer(HmacDrbg *drbg, QObject *parent = Q_NULLPTR);
+  ~EntropyServer();
+
+  // `name` is either a bare name or an absolute path to the socket.
+  // Fails if another server is listening on it already.
+  bool listen(const QString &name);
+  void close(void);
+  bool isListening(void) const;
+  QString fullServerName(void) const;
+  QString errorString(void) const;
+
+  void setSource(Source);
+  Source source(void) const;
+  void setReservoirSize(int);
+  int reservoirSize(void) const;
+  int reservoirLevel(void) const;
+  int clientCount(void) const;
+
+public slots:
+  // Raw bytes that passed the health tests. Ignored unless the
+  // source is RawSource.
+  void addHealthyBytes(const QByteArray &);
+  // To be called when the DRBG has been (re)seeded.
+  void onDrbgSeeded(void);
+
+signals:
+  void message(const QString &);
+
+private slots:
+  void onNewConnection(void);
+  void onReadyRead(void);
+  void onBytesWritten(void);
+  void onDisconnected(void);
+
+private:
+  void serve(void);
+
+  QScopedPointer<EntropyServerPrivate> d_ptr;
+  Q_DECLARE_PRIVATE(EntropyServer)
+  Q_DISABLE_COPY(EntropyServer)
+};
+
+#endif // __ENTROPYSERVER_H_
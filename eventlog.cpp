@@ -0,0 +1,580 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "eventlog.h"
+#include "outputwriter.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QObject>
+#include <QVector>
+#include <QByteArray>
+#include <QtEndian>
+#include <cstring>
+
+
+static const char FileMagic[8] = { 'Q', 'L', 'I', 'Q', 'D', 'T', 'L', 'G' };
+static const char BlockMagic[4] = { 'Q', 'D', 'T', 'B' };
+static const quint16 FormatVersion = 1;
+static const int FileHeaderSize = 64;
+static const int BlockHeaderSize = 24;
+// an unsigned 64 bit LEB128 number takes up to 10 bytes
+static const int MaxVarintBytes = 10;
+
+const int EventLogWriter::BlockEvents = 4096;
+
+
+class EventLogWriterPrivate {
+public:
+  EventLogWriterPrivate(void)
+    : block(BlockHeaderSize + EventLogWriter::BlockEvents * MaxVarintBytes, '\0')
+    , blockEvents(0)
+    , blockBytes(BlockHeaderSize)
+    , blockFirstFrame(0)
+    , events(0)
+    , writer(Q_NULLPTR)
+    , stream(Q_NULLPTR)
+  { /* ... */ }
+  QFile file;
+  OutputWriter *writer;
+  OutputStream *stream;
+  QString errorString;
+  QByteArray block;
+  int blockEvents;
+  int blockBytes;
+  qint64 blockFirstFrame;
+  qint64 events;
+};
+
+
+EventLogWriter::EventLogWriter(void)
+  : d_ptr(new EventLogWriterPrivate)
+{
+  /* ... */
+}
+
+
+EventLogWriter::~EventLogWriter()
+{
+  close();
+}
+
+
+QByteArray EventLogWriter::fileHeader(const EventLogHeader &header)
+{
+  QByteArray bytes(FileHeaderSize, '\0');
+  uchar *h = reinterpret_cast<uchar*>(bytes.data());
+  memcpy(h, FileMagic, sizeof(FileMagic));
+  qToLittleEndian<quint16>(FormatVersion, h + 8);
+  qToLittleEndian<quint16>(FileHeaderSize, h + 10);
+  qToLittleEndian<quint32>(quint32(header.sampleRate), h + 12);
+  qToLittleEndian<quint16>(quint16(header.channelCount), h + 16);
+  qToLittleEndian<quint16>(quint16(header.sampleSize), h + 18);
+  qToLittleEndian<qint32>(header.threshold, h + 20);
+  qToLittleEndian<qint64>(header.lockTimeNs, h + 24);
+  qToLittleEndian<qint64>(header.anchor.frame, h + 32);
+  qToLittleEndian<qint64>(header.anchor.msecsSinceEpoch, h + 40);
+  qToLittleEndian<quint16>(quint16(header.channel), h + 48);
+  return bytes;
+}
+
+
+bool EventLogWriter::open(const QString &filename, const EventLogHeader &header)
+{
+  Q_D(EventLogWriter);
+  close();
+  d->file.setFileName(filename);
+  if (!d->file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered)) {
+    d->errorString = d->file.errorString();
+    return false;
+  }
+  if (d->file.write(fileHeader(header)) != FileHeaderSize) {
+    d->errorString = d->file.errorString();
+    d->file.close();
+    return false;
+  }
+  d->blockEvents = 0;
+  d->blockBytes = BlockHeaderSize;
+  d->events = 0;
+  return true;
+}
+
+
+bool EventLogWriter::open(OutputWriter *writer, const QString &filename, const EventLogHeader &header)
+{
+  Q_D(EventLogWriter);
+  close();
+  d->writer = writer;
+  d->stream = writer->open(filename, fileHeader(header));
+  d->blockEvents = 0;
+  d->blockBytes = BlockHeaderSize;
+  d->events = 0;
+  return true;
+}
+
+
+bool EventLogWriter::isOpen(void) const
+{
+  return d_ptr->stream != Q_NULLPTR || d_ptr->file.isOpen();
+}
+
+
+QString EventLogWriter::errorString(void) const
+{
+  return d_ptr->errorString;
+}
+
+
+void EventLogWriter::close(void)
+{
+  Q_D(EventLogWriter);
+  if (!isOpen())
+    return;
+  flush();
+  if (d->stream != Q_NULLPTR) {
+    d->writer->close(d->stream);
+    d->stream = Q_NULLPTR;
+    d->writer = Q_NULLPTR;
+  }
+  d->file.close();
+}
+
+
+void EventLogWriter::append(const ClickEvent &click)
+{
+  Q_D(EventLogWriter);
+  if (!isOpen())
+    return;
+  if (d->blockEvents == 0) {
+    d->blockFirstFrame = click.frame;
+  }
+  uchar *p = reinterpret_cast<uchar*>(d->block.data()) + d->blockBytes;
+  quint64 v = quint64(qMax<qint64>(0, click.dtFrames));
+  while (v >= 0x80) {
+    *p++ = uchar(v) | 0x80;
+    v >>= 7;
+  }
+  *p++ = uchar(v);
+  d->blockBytes = int(p - reinterpret_cast<uchar*>(d->block.data()));
+  ++d->events;
+  if (++d->blockEvents == BlockEvents) {
+    flush();
+  }
+}
+
+
+bool EventLogWriter::flush(void)
+{
+  Q_D(EventLogWriter);
+  if (!isOpen())
+    return false;
+  if (d->blockEvents == 0)
+    return true;
+  uchar *h = reinterpret_cast<uchar*>(d->block.data());
+  memcpy(h, BlockMagic, sizeof(BlockMagic));
+  qToLittleEndian<quint32>(quint32(d->blockEvents), h + 4);
+  qToLittleEndian<quint32>(quint32(d->blockBytes - BlockHeaderSize), h + 8);
+  qToLittleEndian<quint32>(0, h + 12);
+  qToLittleEndian<qint64>(d->blockFirstFrame, h + 16);
+  bool ok = true;
+  if (d->stream != Q_NULLPTR) {
+    d->stream->write(d->block.constData(), d->blockBytes);
+  }
+  else if (d->file.write(d->block.constData(), d->blockBytes) != d->blockBytes) {
+    d->errorString = d->file.errorString();
+    ok = false;
+  }
+  d->blockEvents = 0;
+  d->blockBytes = BlockHeaderSize;
+  return ok;
+}
+
+
+qint64 EventLogWriter::eventCount(void) const
+{
+  return d_ptr->events;
+}
+
+
+struct EventLogBlock
+{
+  qint64 payload;
+  qint64 payloadBytes;
+  qint64 firstEvent;
+  qint64 firstFrame;
+  int count;
+};
+Q_DECLARE_TYPEINFO(EventLogBlock, Q_PRIMITIVE_TYPE);
+
+
+class EventLogReaderPrivate {
+public:
+  EventLogReaderPrivate(const QString &filename)
+    : file(filename)
+    , data(Q_NULLPTR)
+    , size(0)
+    , events(0)
+    , block(0)
+    , indexInBlock(0)
+    , offset(0)
+    , frame(0)
+  { /* ... */ }
+  QFile file;
+  QString errorString;
+  const uchar *data;
+  qint64 size;
+  EventLogHeader header;
+  QVector<EventLogBlock> blocks;
+  qint64 events;
+
+  // read position
+  int block;
+  int indexInBlock;
+  qint64 offset;
+  qint64 frame;
+
+  bool parseHeader(void);
+  void buildIndex(void);
+  // Index of the block holding event number `event`
+  int blockOf(qint64 event) const;
+  void enterBlock(int b);
+  // Decodes the interval at `pos` in block `b` and advances `pos`
+  inline bool decode(int b, qint64 &pos, qint64 &dtFrames) const;
+  inline bool decode(qint64 &dtFrames)
+  {
+    return decode(block, offset, dtFrames);
+  }
+};
+
+
+bool EventLogReaderPrivate::parseHeader(void)
+{
+  if (size < FileHeaderSize || memcmp(data, FileMagic, sizeof(FileMagic)) != 0) {
+    errorString = QObject::tr("not a Qliq event log");
+    return false;
+  }
+  const quint16 version = qFromLittleEndian<quint16>(data + 8);
+  if (version != FormatVersion) {
+    errorString = QObject::tr("unsupported event log version %1").arg(version);
+    return false;
+  }
+  const int headerSize = qFromLittleEndian<quint16>(data + 10);
+  if (headerSize < FileHeaderSize || headerSize > size) {
+    errorString = QObject::tr("bad event log header size");
+    return false;
+  }
+  header.sampleRate = int(qFromLittleEndian<quint32>(data + 12));
+  header.channelCount = qFromLittleEndian<quint16>(data + 16);
+  header.sampleSize = qFromLittleEndian<quint16>(data + 18);
+  header.threshold = qFromLittleEndian<qint32>(data + 20);
+  header.lockTimeNs = qFromLittleEndian<qint64>(data + 24);
+  header.anchor.frame = qFromLittleEndian<qint64>(data + 32);
+  header.anchor.msecsSinceEpoch = qFromLittleEndian<qint64>(data + 40);
+  header.channel = qFromLittleEndian<quint16>(data + 48);
+  offset = headerSize;
+  return true;
+}
+
+
+// Hops from block header to block header; only the first 24 bytes of
+// every block are touched.
+void EventLogReaderPrivate::buildIndex(void)
+{
+  blocks.clear();
+  events = 0;
+  qint64 pos = offset;
+  while (pos + BlockHeaderSize <= size) {
+    const uchar *h = data + pos;
+    if (memcmp(h, BlockMagic, sizeof(BlockMagic)) != 0)
+      break;
+    EventLogBlock b;
+    b.count = int(qFromLittleEndian<quint32>(h + 4));
+    b.payloadBytes = qFromLittleEndian<quint32>(h + 8);
+    b.firstFrame = qFromLittleEndian<qint64>(h + 16);
+    b.payload = pos + BlockHeaderSize;
+    b.firstEvent = events;
+    if (b.payload + b.payloadBytes > size || b.count > b.payloadBytes)
+      break;
+    blocks.append(b);
+    events += b.count;
+    pos = b.payload + b.payloadBytes;
+  }
+}
+
+
+void EventLogReaderPrivate::enterBlock(int b)
+{
+  block = b;
+  indexInBlock = 0;
+  if (b < blocks.size()) {
+    offset = blocks.at(b).payload;
+    frame = blocks.at(b).firstFrame;
+  }
+}
+
+
+int EventLogReaderPrivate::blockOf(qint64 event) const
+{
+  int lo = 0;
+  int hi = blocks.size();
+  while (hi - lo > 1) {
+    const int mid = (lo + hi) / 2;
+    if (blocks.at(mid).firstEvent <= event) {
+      lo = mid;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+
+inline bool EventLogReaderPrivate::decode(int b, qint64 &pos, qint64 &dtFrames) const
+{
+  const EventLogBlock &blk = blocks.at(b);
+  const qint64 end = blk.payload + blk.payloadBytes;
+  quint64 v = 0;
+  int shift = 0;
+  while (pos < end && shift < 64) {
+    const uchar c = data[pos++];
+    v |= quint64(c & 0x7f) << shift;
+    if ((c & 0x80) == 0) {
+      dtFrames = qint64(v);
+      return true;
+    }
+    shift += 7;
+  }
+  return false;
+}
+
+
+EventLogReader::EventLogReader(const QString &filename)
+  : d_ptr(new EventLogReaderPrivate(filename))
+{
+  /* ... */
+}
+
+
+EventLogReader::~EventLogReader()
+{
+  Q_D(EventLogReader);
+  if (d->data != Q_NULLPTR) {
+    d->file.unmap(const_cast<uchar*>(d->data));
+  }
+}
+
+
+bool EventLogReader::open(void)
+{
+  Q_D(EventLogReader);
+  if (!d->file.open(QIODevice::ReadOnly)) {
+    d->errorString = d->file.errorString();
+    return false;
+  }
+  d->size = d->file.size();
+  d->data = d->file.map(0, d->size);
+  if (d->data == Q_NULLPTR) {
+    d->errorString = d->file.errorString();
+    return false;
+  }
+  if (!d->parseHeader())
+    return false;
+  d->buildIndex();
+  d->enterBlock(0);
+  return true;
+}
+
+
+QString EventLogReader::errorString(void) const
+{
+  return d_ptr->errorString;
+}
+
+
+const EventLogHeader &EventLogReader::header(void) const
+{
+  return d_ptr->header;
+}
+
+
+qint64 EventLogReader::eventCount(void) const
+{
+  return d_ptr->events;
+}
+
+
+int EventLogReader::blockCount(void) const
+{
+  return d_ptr->blocks.size();
+}
+
+
+bool EventLogReader::seek(qint64 event)
+{
+  Q_D(EventLogReader);
+  if (event < 0 || event > d->events)
+    return false;
+  const int lo = d->blockOf(event);
+  d->enterBlock(lo);
+  if (lo >= d->blocks.size())
+    return true;
+  qint64 dt;
+  const qint64 skip = event - d->blocks.at(lo).firstEvent;
+  while (d->indexInBlock < skip && d->decode(dt)) {
+    if (d->indexInBlock > 0) {
+      d->frame += dt;
+    }
+    ++d->indexInBlock;
+  }
+  return true;
+}
+
+
+bool EventLogReader::seekToFrame(qint64 frame)
+{
+  Q_D(EventLogReader);
+  if (d->blocks.isEmpty())
+    return false;
+  int lo = 0;
+  int hi = d->blocks.size();
+  while (hi - lo > 1) {
+    const int mid = (lo + hi) / 2;
+    if (d->blocks.at(mid).firstFrame <= frame) {
+      lo = mid;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  d->enterBlock(lo);
+  while (d->block < d->blocks.size()) {
+    const qint64 offset = d->offset;
+    const qint64 lastFrame = d->frame;
+    qint64 dt;
+    if (!d->decode(dt)) {
+      d->enterBlock(d->block + 1);
+      continue;
+    }
+    const qint64 f = d->indexInBlock > 0 ? lastFrame + dt : lastFrame;
+    if (f >= frame) {
+      // step back, so that next() returns this event
+      d->offset = offset;
+      d->frame = lastFrame;
+      return true;
+    }
+    d->frame = f;
+    if (++d->indexInBlock == d->blocks.at(d->block).count) {
+      d->enterBlock(d->block + 1);
+    }
+  }
+  return true;
+}
+
+
+qint64 EventLogReader::position(void) const
+{
+  if (d_ptr->block >= d_ptr->blocks.size())
+    return d_ptr->events;
+  return d_ptr->blocks.at(d_ptr->block).firstEvent + d_ptr->indexInBlock;
+}
+
+
+bool EventLogReader::atEnd(void) const
+{
+  return position() >= d_ptr->events;
+}
+
+
+bool EventLogReader::next(ClickEvent &click)
+{
+  Q_D(EventLogReader);
+  while (d->block < d->blocks.size() && d->indexInBlock >= d->blocks.at(d->block).count) {
+    d->enterBlock(d->block + 1);
+  }
+  if (d->block >= d->blocks.size())
+    return false;
+  qint64 dt;
+  if (!d->decode(dt)) {
+    d->enterBlock(d->block + 1);
+    return next(click);
+  }
+  if (d->indexInBlock > 0) {
+    d->frame += dt;
+  }
+  ++d->indexInBlock;
+  click = ClickEvent(d->frame, dt, d->header.sampleRate, d->header.channel);
+  return true;
+}
+
+
+qint64 EventLogReader::read(qint64 *dtFrames, qint64 maxCount)
+{
+  Q_D(EventLogReader);
+  qint64 n = 0;
+  while (n < maxCount && d->block < d->blocks.size()) {
+    const int count = d->blocks.at(d->block).count;
+    while (n < maxCount && d->indexInBlock < count && d->decode(dtFrames[n])) {
+      if (d->indexInBlock > 0) {
+        d->frame += dtFrames[n];
+      }
+      ++d->indexInBlock;
+      ++n;
+    }
+    if (n < maxCount) {
+      d->enterBlock(d->block + 1);
+    }
+  }
+  return n;
+}
+
+
+// Doesn't touch the read position, so several threads can decode
+// different parts of the log at once.
+qint64 EventLogReader::read(qint64 event, qint64 *dtFrames, qint64 maxCount) const
+{
+  if (event < 0 || event >= d_ptr->events)
+    return 0;
+  int b = d_ptr->blockOf(event);
+  qint64 skip = event - d_ptr->blocks.at(b).firstEvent;
+  qint64 n = 0;
+  while (n < maxCount && b < d_ptr->blocks.size()) {
+    const EventLogBlock &block = d_ptr->blocks.at(b);
+    qint64 pos = block.payload;
+    qint64 dt;
+    for (int i = 0; i < block.count && n < maxCount && d_ptr->decode(b, pos, dt); ++i) {
+      if (i >= skip) {
+        dtFrames[n++] = dt;
+      }
+    }
+    skip = 0;
+    ++b;
+  }
+  return n;
+}
+
+
+bool EventLogReader::isEventLog(const QString &filename)
+{
+  QFile f(filename);
+  if (!f.open(QIODevice::ReadOnly))
+    return false;
+  char magic[sizeof(FileMagic)];
+  return f.read(magic, sizeof(magic)) == sizeof(magic) && memcmp(magic, FileMagic, sizeof(magic)) == 0;
+}
@@ -0,0 +1,164 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef __EVENTLOG_H_
+#define __EVENTLOG_H_
+
+#include <QtGlobal>
+#include <QString>
+#include <QByteArray>
+#include <QScopedPointer>
+
+#include "clickevent.h"
+
+class OutputWriter;
+class EventLogWriterPrivate;
+class EventLogReaderPrivate;
+
+
+// Binary log of inter-arrival times, replacing dt.txt.
+//
+// All numbers are little endian. The file starts with a 64 byte
+// header:
+//
+//   0  char[8]  "QLIQDTLG"
+//   8  quint16  format version (1)
+//  10  quint16  header size (64)
+//  12  quint32  sample rate
+//  16  quint16  channel count
+//  18  quint16  bits per sample
+//  20  qint32   click threshold
+//  24  qint64   lock time in ns
+//  32  qint64   anchor frame       \ see TimeAnchor; the anchor
+//  40  qint64   anchor wall time   / frame is -1 if unknown
+//  48  quint16  channel the events were detected on
+//  50           reserved, zero
+//
+// followed by blocks of up to BlockEvents events, each with a 24 byte
+// header:
+//
+//   0  char[4]  "QDTB"
+//   4  quint32  number of events
+//   8  quint32  payload size in bytes
+//  12  quint32  reserved, zero
+//  16  qint64   frame of the first event
+//
+// The payload holds each event's dtFrames as an unsigned LEB128
+// varint, so a click costs one or two bytes at usual rates. The frame
+// of event i + 1 is the frame of event i plus the dtFrames of event
+// i + 1. A block cut short by a crash is ignored by the reader.
+//
+// A log holds the clicks of a single channel; multichannel captures
+// are logged to one file per channel.
+struct EventLogHeader
+{
+  EventLogHeader(void)
+    : sampleRate(0)
+    , channelCount(0)
+    , sampleSize(0)
+    , threshold(0)
+    , lockTimeNs(0)
+    , channel(0)
+  { /* ... */ }
+  int sampleRate;
+  int channelCount;
+  int sampleSize;
+  int threshold;
+  qint64 lockTimeNs;
+  TimeAnchor anchor;
+  int channel;
+};
+
+
+class EventLogWriter
+{
+public:
+  EventLogWriter(void);
+  ~EventLogWriter();
+
+  // Truncates `filename` and writes the header
+  bool open(const QString &filename, const EventLogHeader &);
+  // Writes through `writer` instead, which repeats the header at the
+  // start of every rotated file
+  bool open(OutputWriter *writer, const QString &filename, const EventLogHeader &);
+  bool isOpen(void) const;
+  QString errorString(void) const;
+  // Writes the pending block and closes the file
+  void close(void);
+
+  // Collects events in memory; the file is written a block at a time.
+  void append(const ClickEvent &);
+  // Writes the pending events as a (possibly short) block
+  bool flush(void);
+
+  qint64 eventCount(void) const;
+
+  static QByteArray fileHeader(const EventLogHeader &);
+
+  static const int BlockEvents;
+
+private:
+  QScopedPointer<EventLogWriterPrivate> d_ptr;
+  Q_DECLARE_PRIVATE(EventLogWriter)
+  Q_DISABLE_COPY(EventLogWriter)
+};
+
+
+// Memory-maps an event log and indexes its blocks, so that reading
+// can start at any event or frame without decoding what lies before.
+class EventLogReader
+{
+public:
+  explicit EventLogReader(const QString &filename);
+  ~EventLogReader();
+
+  bool open(void);
+  QString errorString(void) const;
+  // Valid after open()
+  const EventLogHeader &header(void) const;
+  qint64 eventCount(void) const;
+  int blockCount(void) const;
+
+  // Positions the reader at event number `event`
+  bool seek(qint64 event);
+  // Positions the reader at the first event at or after `frame`
+  bool seekToFrame(qint64 frame);
+  // Index of the event next() will return
+  qint64 position(void) const;
+  bool atEnd(void) const;
+
+  bool next(ClickEvent &);
+  // Decodes up to `maxCount` intervals into `dtFrames`; returns the
+  // number of intervals read.
+  qint64 read(qint64 *dtFrames, qint64 maxCount);
+  // Decodes up to `maxCount` intervals from event number `event` on,
+  // without moving the reader; safe to call from several threads.
+  qint64 read(qint64 event, qint64 *dtFrames, qint64 maxCount) const;
+
+  // True if `filename` starts like an event log
+  static bool isEventLog(const QString &filename);
+
+private:
+  QScopedPointer<EventLogReaderPrivate> d_ptr;
+  Q_DECLARE_PRIVATE(EventLogReader)
+  Q_DISABLE_COPY(EventLogReader)
+};
+
+#endif // __EVENTLOG_H_
@@ -22,6 +22,8 @@
 #include <QDebug>
 #include <QVector>
 #include <QtMath>
+#include <cstring>
+#include <cmath>
 
 const int PopCount[256] = {
    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
@@ -38,7 +40,8 @@ const int PopCount[256] = {
    3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
    3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
-   3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7
+   3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
+   4, 5, 5, 6, 5, 6, 6, 7, 5, 6, 6, 7, 6, 7, 7, 8
 };
 
 
@@ -88,3 +91,234 @@ qreal testEntropy(const QByteArray &ran)
   }
   return ent;
 }
+
+
+// Acceptance intervals from FIPS 140-2, section 4.9.1
+static const int MonobitMin = 9725;
+static const int MonobitMax = 10275;
+static const qreal PokerMin = 2.16;
+static const qreal PokerMax = 46.17;
+static const int LongRunLength = 26;
+static const int MaxRunLength = 6;
+static const int RunsMin[MaxRunLength] = { 2315, 1114, 527, 240, 103, 103 };
+static const int RunsMax[MaxRunLength] = { 2685, 1386, 723, 384, 209, 209 };
+
+
+class Fips140TestPrivate
+{
+public:
+  Fips140TestPrivate(void)
+    : failed(Fips140Test::NoTest)
+    , resultOnes(0)
+    , resultPoker(0.0)
+    , resultLongestRun(0)
+    , blocks(0)
+  {
+    clear();
+  }
+  ~Fips140TestPrivate() { /* ... */ }
+  int ones;
+  int poker[16];
+  int runs[2][MaxRunLength];
+  int currentBit;
+  int runLength;
+  int longestRun;
+  int bytes;
+  int failed;
+  int resultOnes;
+  qreal resultPoker;
+  int resultLongestRun;
+  qint64 blocks;
+
+  void clear(void)
+  {
+    ones = 0;
+    memset(poker, 0, sizeof(poker));
+    memset(runs, 0, sizeof(runs));
+    currentBit = -1;
+    runLength = 0;
+    longestRun = 0;
+    bytes = 0;
+  }
+
+  inline void closeRun(void)
+  {
+    if (runLength > 0) {
+      ++runs[currentBit][qMin(runLength, MaxRunLength) - 1];
+      longestRun = qMax(longestRun, runLength);
+    }
+  }
+
+  void evaluate(void)
+  {
+    closeRun();
+    failed = Fips140Test::NoTest;
+    if (ones <= MonobitMin || ones >= MonobitMax) {
+      failed |= Fips140Test::Monobit;
+    }
+    int sumOfSquares = 0;
+    for (int i = 0; i < 16; ++i) {
+      sumOfSquares += poker[i] * poker[i];
+    }
+    static const int Segments = Fips140Test::BlockBits / 4;
+    const qreal x = 16.0 / Segments * sumOfSquares - Segments;
+    if (x <= PokerMin || x >= PokerMax) {
+      failed |= Fips140Test::Poker;
+    }
+    for (int bit = 0; bit < 2; ++bit) {
+      for (int i = 0; i < MaxRunLength; ++i) {
+        if (runs[bit][i] < RunsMin[i] || runs[bit][i] > RunsMax[i]) {
+          failed |= Fips140Test::Runs;
+        }
+      }
+    }
+    if (longestRun >= LongRunLength) {
+      failed |= Fips140Test::LongRun;
+    }
+    resultOnes = ones;
+    resultPoker = x;
+    resultLongestRun = longestRun;
+    ++blocks;
+  }
+};
+
+
+Fips140Test::Fips140Test(void)
+  : d_ptr(new Fips140TestPrivate)
+{
+  /* ... */
+}
+
+
+Fips140Test::~Fips140Test()
+{
+  /* ... */
+}
+
+
+bool Fips140Test::addByte(quint8 byte)
+{
+  Q_D(Fips140Test);
+  d->ones += PopCount[byte];
+  ++d->poker[byte & 0x0f];
+  ++d->poker[byte >> 4];
+  if ((byte == 0x00 && d->currentBit == 0) || (byte == 0xff && d->currentBit == 1)) {
+    d->runLength += 8;
+  }
+  else {
+    for (int i = 0; i < 8; ++i) {
+      const int bit = (byte >> i) & 1;
+      if (bit == d->currentBit) {
+        ++d->runLength;
+      }
+      else {
+        d->closeRun();
+        d->currentBit = bit;
+        d->runLength = 1;
+      }
+    }
+  }
+  if (++d->bytes < BlockBytes)
+    return false;
+  d->evaluate();
+  d->clear();
+  return true;
+}
+
+
+void Fips140Test::reset(void)
+{
+  Q_D(Fips140Test);
+  d->clear();
+}
+
+
+int Fips140Test::failedTests(void) const
+{
+  return d_ptr->failed;
+}
+
+
+bool Fips140Test::passed(void) const
+{
+  return d_ptr->blocks > 0 && d_ptr->failed == NoTest;
+}
+
+
+int Fips140Test::ones(void) const
+{
+  return d_ptr->resultOnes;
+}
+
+
+qreal Fips140Test::pokerStatistic(void) const
+{
+  return d_ptr->resultPoker;
+}
+
+
+int Fips140Test::longestRun(void) const
+{
+  return d_ptr->resultLongestRun;
+}
+
+
+int Fips140Test::bytesInBlock(void) const
+{
+  return d_ptr->bytes;
+}
+
+
+qint64 Fips140Test::blockCount(void) const
+{
+  return d_ptr->blocks;
+}
+
+
+RepetitionCountTest::RepetitionCountTest(qreal minEntropy, int alphaExponent)
+  : mCutoff(1 + int(qCeil(alphaExponent / minEntropy)))
+{
+  reset();
+}
+
+
+void RepetitionCountTest::reset(void)
+{
+  mLastSample = -1;
+  mCount = 0;
+  mFailed = false;
+}
+
+
+// Smallest k for which the binomial distribution B(n, p) has a
+// cumulative probability of at least 1 - 2^-alphaExponent.
+static int criticalBinomial(int n, qreal p, int alphaExponent)
+{
+  const qreal alpha = qPow(2.0, -alphaExponent);
+  const qreal lp = qLn(p);
+  const qreal lq = qLn(1.0 - p);
+  qreal cdf = 0.0;
+  for (int k = 0; k <= n; ++k) {
+    cdf += qExp(std::lgamma(n + 1.0) - std::lgamma(k + 1.0) - std::lgamma(n - k + 1.0) + k * lp + (n - k) * lq);
+    if (cdf >= 1.0 - alpha)
+      return k;
+  }
+  return n;
+}
+
+
+AdaptiveProportionTest::AdaptiveProportionTest(qreal minEntropy, int windowSize, int alphaExponent)
+  : mWindowSize(windowSize)
+  , mCutoff(1 + criticalBinomial(windowSize, qPow(2.0, -minEntropy), alphaExponent))
+{
+  reset();
+}
+
+
+void AdaptiveProportionTest::reset(void)
+{
+  mIndex = 0;
+  mFirstSample = -1;
+  mCount = 0;
+  mFailed = false;
+}
@@ -22,9 +22,136 @@
 #define __HEALTHCHECK_H_
 
 #include <QByteArray>
+#include <QScopedPointer>
 
 extern bool testMonobit(const QByteArray &ran, int &notPassedCount, int &testCount);
 extern qreal testEntropy(const QByteArray &ran);
 
+
+class Fips140TestPrivate;
+
+// FIPS 140-2 statistical random number generator tests (monobit,
+// poker, runs and long run), evaluated incrementally on 20,000 bit
+// blocks. Bits are consumed least significant bit first, in the order
+// MainWindow::addBit() assembles them, so the verdict for a block is
+// available as soon as its last byte has been added.
+class Fips140Test
+{
+public:
+  enum Test {
+    NoTest = 0,
+    Monobit = 1 << 0,
+    Poker = 1 << 1,
+    Runs = 1 << 2,
+    LongRun = 1 << 3
+  };
+
+  static const int BlockBits = 20000;
+  static const int BlockBytes = BlockBits / 8;
+
+  Fips140Test(void);
+  ~Fips140Test();
+
+  // Returns true if `byte` completed a block.
+  bool addByte(quint8 byte);
+  void reset(void);
+
+  // Results of the most recently completed block
+  int failedTests(void) const;
+  bool passed(void) const;
+  int ones(void) const;
+  qreal pokerStatistic(void) const;
+  int longestRun(void) const;
+
+  int bytesInBlock(void) const;
+  qint64 blockCount(void) const;
+
+private:
+  QScopedPointer<Fips140TestPrivate> d_ptr;
+  Q_DECLARE_PRIVATE(Fips140Test)
+  Q_DISABLE_COPY(Fips140Test)
+};
+
+
+// Continuous health tests from NIST SP 800-90B, section 4.4. Both
+// take O(1) time per sample. `minEntropy` is the entropy per sample
+// the source is assessed to deliver, `alphaExponent` the negative
+// binary logarithm of the tolerated false positive probability.
+
+// Repetition Count Test: raises an alarm when the same value repeats
+// too often in a row.
+class RepetitionCountTest
+{
+public:
+  explicit RepetitionCountTest(qreal minEntropy = 1.0, int alphaExponent = 20);
+
+  // Returns false if `sample` triggered an alarm.
+  inline bool addSample(int sample)
+  {
+    if (sample == mLastSample) {
+      if (++mCount >= mCutoff) {
+        mFailed = true;
+        return false;
+      }
+    }
+    else {
+      mLastSample = sample;
+      mCount = 1;
+    }
+    return true;
+  }
+  void reset(void);
+  bool failed(void) const { return mFailed; }
+  int cutoff(void) const { return mCutoff; }
+
+private:
+  int mCutoff;
+  int mLastSample;
+  int mCount;
+  bool mFailed;
+};
+
+
+// Adaptive Proportion Test: raises an alarm when the first value of a
+// window reappears too often within that window.
+class AdaptiveProportionTest
+{
+public:
+  // Use a window of 1024 samples for binary sources, 512 otherwise.
+  explicit AdaptiveProportionTest(qreal minEntropy = 1.0, int windowSize = 1024, int alphaExponent = 20);
+
+  // Returns false if `sample` triggered an alarm.
+  inline bool addSample(int sample)
+  {
+    if (mIndex == 0) {
+      mFirstSample = sample;
+      mCount = 1;
+    }
+    else if (sample == mFirstSample) {
+      if (++mCount >= mCutoff) {
+        mFailed = true;
+        mIndex = 0;
+        return false;
+      }
+    }
+    if (++mIndex >= mWindowSize) {
+      mIndex = 0;
+    }
+    return true;
+  }
+  void reset(void);
+  bool failed(void) const { return mFailed; }
+  int cutoff(void) const { return mCutoff; }
+  int windowSize(void) const { return mWindowSize; }
+
+private:
+  int mWindowSize;
+  int mCutoff;
+  int mIndex;
+  int mFirstSample;
+  int mCount;
+  bool mFailed;
+};
+
 #endif // __HEALTHCHECK_H_
 
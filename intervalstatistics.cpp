@@ -0,0 +1,360 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "intervalstatistics.h"
+
+#include <QObject>
+#include <qmath.h>
+#include <algorithm>
+#include <cmath>
+
+
+const qreal IntervalStatistics::TrackedQuantiles[IntervalStatistics::TrackedQuantileCount] = {
+  0.01, 0.1, 0.5, 0.9, 0.99
+};
+
+
+P2Quantile::P2Quantile(qreal p)
+  : mP(p)
+{
+  reset();
+}
+
+
+void P2Quantile::reset(void)
+{
+  mCount = 0;
+  for (int i = 0; i < 5; ++i) {
+    mHeight[i] = 0.0;
+    mPos[i] = i;
+  }
+  mDesired[0] = 0.0;
+  mDesired[1] = 2 * mP;
+  mDesired[2] = 4 * mP;
+  mDesired[3] = 2 + 2 * mP;
+  mDesired[4] = 4.0;
+  mIncrement[0] = 0.0;
+  mIncrement[1] = mP / 2;
+  mIncrement[2] = mP;
+  mIncrement[3] = (1 + mP) / 2;
+  mIncrement[4] = 1.0;
+}
+
+
+void P2Quantile::add(qreal x)
+{
+  if (mCount < 5) {
+    mHeight[mCount++] = x;
+    if (mCount == 5) {
+      std::sort(mHeight, mHeight + 5);
+    }
+    return;
+  }
+  ++mCount;
+  int k;
+  if (x < mHeight[0]) {
+    mHeight[0] = x;
+    k = 0;
+  }
+  else if (x >= mHeight[4]) {
+    mHeight[4] = x;
+    k = 3;
+  }
+  else {
+    k = 0;
+    while (x >= mHeight[k + 1]) {
+      ++k;
+    }
+  }
+  for (int i = k + 1; i < 5; ++i) {
+    mPos[i] += 1;
+  }
+  for (int i = 0; i < 5; ++i) {
+    mDesired[i] += mIncrement[i];
+  }
+  // move the inner markers towards their desired positions
+  for (int i = 1; i < 4; ++i) {
+    const qreal delta = mDesired[i] - mPos[i];
+    if ((delta >= 1 && mPos[i + 1] - mPos[i] > 1) || (delta <= -1 && mPos[i - 1] - mPos[i] < -1)) {
+      const int d = (delta > 0) ? 1 : -1;
+      const qreal h = parabolic(i, d);
+      mHeight[i] = (mHeight[i - 1] < h && h < mHeight[i + 1]) ? h : linear(i, d);
+      mPos[i] += d;
+    }
+  }
+}
+
+
+qreal P2Quantile::parabolic(int i, int d) const
+{
+  return mHeight[i] + d / (mPos[i + 1] - mPos[i - 1]) *
+      ((mPos[i] - mPos[i - 1] + d) * (mHeight[i + 1] - mHeight[i]) / (mPos[i + 1] - mPos[i]) +
+       (mPos[i + 1] - mPos[i] - d) * (mHeight[i] - mHeight[i - 1]) / (mPos[i] - mPos[i - 1]));
+}
+
+
+qreal P2Quantile::linear(int i, int d) const
+{
+  return mHeight[i] + d * (mHeight[i + d] - mHeight[i]) / (mPos[i + d] - mPos[i]);
+}
+
+
+qreal P2Quantile::value(void) const
+{
+  if (mCount >= 5)
+    return mHeight[2];
+  if (mCount == 0)
+    return 0.0;
+  qreal sorted[5];
+  std::copy(mHeight, mHeight + mCount, sorted);
+  std::sort(sorted, sorted + mCount);
+  return sorted[qRound(mP * (mCount - 1))];
+}
+
+
+IntervalStatistics::IntervalStatistics(void)
+{
+  for (int i = 0; i < TrackedQuantileCount; ++i) {
+    mQuantiles[i] = P2Quantile(TrackedQuantiles[i]);
+  }
+  reset();
+}
+
+
+void IntervalStatistics::reset(void)
+{
+  mCount = 0;
+  mMin = 0;
+  mMax = 0;
+  mMean = 0.0;
+  mM2 = 0.0;
+  mMerged = false;
+  std::fill(mBuckets, mBuckets + Buckets, 0);
+  for (int i = 0; i < TrackedQuantileCount; ++i) {
+    mQuantiles[i].reset();
+  }
+}
+
+
+void IntervalStatistics::add(qint64 dtFrames)
+{
+  if (mCount == 0) {
+    mMin = dtFrames;
+    mMax = dtFrames;
+  }
+  else {
+    mMin = qMin(mMin, dtFrames);
+    mMax = qMax(mMax, dtFrames);
+  }
+  ++mCount;
+  const qreal delta = dtFrames - mMean;
+  mMean += delta / mCount;
+  mM2 += delta * (dtFrames - mMean);
+  ++mBuckets[bucketOf(dtFrames)];
+  for (int i = 0; i < TrackedQuantileCount; ++i) {
+    mQuantiles[i].add(dtFrames);
+  }
+}
+
+
+// Chan et al.'s update for the moments of the union of two samples
+void IntervalStatistics::merge(const IntervalStatistics &other)
+{
+  if (other.mCount == 0)
+    return;
+  if (mCount == 0) {
+    mMin = other.mMin;
+    mMax = other.mMax;
+  }
+  else {
+    mMin = qMin(mMin, other.mMin);
+    mMax = qMax(mMax, other.mMax);
+  }
+  const qint64 n = mCount + other.mCount;
+  const qreal delta = other.mMean - mMean;
+  mMean += delta * other.mCount / n;
+  mM2 += other.mM2 + delta * delta * (qreal(mCount) * other.mCount / n);
+  mCount = n;
+  for (int bucket = 0; bucket < Buckets; ++bucket) {
+    mBuckets[bucket] += other.mBuckets[bucket];
+  }
+  mMerged = true;
+}
+
+
+qreal IntervalStatistics::variance(void) const
+{
+  return (mCount > 1) ? mM2 / (mCount - 1) : 0.0;
+}
+
+
+qreal IntervalStatistics::standardDeviation(void) const
+{
+  return qSqrt(variance());
+}
+
+
+qreal IntervalStatistics::coefficientOfVariation(void) const
+{
+  return (mMean > 0) ? standardDeviation() / mMean : 0.0;
+}
+
+
+qreal IntervalStatistics::median(void) const
+{
+  return quantile(0.5);
+}
+
+
+qreal IntervalStatistics::quantile(qreal p) const
+{
+  for (int i = 0; i < TrackedQuantileCount && !mMerged; ++i) {
+    if (qFuzzyCompare(p, TrackedQuantiles[i]))
+      return mQuantiles[i].value();
+  }
+  if (mCount == 0)
+    return 0.0;
+  const qreal rank = qBound(qreal(0), p, qreal(1)) * mCount;
+  quint64 below = 0;
+  for (int bucket = bucketOf(mMin); bucket <= bucketOf(mMax); ++bucket) {
+    const quint64 n = mBuckets[bucket];
+    if (n > 0 && below + n >= rank) {
+      const qreal lo = bucketStart(bucket);
+      const qreal hi = (bucket + 1 < Buckets) ? bucketStart(bucket + 1) : mMax + 1;
+      const qreal x = lo + (rank - below) / n * (hi - lo);
+      return qBound(qreal(mMin), x, qreal(mMax));
+    }
+    below += n;
+  }
+  return mMax;
+}
+
+
+namespace {
+
+  inline int floorLog2(quint64 x)
+  {
+    int e = 0;
+    for (int shift = 32; shift > 0; shift /= 2) {
+      if (x >> shift) {
+        x >>= shift;
+        e += shift;
+      }
+    }
+    return e;
+  }
+
+}
+
+
+int IntervalStatistics::bucketOf(qint64 dtFrames)
+{
+  if (dtFrames < SubBuckets)
+    return int(qMax(Q_INT64_C(0), dtFrames));
+  const int e = floorLog2(quint64(dtFrames));
+  return SubBuckets + (e - 3) * SubBuckets + int(dtFrames >> (e - 3)) - SubBuckets;
+}
+
+
+qint64 IntervalStatistics::bucketStart(int bucket)
+{
+  if (bucket < SubBuckets)
+    return bucket;
+  const int k = bucket - SubBuckets;
+  return qint64(SubBuckets + k % SubBuckets) << (k / SubBuckets);
+}
+
+
+qreal IntervalStatistics::poissonChiSquare(int *degreesOfFreedom) const
+{
+  if (degreesOfFreedom != Q_NULLPTR) {
+    *degreesOfFreedom = 0;
+  }
+  const qreal excess = mMean - mMin;
+  if (mCount < 2 || excess <= 0)
+    return 0.0;
+  // Intervals are whole frames, so the shifted exponential is a
+  // shifted geometric distribution, whose parameter the mean fixes.
+  const qreal lambda = std::log1p(1 / excess);
+  const qreal n = mCount;
+  auto survival = [this, lambda](qint64 frames) {
+    return (frames <= mMin) ? 1.0 : qExp(-lambda * (frames - mMin));
+  };
+  qreal chiSquare = 0.0;
+  int groups = 0;
+  qreal observed = 0.0;
+  qreal expected = 0.0;
+  qreal lastObserved = 0.0;
+  qreal lastExpected = 0.0;
+  const int last = bucketOf(mMax);
+  for (int bucket = bucketOf(mMin); bucket <= last; ++bucket) {
+    observed += mBuckets[bucket];
+    // the tail beyond the maximum goes into the last bucket
+    const qreal hiSurvival = (bucket < last) ? survival(bucketStart(bucket + 1)) : 0.0;
+    expected += n * (survival(bucketStart(bucket)) - hiSurvival);
+    if (expected >= 5 || bucket == last) {
+      if (expected < 5 && groups > 0) {
+        // too few left for a group of their own
+        chiSquare -= (lastObserved - lastExpected) * (lastObserved - lastExpected) / lastExpected;
+        observed += lastObserved;
+        expected += lastExpected;
+        --groups;
+      }
+      if (expected > 0) {
+        chiSquare += (observed - expected) * (observed - expected) / expected;
+        ++groups;
+      }
+      lastObserved = observed;
+      lastExpected = expected;
+      observed = 0.0;
+      expected = 0.0;
+    }
+  }
+  // the total, the dead time and the rate were taken from the data
+  const int dof = groups - 3;
+  if (dof < 1)
+    return 0.0;
+  if (degreesOfFreedom != Q_NULLPTR) {
+    *degreesOfFreedom = dof;
+  }
+  return chiSquare;
+}
+
+
+QString IntervalStatistics::summary(int sampleRate) const
+{
+  if (mCount == 0 || sampleRate <= 0)
+    return QObject::tr("no intervals");
+  const qreal msPerFrame = 1000.0 / sampleRate;
+  int dof = 0;
+  const qreal chiSquare = poissonChiSquare(&dof);
+  return QObject::tr("%1 intervals, %2 counts/s, dt mean %3 ms, sd %4 ms, CV %5, "
+                     "min %6 ms, median %7 ms, p99 %8 ms, max %9 ms, chi2/dof %10")
+      .arg(mCount)
+      .arg((mMean > 0) ? sampleRate / mMean : 0.0, 0, 'f', 2)
+      .arg(mMean * msPerFrame, 0, 'f', 3)
+      .arg(standardDeviation() * msPerFrame, 0, 'f', 3)
+      .arg(coefficientOfVariation(), 0, 'f', 3)
+      .arg(mMin * msPerFrame, 0, 'f', 3)
+      .arg(median() * msPerFrame, 0, 'f', 3)
+      .arg(quantile(0.99) * msPerFrame, 0, 'f', 3)
+      .arg(mMax * msPerFrame, 0, 'f', 3)
+      .arg((dof > 0) ? chiSquare / dof : 0.0, 0, 'f', 2);
+}
@@ -0,0 +1,137 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+#ifndef __INTERVALSTATISTICS_H_
+#define __INTERVALSTATISTICS_H_
+
+#include <QtGlobal>
+#include <QString>
+
+
+// Estimates the `p` quantile of a stream in constant memory with the
+// P² algorithm (Jain and Chlamtac, 1985): five markers whose heights
+// are adjusted by piecewise-parabolic interpolation as values arrive.
+class P2Quantile
+{
+public:
+  explicit P2Quantile(qreal p = 0.5);
+
+  void add(qreal x);
+  void reset(void);
+
+  qreal p(void) const { return mP; }
+  qint64 count(void) const { return mCount; }
+  // Exact while fewer than five values have been added
+  qreal value(void) const;
+
+private:
+  qreal parabolic(int i, int d) const;
+  qreal linear(int i, int d) const;
+
+  qreal mP;
+  qint64 mCount;
+  // marker heights, actual and desired positions, and the increments
+  // of the desired positions
+  qreal mHeight[5];
+  qreal mPos[5];
+  qreal mDesired[5];
+  qreal mIncrement[5];
+};
+
+
+// Streaming statistics of the inter-arrival times of one channel:
+// mean and variance by Welford's method, minimum and maximum, a
+// histogram with logarithmically spaced buckets and P² estimates of a
+// few quantiles.
+// Memory and time per interval are constant, so it can run for weeks.
+//
+// For a Poisson source the intervals follow an exponential
+// distribution shifted by the dead time, so the coefficient of
+// variation is a little below 1 and poissonChiSquare() stays near 1
+// per degree of freedom. A dead time that grows, or short intervals
+// that go missing, show as a rising minimum, a falling coefficient of
+// variation and a chi-square that drifts away from its degrees of
+// freedom.
+//
+// All times are in frames.
+class IntervalStatistics
+{
+public:
+  // Buckets 0 to 7 hold the values 0 to 7; above, every octave is
+  // split into 8 buckets, i.e. bins are at most 12.5 % wide.
+  static const int SubBuckets = 8;
+  static const int Buckets = SubBuckets + (63 - 3) * SubBuckets;
+  // Quantiles estimated by P²; quantile() interpolates others from
+  // the histogram.
+  static const int TrackedQuantileCount = 5;
+  static const qreal TrackedQuantiles[TrackedQuantileCount];
+
+  IntervalStatistics(void);
+
+  void add(qint64 dtFrames);
+  // Adds the intervals counted by `other`, e.g. of a part of the
+  // stream processed on another thread. P² estimates can't be
+  // combined, so from then on all quantiles come from the histogram.
+  void merge(const IntervalStatistics &other);
+  void reset(void);
+
+  qint64 count(void) const { return mCount; }
+  qint64 min(void) const { return mMin; }
+  qint64 max(void) const { return mMax; }
+  qreal mean(void) const { return mMean; }
+  // Sample variance
+  qreal variance(void) const;
+  qreal standardDeviation(void) const;
+  // Standard deviation over mean; 1 for an exponential distribution
+  qreal coefficientOfVariation(void) const;
+  qreal median(void) const;
+  // 0 <= p <= 1
+  qreal quantile(qreal p) const;
+
+  quint64 bucketCount(int bucket) const { return mBuckets[bucket]; }
+  // Lower end of `bucket`; it holds the values up to, but excluding,
+  // the start of the next one.
+  static qint64 bucketStart(int bucket);
+  static int bucketOf(qint64 dtFrames);
+
+  // Pearson's chi-square of the histogram against an exponential
+  // distribution shifted by the minimum interval, with the rate
+  // fitted to the mean. Buckets are pooled until at least 5 intervals
+  // are expected in each. Returns 0 and sets `degreesOfFreedom` to 0
+  // if there are too few intervals.
+  qreal poissonChiSquare(int *degreesOfFreedom = Q_NULLPTR) const;
+
+  // One line for logs and status bars; rates and times are converted
+  // to seconds with `sampleRate`.
+  QString summary(int sampleRate) const;
+
+private:
+  qint64 mCount;
+  qint64 mMin;
+  qint64 mMax;
+  qreal mMean;
+  qreal mM2;
+  quint64 mBuckets[Buckets];
+  P2Quantile mQuantiles[TrackedQuantileCount];
+  bool mMerged;
+};
+
+#endif // __INTERVALSTATISTICS_H_
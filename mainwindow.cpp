@@ -21,24 +21,23 @@
 #include "ui_mainwindow.h"
 #include "volumerenderarea.h"
 #include "waverenderarea.h"
+#include "spectrumrenderarea.h"
 #include "audioinputdevice.h"
+#include "capturedevice.h"
+#include "clickdetector.h"
+#include "entropyengine.h"
+#include "intervalstatistics.h"
 #include "global.h"
-#include "healthcheck.h"
 
 #include <QDebug>
-#include <QAudioInput>
-#include <QAudioFormat>
-#include <QAudioDeviceInfo>
-#include <QSysInfo>
+#include <QDir>
 #include <QVBoxLayout>
 #include <QSlider>
-#include <QMutex>
-#include <QFile>
 #include <QSettings>
-#include <QElapsedTimer>
 #include <QDateTime>
 #include <QIcon>
-#include <limits>
+#include <QPixmap>
+#include <QTimer>
 
 
 class MainWindowPrivate {
@@ -46,76 +45,35 @@ public:
   MainWindowPrivate(void)
     : startIcon(":/images/start.png")
     , stopIcon(":/images/stop.png")
-    , audioDeviceInfo(QAudioDeviceInfo::defaultInputDevice())
-    , audio(Q_NULLPTR)
-    , audioInput(Q_NULLPTR)
+    , engine(Q_NULLPTR)
     , volumeRenderArea(Q_NULLPTR)
     , waveRenderArea(Q_NULLPTR)
-    , currentByte(0)
-    , currentByteIndex(0)
-    , flipBit(false)
-    , sampleBufferMutex(new QMutex)
-    , paused(false)
-    , pauseOnNextClick(false)
+    , spectrumRenderArea(Q_NULLPTR)
+    , displayedDevice(Q_NULLPTR)
+    , lastByte(0)
+    , byteAdded(false)
     , settings(QSettings::IniFormat, QSettings::UserScope, AppCompanyName, AppName)
-    , bps(std::numeric_limits<qreal>::min())
-    , byteCounter(0)
-    , dtIndex(0)
-  {
-// #define USE_PREFERRED_AUDIO_FORMAT
-#ifdef USE_PREFERRED_AUDIO_FORMAT
-    audioFormat = audioDeviceInfo.preferredFormat();
-#else
-    audioFormat.setSampleRate(11025);
-    audioFormat.setChannelCount(1);
-    audioFormat.setCodec("audio/pcm");
-    audioFormat.setSampleSize(16);
-    audioFormat.setByteOrder(QAudioFormat::LittleEndian);
-    audioFormat.setSampleType(QAudioFormat::SignedInt);
-#endif
-    qDebug() << audioFormat;
-
-    randomNumberFile.setFileName("..\\Qliq\\random-numbers.bin");
-    randomNumberFile.open(QIODevice::WriteOnly | QIODevice::Truncate);
-
-    dtFile.setFileName("..\\Qliq\\dt.txt");
-    dtFile.open(QIODevice::WriteOnly | QIODevice::Truncate);
-  }
-  ~MainWindowPrivate()
-  {
-    randomNumberFile.close();
-    dtFile.close();
-  }
+  { /* ... */ }
   QIcon startIcon;
   QIcon stopIcon;
-  QAudioDeviceInfo audioDeviceInfo;
-  QAudioFormat audioFormat;
-  QAudioInput *audio;
-  AudioInputDevice *audioInput;
+  EntropyEngine *engine;
   VolumeRenderArea *volumeRenderArea;
   WaveRenderArea *waveRenderArea;
-  QByteArray randomBytes;
-  quint8 currentByte;
-  int currentByteIndex;
-  bool flipBit;
-  QMutex *sampleBufferMutex;
-  bool paused;
-  bool pauseOnNextClick;
-  QFile randomNumberFile;
-  QFile dtFile;
+  SpectrumRenderArea *spectrumRenderArea;
+  // the device of the channel shown in waveRenderArea
+  AudioInputDevice *displayedDevice;
+  // shown on the next refresh, so that formatting doesn't hold up the
+  // engine, which runs on the GUI thread, at every byte
+  quint8 lastByte;
+  bool byteAdded;
+  // refreshes the volume meter at the waveform's frame rate
+  QTimer displayTimer;
+  // refreshes the interval statistics, which needn't change as often
+  QTimer statisticsTimer;
   QSettings settings;
-  QElapsedTimer timer;
-  qreal bps;
-  qint64 byteCounter;
-  QElapsedTimer totalTimer;
-  qint64 dtPair[2];
-  int dtIndex;
 };
 
 
-static const int MaxRandomBufferSize = 20000 / 8;
-
-
 MainWindow::MainWindow(QWidget *parent)
   : QMainWindow(parent)
   , ui(new Ui::MainWindow)
@@ -126,52 +84,83 @@ MainWindow::MainWindow(QWidget *parent)
 
   setWindowIcon(QIcon(":/images/qliq.ico"));
 
+  QAudioFormat format;
+  format.setChannelCount(d->settings.value("audio/channels", 1).toInt());
+  format.setSampleRate(d->settings.value("audio/sampleRate", 11025).toInt());
+  d->engine = new EntropyEngine(format, this);
+  QObject::connect(d->engine, SIGNAL(message(QString)), SLOT(log(QString)));
+  d->engine->setInputDevices(d->settings.value("audio/devices").toStringList());
+  QObject::connect(d->engine, SIGNAL(byteAdded(quint8)), SLOT(onByteAdded(quint8)));
+  QObject::connect(d->engine, SIGNAL(bufferedBytesChanged(int)), ui->bufferProgressBar, SLOT(setValue(int)));
+  QObject::connect(d->engine, SIGNAL(healthChanged(bool)), SLOT(onHealthChanged(bool)));
+  QObject::connect(d->engine, SIGNAL(started()), SLOT(onStarted()));
+  QObject::connect(d->engine, SIGNAL(stopped()), SLOT(onStopped()));
+  QObject::connect(d->engine, SIGNAL(extractorChanged(QString)), SLOT(onExtractorChanged(QString)));
+
   d->volumeRenderArea = new VolumeRenderArea;
 
-  d->waveRenderArea = new WaveRenderArea(d->sampleBufferMutex);
-  d->waveRenderArea->setAudioFormat(d->audioFormat);
+  d->waveRenderArea = new WaveRenderArea;
+  d->waveRenderArea->setAudioFormat(d->engine->audioFormat());
   d->waveRenderArea->setWritePixmap(false);
-  QObject::connect(d->waveRenderArea, SIGNAL(click(qint64)), SLOT(onClick(qint64)));
 
-  QObject::connect(ui->thresholdSlider, SIGNAL(valueChanged(int)), d->waveRenderArea, SLOT(setThreshold(int)));
-  const quint32 maxAmpl = AudioInputDevice::maxAmplitudeForFormat(d->audioFormat);
+  d->spectrumRenderArea = new SpectrumRenderArea;
+
+  const quint32 maxAmpl = AudioInputDevice::maxAmplitudeForFormat(d->engine->audioFormat());
   ui->thresholdSlider->setRange(maxAmpl / 100, maxAmpl);
   ui->thresholdSlider->setValue(ui->thresholdSlider->maximum() * 7 / 8);
 
-  d->audioInput  = new AudioInputDevice(d->audioFormat, d->sampleBufferMutex, this);
-  QObject::connect(d->audioInput, SIGNAL(update()), SLOT(refreshDisplay()));
-
-  QObject::connect(ui->startStopButton, SIGNAL(clicked(bool)), SLOT(startStop()));
-
-  QObject::connect(ui->volumeSlider, SIGNAL(valueChanged(int)), SLOT(onVolumeSliderChanged(int)));
-
-  d->audio = new QAudioInput(d->audioDeviceInfo, d->audioFormat, this);
-  ui->volumeSlider->setValue(qRound(100 * d->audio->volume()));
-  QObject::connect(d->audio, SIGNAL(stateChanged(QAudio::State)), SLOT(onAudioStateChanged(QAudio::State)));
+  foreach (const QString &id, BitExtractor::ids()) {
+    QScopedPointer<BitExtractor> extractor(BitExtractor::create(id));
+    ui->extractorComboBox->addItem(extractor->name(), id);
+  }
 
   ui->graphLayout->addWidget(d->waveRenderArea);
+  ui->graphLayout->addWidget(d->spectrumRenderArea);
   ui->graphLayout->addWidget(d->volumeRenderArea);
 
-  ui->statusBar->showMessage(d->audioDeviceInfo.deviceName());
+  ui->statusBar->showMessage(d->engine->inputDevices().join(", "));
 
-  ui->bufferProgressBar->setRange(0, MaxRandomBufferSize);
+  ui->bufferProgressBar->setRange(0, EntropyEngine::BlockBytes);
   ui->bufferProgressBar->setValue(0);
 
   restoreSettings();
 
-  d->audioInput->start();
-  d->audio->start(d->audioInput);
-  if (!d->paused) {
-    start();
+  for (int c = 0; c < d->engine->channelCount(); ++c) {
+    int deviceChannel;
+    const CaptureDevice *device = d->engine->captureDeviceOfChannel(c, &deviceChannel);
+    ui->channelComboBox->addItem(d->engine->deviceCount() > 1
+                                 ? tr("%1, channel %2").arg(device->deviceInfo().deviceName()).arg(deviceChannel + 1)
+                                 : tr("Channel %1").arg(c + 1));
+  }
+  ui->channelComboBox->setVisible(d->engine->channelCount() > 1);
+  onChannelComboBoxChanged(0);
+
+  QObject::connect(ui->channelComboBox, SIGNAL(currentIndexChanged(int)), SLOT(onChannelComboBoxChanged(int)));
+  QObject::connect(ui->volumeSlider, SIGNAL(valueChanged(int)), SLOT(onVolumeSliderChanged(int)));
+  QObject::connect(ui->extractorComboBox, SIGNAL(currentIndexChanged(int)), SLOT(onExtractorComboBoxChanged(int)));
+  QObject::connect(ui->preventBiasCheckBox, SIGNAL(toggled(bool)), d->engine, SLOT(setPreventBias(bool)));
+  QObject::connect(ui->onlySaveHealthyDataCheckBox, SIGNAL(toggled(bool)), d->engine, SLOT(setOnlySaveHealthyData(bool)));
+  QObject::connect(ui->pulseAnalysisCheckBox, SIGNAL(toggled(bool)), d->engine, SLOT(setPulseAnalysis(bool)));
+  QObject::connect(ui->pulseAnalysisCheckBox, SIGNAL(toggled(bool)), d->spectrumRenderArea, SLOT(setVisible(bool)));
+  QObject::connect(ui->startStopButton, SIGNAL(clicked(bool)), SLOT(startStop()));
+  QObject::connect(&d->displayTimer, SIGNAL(timeout()), SLOT(refreshDisplay()));
+  d->displayTimer.start(1000 / WaveRenderer::DefaultFps);
+  QObject::connect(&d->statisticsTimer, SIGNAL(timeout()), SLOT(refreshIntervalStatistics()));
+  d->statisticsTimer.start(1000);
+
+  if (d->settings.value("server/enabled", false).toBool()) {
+    d->engine->startServer();
+  }
+  d->engine->startCapture();
+  ui->volumeSlider->setValue(qRound(100 * d->engine->volume()));
+  if (!d->settings.value("mainwindow/paused", false).toBool()) {
+    d->engine->start();
   }
 }
 
 
 MainWindow::~MainWindow()
 {
-  Q_D(MainWindow);
-  d->audio->stop();
-  d->audioInput->stop();
   delete ui;
 }
 
@@ -187,10 +176,11 @@ void MainWindow::saveSettings(void)
 {
   Q_D(MainWindow);
   d->settings.setValue("mainwindow/geometry", saveGeometry());
-  d->settings.setValue("analysis/threshold", d->waveRenderArea->threshold());
-  d->settings.setValue("analysis/lockTimeNs", d->waveRenderArea->lockTimeNs());
-  d->settings.setValue("mainwindow/paused", d->paused);
-  d->settings.setValue("options/preventBias", ui->preventBiasCheckBox->isChecked());
+  d->settings.setValue("mainwindow/paused", !d->engine->isRunning());
+  // per device; channelCount() counts the channels of all devices
+  d->settings.setValue("audio/channels", d->engine->audioFormat().channelCount());
+  d->settings.setValue("audio/sampleRate", d->engine->audioFormat().sampleRate());
+  d->engine->saveSettings(d->settings);
   d->settings.sync();
 }
 
@@ -199,155 +189,136 @@ void MainWindow::restoreSettings(void)
 {
   Q_D(MainWindow);
   restoreGeometry(d->settings.value("mainwindow/geometry").toByteArray());
-  d->waveRenderArea->setThreshold(d->settings.value("analysis/threshold", 32000).toInt());
-  d->waveRenderArea->setLockTimeNs(d->settings.value("analysis/lockTimeNs", 1600 * 1000).toLongLong());
-  d->paused = d->settings.value("mainwindow/paused", false).toBool();
-  ui->preventBiasCheckBox->setChecked(d->settings.value("options/preventBias", true).toBool());
-  d->pauseOnNextClick = false;
+  d->engine->restoreSettings(d->settings);
+  ui->preventBiasCheckBox->setChecked(d->engine->preventBias());
+  ui->onlySaveHealthyDataCheckBox->setChecked(d->engine->onlySaveHealthyData());
+  ui->pulseAnalysisCheckBox->setChecked(d->engine->pulseAnalysis());
+  d->spectrumRenderArea->setVisible(d->engine->pulseAnalysis());
+  onExtractorChanged(d->engine->extractorId());
+  d->waveRenderArea->setScreenshotDirectory(QDir(d->engine->outputDirectory()).filePath("screenshots"));
 }
 
 
 void MainWindow::refreshDisplay(void)
 {
   Q_D(MainWindow);
-  if (!d->paused) {
-    d->volumeRenderArea->setLevel(d->audioInput->level());
-    d->waveRenderArea->setData(d->audioInput->sampleBuffer(), d->audio->processedUSecs());
+  if (d->byteAdded) {
+    d->byteAdded = false;
+    const qint64 elapsedMs = qMax<qint64>(1, d->engine->elapsedMs());
+    ui->statusLabel->setText(QString("%1 byte/min overall (%2 byte/s)")
+                             .arg(d->engine->byteCount() * 60 * 1000 / elapsedMs)
+                             .arg(d->engine->bytesPerSecond(), 0, 'f', 1));
+    ui->bitsLcdNumber->display(QString("%1").arg(int(d->lastByte), 8, 2, QChar('0')));
+    ui->byteLcdNumber->display(QString("%1").arg(int(d->lastByte), 2, 16, QChar('0')));
+  }
+  if (d->engine->isRunning() && d->displayedDevice != Q_NULLPTR) {
+    d->volumeRenderArea->setLevel(d->displayedDevice->level());
+    if (d->spectrumRenderArea->isVisible()) {
+      d->spectrumRenderArea->refresh();
+    }
   }
 }
 
 
-void MainWindow::onVolumeSliderChanged(int value)
+void MainWindow::refreshIntervalStatistics(void)
 {
   Q_D(MainWindow);
-  if (d->audio != Q_NULLPTR) {
-    d->audio->setVolume(1e-2 * value);
-  }
+  const IntervalStatistics *statistics = d->engine->intervalStatistics(ui->channelComboBox->currentIndex());
+  if (statistics == Q_NULLPTR)
+    return;
+  ui->intervalStatisticsLabel->setText(statistics->summary(d->engine->audioFormat().sampleRate()));
 }
 
 
-void MainWindow::addBit(int bit)
+void MainWindow::onVolumeSliderChanged(int value)
 {
   Q_D(MainWindow);
-  d->currentByte |= bit << d->currentByteIndex;
-  ++d->currentByteIndex;
-  if (d->currentByteIndex > 7) {
-    ui->statusLabel->setText(QString("%1 byte/min overall (%2 byte/s)")
-                             .arg(d->byteCounter * 60 * 1000 / d->totalTimer.elapsed())
-                             .arg(d->bps, 0, 'f', 1));
-    d->randomBytes.append(d->currentByte);
-    ui->bitsLcdNumber->display(QString("%1").arg(int(d->currentByte), 8, 2, QChar('0')));
-    ui->byteLcdNumber->display(QString("%1").arg(int(d->currentByte), 2, 16, QChar('0')));
-    ++d->byteCounter;
-    ui->bufferProgressBar->setValue(d->randomBytes.size());
-    if (d->randomBytes.size() >= MaxRandomBufferSize) {
-      d->bps = 1e9 * MaxRandomBufferSize / d->timer.nsecsElapsed();
-      d->timer.restart();
-      bool healthy = healthCheck(d->randomBytes);
-      if (healthy || !ui->onlySaveHealthyDataCheckBox->isChecked()) {
-        d->randomNumberFile.write(d->randomBytes);
-        d->randomNumberFile.flush();
-      }
-      d->randomBytes.clear();
-    }
-    d->currentByte = 0;
-    d->currentByteIndex = 0;
-  }
+  d->engine->setVolume(1e-2 * value);
 }
 
 
-void MainWindow::onClick(const qint64 dt)
+// Shows the channel and binds the threshold slider to its detector
+void MainWindow::onChannelComboBoxChanged(int channel)
 {
   Q_D(MainWindow);
-  d->dtPair[d->dtIndex] = dt;
-  if (++d->dtIndex > 1) {
-    d->dtIndex = 0;
-    int bit = (d->dtPair[1] > d->dtPair[0]) ^ d->flipBit ? 0 : 1;
-    addBit(bit);
-    if (ui->preventBiasCheckBox->isChecked()) {
-      d->flipBit = !d->flipBit;
-    }
-  }
-  if (d->pauseOnNextClick) {
-    stop();
-  }
-  d->dtFile.write(QString::number(dt).toLatin1().append("\n"));
+  int deviceChannel;
+  CaptureDevice *device = d->engine->captureDeviceOfChannel(channel, &deviceChannel);
+  if (device == Q_NULLPTR)
+    return;
+  ClickDetector *clickDetector = device->clickDetector(deviceChannel);
+  ui->thresholdSlider->disconnect(SIGNAL(valueChanged(int)));
+  ui->thresholdSlider->setValue(clickDetector->threshold());
+  QObject::connect(ui->thresholdSlider, SIGNAL(valueChanged(int)), clickDetector, SLOT(setThreshold(int)));
+  d->displayedDevice = device->audioInputDevice();
+  d->waveRenderArea->setClickDetector(clickDetector);
+  d->spectrumRenderArea->setClickDetector(clickDetector);
+  d->waveRenderArea->setSampleRing(d->displayedDevice->sampleRing(deviceChannel));
+  refreshIntervalStatistics();
 }
 
 
-void MainWindow::start(void)
+void MainWindow::onExtractorComboBoxChanged(int index)
 {
   Q_D(MainWindow);
-  d->timer.start();
-  d->totalTimer.start();
-  d->paused = false;
-  d->pauseOnNextClick = false;
-  d->byteCounter = 0;
-  ui->startStopButton->setIcon(d->stopIcon);
+  d->engine->setExtractor(ui->extractorComboBox->itemData(index).toString());
 }
 
 
-void MainWindow::stop(void)
+void MainWindow::onExtractorChanged(const QString &id)
 {
-  Q_D(MainWindow);
-  d->paused = true;
-  ui->startStopButton->setIcon(d->startIcon);
+  const int index = ui->extractorComboBox->findData(id);
+  if (index != ui->extractorComboBox->currentIndex()) {
+    ui->extractorComboBox->setCurrentIndex(index);
+  }
+  ui->preventBiasCheckBox->setEnabled(id == "pair");
 }
 
 
-void MainWindow::log(const QString &msg)
+void MainWindow::onByteAdded(quint8 byte)
 {
-  ui->logPlainTextEdit->appendPlainText(tr("[%1] %2").arg(QDateTime::currentDateTime().toString(Qt::ISODate)).arg(msg));
+  Q_D(MainWindow);
+  d->lastByte = byte;
+  d->byteAdded = true;
 }
 
 
-bool MainWindow::healthCheck(const QByteArray &randomBytes)
+void MainWindow::onHealthChanged(bool healthy)
 {
   static const QPixmap HappyIcon(":/images/happy.png");
   static const QPixmap SadIcon(":/images/sad.png");
-  bool healthy = true;
-  bool ok;
-  qreal entropy = testEntropy(randomBytes);
-  log(tr("Entropy: %1").arg(entropy, 0, 'f'));
-  int notPassedCount = 0;
-  int testCount = 0;
-  ok = testMonobit(randomBytes, notPassedCount, testCount);
-  healthy &= ok;
-  log(tr("FIPS 140-2 Monobit test %1.").arg(healthy ? tr("passed") : tr("failed")));
   ui->healthLabel->setPixmap(healthy ? HappyIcon : SadIcon);
-  return healthy;
 }
 
 
-void MainWindow::startStop(void)
+void MainWindow::onStarted(void)
 {
   Q_D(MainWindow);
-  if (d->paused) {
-    start();
-  }
-  else {
-    d->pauseOnNextClick = true;
-    d->paused = false;
-  }
+  ui->startStopButton->setIcon(d->stopIcon);
+  d->waveRenderArea->startRendering();
 }
 
 
-void MainWindow::onAudioStateChanged(QAudio::State audioState)
+void MainWindow::onStopped(void)
 {
   Q_D(MainWindow);
-  switch (audioState) {
-  case QAudio::StoppedState:
-    if (d->audio->error() != QAudio::NoError) {
-      // Error handling
-    }
-    else {
-      // Finished recording
-    }
-    break;
-  case QAudio::ActiveState:
-    d->timer.start();
-    break;
-  default:
-    break;
+  ui->startStopButton->setIcon(d->startIcon);
+  d->waveRenderArea->stopRendering();
+}
+
+
+void MainWindow::log(const QString &msg)
+{
+  ui->logPlainTextEdit->appendPlainText(tr("[%1] %2").arg(QDateTime::currentDateTime().toString(Qt::ISODate)).arg(msg));
+}
+
+
+void MainWindow::startStop(void)
+{
+  Q_D(MainWindow);
+  if (d->engine->isRunning()) {
+    d->engine->stopOnNextClick();
+  }
+  else {
+    d->engine->start();
   }
 }
@@ -22,9 +22,7 @@
 
 #include <QMainWindow>
 #include <QScopedPointer>
-#include <QByteArray>
 #include <QString>
-#include <QAudio>
 
 namespace Ui {
 class MainWindow;
@@ -50,20 +48,22 @@ private:
   Q_DISABLE_COPY(MainWindow)
 
 private slots:
-  void onAudioStateChanged(QAudio::State);
   void refreshDisplay(void);
+  void refreshIntervalStatistics(void);
   void onVolumeSliderChanged(int);
-  void onClick(const qint64 dt);
+  void onChannelComboBoxChanged(int);
+  void onExtractorComboBoxChanged(int);
+  void onExtractorChanged(const QString &id);
+  void onByteAdded(quint8);
+  void onHealthChanged(bool);
+  void onStarted(void);
+  void onStopped(void);
   void startStop(void);
+  void log(const QString &msg);
 
 private: // methods
-  void addBit(int);
   void restoreSettings(void);
   void saveSettings(void);
-  void start(void);
-  void stop(void);
-  bool healthCheck(const QByteArray &randomBytes);
-  void log(const QString &msg);
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,579 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "outputwriter.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDateTime>
+#include <QList>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <cstring>
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+
+const int OutputWriter::DefaultPageSize = 256 * 1024;
+
+
+static void syncFile(QFile &file)
+{
+  file.flush();
+#ifdef Q_OS_WIN
+  _commit(file.handle());
+#else
+  ::fsync(file.handle());
+#endif
+}
+
+
+class OutputStreamPrivate {
+public:
+  OutputStreamPrivate(OutputWriter *writer, const QString &fileName, const QByteArray &fileHeader, int pageSize)
+    : writer(writer)
+    , fileName(fileName)
+    , fileHeader(fileHeader)
+    , pageSize(pageSize)
+    , front(0)
+    , backPending(false)
+    , flushRequested(false)
+    , closeRequested(false)
+    , bytesWritten(0)
+    , droppedBytes(0)
+    , fileBytes(0)
+    , failed(false)
+  {
+    page[0].resize(pageSize);
+    page[1].resize(pageSize);
+    fill[0] = 0;
+    fill[1] = 0;
+  }
+  OutputWriter *writer;
+  const QString fileName;
+  const QByteArray fileHeader;
+  const int pageSize;
+
+  // guards everything the producer touches
+  QMutex mutex;
+  QByteArray page[2];
+  int fill[2];
+  int front;
+  bool backPending;
+  bool flushRequested;
+  bool closeRequested;
+  QElapsedTimer frontAge;
+  qint64 bytesWritten;
+  qint64 droppedBytes;
+
+  // writer thread only
+  QFile file;
+  qint64 fileBytes;
+  QElapsedTimer fileAge;
+  bool failed;
+
+  // Makes the front page the back page. Call with the mutex held.
+  bool handOver(void)
+  {
+    if (backPending)
+      return false;
+    front = 1 - front;
+    backPending = true;
+    return true;
+  }
+};
+
+
+OutputStream::OutputStream(OutputWriter *writer, const QString &fileName, const QByteArray &fileHeader, int pageSize)
+  : d_ptr(new OutputStreamPrivate(writer, fileName, fileHeader, pageSize))
+{
+  /* ... */
+}
+
+
+OutputStream::~OutputStream()
+{
+  /* ... */
+}
+
+
+void OutputStream::write(const char *data, qint64 len)
+{
+  Q_D(OutputStream);
+  if (len <= 0)
+    return;
+  bool wake = false;
+  {
+    QMutexLocker lock(&d->mutex);
+    if (d->closeRequested)
+      return;
+    if (len > d->pageSize - d->fill[d->front] && d->fill[d->front] > 0) {
+      // keep the record in one piece
+      if (!d->handOver()) {
+        d->droppedBytes += len;
+        return;
+      }
+      wake = true;
+    }
+    while (len > 0) {
+      int &fill = d->fill[d->front];
+      if (fill == 0) {
+        d->frontAge.start();
+      }
+      const int n = int(qMin<qint64>(len, d->pageSize - fill));
+      memcpy(d->page[d->front].data() + fill, data, size_t(n));
+      fill += n;
+      data += n;
+      len -= n;
+      if (fill == d->pageSize) {
+        if (d->handOver()) {
+          wake = true;
+        }
+        else if (len > 0) {
+          d->droppedBytes += len;
+          break;
+        }
+      }
+    }
+  }
+  if (wake) {
+    d->writer->wake();
+  }
+}
+
+
+void OutputStream::write(const QByteArray &data)
+{
+  write(data.constData(), data.size());
+}
+
+
+void OutputStream::flush(void)
+{
+  Q_D(OutputStream);
+  {
+    QMutexLocker lock(&d->mutex);
+    d->flushRequested = true;
+  }
+  d->writer->wake();
+}
+
+
+QString OutputStream::fileName(void) const
+{
+  return d_ptr->fileName;
+}
+
+
+qint64 OutputStream::bytesWritten(void) const
+{
+  QMutexLocker lock(&d_ptr->mutex);
+  return d_ptr->bytesWritten;
+}
+
+
+qint64 OutputStream::droppedBytes(void) const
+{
+  QMutexLocker lock(&d_ptr->mutex);
+  return d_ptr->droppedBytes;
+}
+
+
+class OutputWriterPrivate {
+public:
+  OutputWriterPrivate(OutputWriter *q)
+    : q_ptr(q)
+    , work(false)
+    , stopping(false)
+    , syncPolicy(OutputWriter::SyncOnClose)
+    , syncIntervalMs(1000)
+    , rotationBytes(0)
+    , rotationSeconds(0)
+    , pageSize(OutputWriter::DefaultPageSize)
+    , flushIntervalMs(1000)
+  { /* ... */ }
+  OutputWriter *q_ptr;
+  Q_DECLARE_PUBLIC(OutputWriter)
+
+  // guards everything below
+  QMutex mutex;
+  QWaitCondition wakeUp;
+  bool work;
+  bool stopping;
+  QList<OutputStream*> streams;
+  OutputWriter::SyncPolicy syncPolicy;
+  int syncIntervalMs;
+  qint64 rotationBytes;
+  int rotationSeconds;
+  int pageSize;
+  int flushIntervalMs;
+
+  // Snapshot of the settings for one pass of the writer thread
+  struct Config {
+    OutputWriter::SyncPolicy syncPolicy;
+    qint64 rotationBytes;
+    int rotationSeconds;
+    int flushIntervalMs;
+    bool rotating(void) const
+    {
+      return rotationBytes > 0 || rotationSeconds > 0;
+    }
+  };
+
+  bool service(OutputStream *, const Config &, bool drain);
+  bool writePage(OutputStreamPrivate *, const char *data, int len, const Config &);
+  bool openFile(OutputStreamPrivate *, const Config &);
+  void closeFile(OutputStreamPrivate *, const Config &);
+};
+
+
+// Writes the stream's pending pages. Returns true if the stream has
+// been closed and must be removed.
+bool OutputWriterPrivate::service(OutputStream *stream, const Config &config, bool drain)
+{
+  OutputStreamPrivate *s = stream->d_func();
+  bool closing = false;
+  forever {
+    const char *data = Q_NULLPTR;
+    int len = 0;
+    int back = 0;
+    {
+      QMutexLocker lock(&s->mutex);
+      closing = drain || s->closeRequested;
+      const int frontFill = s->fill[s->front];
+      if (!s->backPending && frontFill > 0 &&
+          (closing || s->flushRequested || frontFill == s->pageSize || s->frontAge.elapsed() >= config.flushIntervalMs)) {
+        s->handOver();
+      }
+      s->flushRequested = false;
+      if (!s->backPending)
+        break;
+      back = 1 - s->front;
+      data = s->page[back].constData();
+      len = s->fill[back];
+    }
+    const bool ok = writePage(s, data, len, config);
+    QMutexLocker lock(&s->mutex);
+    s->fill[back] = 0;
+    s->backPending = false;
+    if (ok) {
+      s->bytesWritten += len;
+    }
+    else {
+      s->droppedBytes += len;
+    }
+  }
+  if (closing) {
+    closeFile(s, config);
+  }
+  return closing;
+}
+
+
+bool OutputWriterPrivate::writePage(OutputStreamPrivate *s, const char *data, int len, const Config &config)
+{
+  Q_Q(OutputWriter);
+  if (s->file.isOpen()) {
+    const bool full = config.rotationBytes > 0 && s->fileBytes >= config.rotationBytes;
+    const bool old = config.rotationSeconds > 0 && s->fileAge.elapsed() >= 1000 * qint64(config.rotationSeconds);
+    if (full || old) {
+      closeFile(s, config);
+    }
+  }
+  if (!s->file.isOpen() && !openFile(s, config))
+    return false;
+  if (s->file.write(data, len) != len) {
+    emit q->error(QObject::tr("Cannot write %1: %2").arg(s->file.fileName()).arg(s->file.errorString()));
+    return false;
+  }
+  s->fileBytes += len;
+  if (config.syncPolicy == OutputWriter::SyncEveryPage) {
+    syncFile(s->file);
+  }
+  return true;
+}
+
+
+bool OutputWriterPrivate::openFile(OutputStreamPrivate *s, const Config &config)
+{
+  Q_Q(OutputWriter);
+  // don't retry, and complain, for every page
+  if (s->failed)
+    return false;
+  const QFileInfo fi(s->fileName);
+  QDir().mkpath(fi.absolutePath());
+  QString fileName = s->fileName;
+  if (config.rotating()) {
+    const QString &stem = fi.absoluteDir().filePath(fi.completeBaseName() + "-" + QDateTime::currentDateTime().toString("yyyyMMdd-HHmmss"));
+    const QString &suffix = fi.suffix().isEmpty() ? QString() : "." + fi.suffix();
+    fileName = stem + suffix;
+    for (int i = 1; QFileInfo(fileName).exists(); ++i) {
+      fileName = QString("%1-%2%3").arg(stem).arg(i).arg(suffix);
+    }
+  }
+  s->file.setFileName(fileName);
+  if (!s->file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered)) {
+    s->failed = true;
+    emit q->error(QObject::tr("Cannot open %1: %2").arg(fileName).arg(s->file.errorString()));
+    return false;
+  }
+  s->fileBytes = 0;
+  s->fileAge.start();
+  if (!s->fileHeader.isEmpty()) {
+    s->file.write(s->fileHeader);
+    s->fileBytes += s->fileHeader.size();
+  }
+  return true;
+}
+
+
+void OutputWriterPrivate::closeFile(OutputStreamPrivate *s, const Config &config)
+{
+  if (!s->file.isOpen())
+    return;
+  if (config.syncPolicy != OutputWriter::SyncNever) {
+    syncFile(s->file);
+  }
+  s->file.close();
+}
+
+
+OutputWriter::OutputWriter(QObject *parent)
+  : QThread(parent)
+  , d_ptr(new OutputWriterPrivate(this))
+{
+  /* ... */
+}
+
+
+OutputWriter::~OutputWriter()
+{
+  Q_D(OutputWriter);
+  {
+    QMutexLocker lock(&d->mutex);
+    d->stopping = true;
+    d->wakeUp.wakeAll();
+  }
+  wait();
+  // the thread has written out and closed all of them
+  foreach (OutputStream *stream, d->streams) {
+    delete stream;
+  }
+}
+
+
+OutputStream *OutputWriter::open(const QString &fileName, const QByteArray &fileHeader)
+{
+  Q_D(OutputWriter);
+  OutputStream *stream;
+  {
+    QMutexLocker lock(&d->mutex);
+    stream = new OutputStream(this, fileName, fileHeader, d->pageSize);
+    d->streams.append(stream);
+  }
+  if (!isRunning()) {
+    start();
+  }
+  return stream;
+}
+
+
+void OutputWriter::close(OutputStream *stream)
+{
+  if (stream == Q_NULLPTR)
+    return;
+  {
+    QMutexLocker lock(&stream->d_ptr->mutex);
+    stream->d_ptr->closeRequested = true;
+  }
+  wake();
+}
+
+
+void OutputWriter::wake(void)
+{
+  Q_D(OutputWriter);
+  QMutexLocker lock(&d->mutex);
+  d->work = true;
+  d->wakeUp.wakeOne();
+}
+
+
+void OutputWriter::run(void)
+{
+  Q_D(OutputWriter);
+  QElapsedTimer syncTimer;
+  syncTimer.start();
+  forever {
+    QList<OutputStream*> streams;
+    OutputWriterPrivate::Config config;
+    bool stopping;
+    int syncIntervalMs;
+    {
+      QMutexLocker lock(&d->mutex);
+      if (!d->work && !d->stopping) {
+        d->wakeUp.wait(&d->mutex, ulong(qMax(1, d->flushIntervalMs)));
+      }
+      d->work = false;
+      stopping = d->stopping;
+      streams = d->streams;
+      config.syncPolicy = d->syncPolicy;
+      config.rotationBytes = d->rotationBytes;
+      config.rotationSeconds = d->rotationSeconds;
+      config.flushIntervalMs = d->flushIntervalMs;
+      syncIntervalMs = d->syncIntervalMs;
+    }
+    foreach (OutputStream *stream, streams) {
+      if (d->service(stream, config, stopping) && !stopping) {
+        QMutexLocker lock(&d->mutex);
+        d->streams.removeOne(stream);
+        delete stream;
+      }
+    }
+    if (stopping)
+      break;
+    if (config.syncPolicy == SyncPeriodically && syncTimer.elapsed() >= syncIntervalMs) {
+      // the closed streams have just been deleted; only this thread
+      // deletes streams, so the remaining ones stay valid
+      {
+        QMutexLocker lock(&d->mutex);
+        streams = d->streams;
+      }
+      foreach (OutputStream *stream, streams) {
+        QFile &file = stream->d_ptr->file;
+        if (file.isOpen()) {
+          syncFile(file);
+        }
+      }
+      syncTimer.restart();
+    }
+  }
+}
+
+
+void OutputWriter::setSyncPolicy(SyncPolicy policy, int intervalMs)
+{
+  Q_D(OutputWriter);
+  QMutexLocker lock(&d->mutex);
+  d->syncPolicy = policy;
+  d->syncIntervalMs = intervalMs;
+}
+
+
+OutputWriter::SyncPolicy OutputWriter::syncPolicy(void) const
+{
+  QMutexLocker lock(&d_ptr->mutex);
+  return d_ptr->syncPolicy;
+}
+
+
+int OutputWriter::syncIntervalMs(void) const
+{
+  QMutexLocker lock(&d_ptr->mutex);
+  return d_ptr->syncIntervalMs;
+}
+
+
+void OutputWriter::setRotation(qint64 maxBytes, int maxSeconds)
+{
+  Q_D(OutputWriter);
+  QMutexLocker lock(&d->mutex);
+  d->rotationBytes = maxBytes;
+  d->rotationSeconds = maxSeconds;
+}
+
+
+qint64 OutputWriter::rotationBytes(void) const
+{
+  QMutexLocker lock(&d_ptr->mutex);
+  return d_ptr->rotationBytes;
+}
+
+
+int OutputWriter::rotationSeconds(void) const
+{
+  QMutexLocker lock(&d_ptr->mutex);
+  return d_ptr->rotationSeconds;
+}
+
+
+void OutputWriter::setPageSize(int bytes)
+{
+  Q_D(OutputWriter);
+  QMutexLocker lock(&d->mutex);
+  d->pageSize = qMax(4096, bytes);
+}
+
+
+int OutputWriter::pageSize(void) const
+{
+  QMutexLocker lock(&d_ptr->mutex);
+  return d_ptr->pageSize;
+}
+
+
+void OutputWriter::setFlushIntervalMs(int ms)
+{
+  Q_D(OutputWriter);
+  QMutexLocker lock(&d->mutex);
+  d->flushIntervalMs = ms;
+}
+
+
+int OutputWriter::flushIntervalMs(void) const
+{
+  QMutexLocker lock(&d_ptr->mutex);
+  return d_ptr->flushIntervalMs;
+}
+
+
+OutputWriter::SyncPolicy OutputWriter::syncPolicyFromString(const QString &policy)
+{
+  if (policy == "never")
+    return SyncNever;
+  if (policy == "page")
+    return SyncEveryPage;
+  if (policy == "periodic")
+    return SyncPeriodically;
+  return SyncOnClose;
+}
+
+
+QString OutputWriter::syncPolicyToString(SyncPolicy policy)
+{
+  switch (policy) {
+  case SyncNever:
+    return "never";
+  case SyncEveryPage:
+    return "page";
+  case SyncPeriodically:
+    return "periodic";
+  default:
+    break;
+  }
+  return "close";
+}
@@ -0,0 +1,139 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef __OUTPUTWRITER_H_
+#define __OUTPUTWRITER_H_
+
+#include <QThread>
+#include <QString>
+#include <QByteArray>
+#include <QScopedPointer>
+
+class OutputWriter;
+class OutputStreamPrivate;
+class OutputWriterPrivate;
+
+
+// Producer side of a file written by an OutputWriter. write() copies
+// into the current page and returns; it never waits for the disk.
+// When a page is full it is swapped with the second page, which the
+// writer thread then writes out. If the writer hasn't finished with
+// the second page yet, i.e. the disk stalls for longer than it takes
+// to fill a page, incoming data is dropped and counted rather than
+// blocking the caller.
+//
+// A write() that fits into a page is never split, so rotation can't
+// cut a record (an audio buffer, an event log block) in two.
+//
+// Use from one producer thread at a time.
+class OutputStream
+{
+public:
+  void write(const char *data, qint64 len);
+  void write(const QByteArray &);
+  // Hands the current page to the writer thread even if it isn't full
+  void flush(void);
+
+  QString fileName(void) const;
+  qint64 bytesWritten(void) const;
+  qint64 droppedBytes(void) const;
+
+private:
+  friend class OutputWriter;
+  friend class OutputWriterPrivate;
+  OutputStream(OutputWriter *writer, const QString &fileName, const QByteArray &fileHeader, int pageSize);
+  ~OutputStream();
+
+  QScopedPointer<OutputStreamPrivate> d_ptr;
+  Q_DECLARE_PRIVATE(OutputStream)
+  Q_DISABLE_COPY(OutputStream)
+};
+
+
+// Writes any number of output files on a thread of its own, so that
+// disk I/O never blocks capture, detection or the GUI.
+//
+// Files are created when their first page is written. With rotation
+// enabled, each file gets the time it was started appended to its
+// base name (random-numbers-20150612-143000.bin) and is replaced by a
+// new one when it exceeds the size or age limit; the file header
+// given to open() is repeated at the start of every file.
+class OutputWriter : public QThread
+{
+  Q_OBJECT
+
+public:
+  enum SyncPolicy {
+    SyncNever,
+    // when a file is closed or rotated
+    SyncOnClose,
+    // after every page
+    SyncEveryPage,
+    // every syncIntervalMs() milliseconds
+    SyncPeriodically
+  };
+
+  explicit OutputWriter(QObject *parent = Q_NULLPTR);
+  // Writes out everything pending and closes all files
+  ~OutputWriter();
+
+  // The stream stays valid until it's passed to close() or the
+  // writer is destroyed. Starts the thread if necessary.
+  OutputStream *open(const QString &fileName, const QByteArray &fileHeader = QByteArray());
+  // Writes out the stream's pending pages, closes its file and
+  // deletes it; doesn't wait for that to happen.
+  void close(OutputStream *);
+
+  void setSyncPolicy(SyncPolicy, int intervalMs = 1000);
+  SyncPolicy syncPolicy(void) const;
+  int syncIntervalMs(void) const;
+  // 0 disables the respective limit
+  void setRotation(qint64 maxBytes, int maxSeconds);
+  qint64 rotationBytes(void) const;
+  int rotationSeconds(void) const;
+  // Affects streams opened afterwards
+  void setPageSize(int bytes);
+  int pageSize(void) const;
+  // Partially filled pages are written after at most this long
+  void setFlushIntervalMs(int);
+  int flushIntervalMs(void) const;
+
+  static SyncPolicy syncPolicyFromString(const QString &);
+  static QString syncPolicyToString(SyncPolicy);
+
+  static const int DefaultPageSize;
+
+signals:
+  // Emitted from the writer thread
+  void error(const QString &);
+
+protected:
+  void run(void);
+
+private:
+  friend class OutputStream;
+  void wake(void);
+
+  QScopedPointer<OutputWriterPrivate> d_ptr;
+  Q_DECLARE_PRIVATE(OutputWriter)
+  Q_DISABLE_COPY(OutputWriter)
+};
+
+#endif // __OUTPUTWRITER_H_
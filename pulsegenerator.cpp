@@ -0,0 +1,454 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "pulsegenerator.h"
+#include "replaysource.h"
+#include "audioinputdevice.h"
+
+#include <QDebug>
+#include <QVector>
+#include <QElapsedTimer>
+#include <QtEndian>
+#include <qmath.h>
+#include <random>
+#include <limits>
+
+
+static const int MaxChunkFrames = 4096;
+// pulses are cut off when they have decayed to this fraction
+static const qreal PulseCutOff = 1e-4;
+
+
+class PulseGeneratorPrivate {
+public:
+  PulseGeneratorPrivate(const QAudioFormat &format)
+    : format(format)
+    , rate(100.0)
+    , amplitude(0.8)
+    , riseTimeUs(20.0)
+    , decayTimeUs(150.0)
+    , deadTimeNs(100 * 1000)
+    , noiseLevel(0.005)
+    , humAmplitude(0.0)
+    , humFrequency(50.0)
+    , seed(0)
+    , frame(0)
+    , pulses(0)
+    , mask(0)
+    , noise(0.0, 1.0)
+  { /* ... */ }
+  const QAudioFormat format;
+  qreal rate;
+  qreal amplitude;
+  qreal riseTimeUs;
+  qreal decayTimeUs;
+  qint64 deadTimeNs;
+  qreal noiseLevel;
+  qreal humAmplitude;
+  qreal humFrequency;
+  quint64 seed;
+
+  qint64 frame;
+  qint64 pulses;
+  // per channel, in frames, fractional
+  QVector<qreal> nextArrival;
+  QVector<float> kernel;
+  // pulses that have been placed but not yet output, indexed by
+  // (absolute frame & mask) * channels + channel
+  QVector<float> overlay;
+  int mask;
+  QVector<float> chunk;
+  std::mt19937_64 rng;
+  std::normal_distribution<qreal> noise;
+
+  void init(void);
+  void scheduleNext(int channel, bool afterPulse);
+  void generate(float *dst, int frames);
+  void encode(const float *src, int frames, char *dst) const;
+};
+
+
+void PulseGeneratorPrivate::init(void)
+{
+  const qreal sampleRate = format.sampleRate();
+  const qreal tr = qMax(1e-3, riseTimeUs) * 1e-6 * sampleRate;
+  const qreal td = qMax(riseTimeUs + 1e-3, decayTimeUs) * 1e-6 * sampleRate;
+  // exp(-t/td) - exp(-t/tr), normalised to a peak of 1
+  const qreal tPeak = tr * td / (td - tr) * qLn(td / tr);
+  const qreal peak = qExp(-tPeak / td) - qExp(-tPeak / tr);
+  const int length = qMax(1, qCeil(-td * qLn(PulseCutOff)));
+  kernel.resize(length);
+  for (int i = 0; i < length; ++i) {
+    kernel[i] = float(amplitude * (qExp(-i / td) - qExp(-i / tr)) / peak);
+  }
+  int size = 1;
+  while (size < MaxChunkFrames + length + 1) {
+    size <<= 1;
+  }
+  const int channels = format.channelCount();
+  overlay.fill(0.f, size * channels);
+  mask = size - 1;
+  chunk.resize(MaxChunkFrames * channels);
+  rng.seed(seed);
+  noise.reset();
+  frame = 0;
+  pulses = 0;
+  nextArrival.fill(0.0, channels);
+  for (int c = 0; c < channels; ++c) {
+    scheduleNext(c, false);
+  }
+}
+
+
+// Thanks to the memorylessness of the exponential distribution, the
+// first decay after the dead time is simply the end of the dead time
+// plus an exponentially distributed waiting time.
+void PulseGeneratorPrivate::scheduleNext(int channel, bool afterPulse)
+{
+  if (rate <= 0.0) {
+    nextArrival[channel] = std::numeric_limits<qreal>::max();
+    return;
+  }
+  std::exponential_distribution<qreal> wait(rate);
+  const qreal deadFrames = afterPulse ? 1e-9 * deadTimeNs * format.sampleRate() : 0.0;
+  nextArrival[channel] += deadFrames + wait(rng) * format.sampleRate();
+}
+
+
+void PulseGeneratorPrivate::generate(float *dst, int frames)
+{
+  const qint64 end = frame + frames;
+  const int channels = format.channelCount();
+  const int length = kernel.size();
+  const float *k = kernel.constData();
+  float *o = overlay.data();
+  for (int c = 0; c < channels; ++c) {
+    while (nextArrival.at(c) < end) {
+      const qint64 start = qint64(nextArrival.at(c));
+      for (int i = 0; i < length; ++i) {
+        o[((start + i) & mask) * channels + c] += k[i];
+      }
+      ++pulses;
+      scheduleNext(c, true);
+    }
+  }
+  const qreal humOmega = 2 * M_PI * humFrequency / format.sampleRate();
+  for (int i = 0; i < frames; ++i) {
+    float *pulse = o + ((frame + i) & mask) * channels;
+    const qreal hum = humAmplitude * qSin(humOmega * (frame + i));
+    for (int c = 0; c < channels; ++c) {
+      *dst++ = float(pulse[c] + hum + noiseLevel * noise(rng));
+      pulse[c] = 0.f;
+    }
+  }
+  frame = end;
+}
+
+
+template <typename T>
+static inline T toInt(float x, qreal scale, qreal offset)
+{
+  return T(qRound(qBound(-1.f, x, 1.f) * scale + offset));
+}
+
+
+void PulseGeneratorPrivate::encode(const float *src, int frames, char *dst) const
+{
+  const int n = frames * format.channelCount();
+  const bool le = format.byteOrder() == QAudioFormat::LittleEndian;
+  uchar *p = reinterpret_cast<uchar*>(dst);
+  switch (format.sampleType()) {
+  case QAudioFormat::Float:
+    for (int i = 0; i < n; ++i) {
+      float x = qBound(-1.f, src[i], 1.f);
+      quint32 bits;
+      memcpy(&bits, &x, sizeof(bits));
+      le ? qToLittleEndian<quint32>(bits, p + 4 * i) : qToBigEndian<quint32>(bits, p + 4 * i);
+    }
+    break;
+  case QAudioFormat::UnSignedInt:
+    switch (format.sampleSize()) {
+    case 8:
+      for (int i = 0; i < n; ++i) {
+        p[i] = toInt<quint8>(src[i], 127.0, 128.0);
+      }
+      break;
+    case 16:
+      for (int i = 0; i < n; ++i) {
+        const quint16 v = toInt<quint16>(src[i], 32767.0, 32768.0);
+        le ? qToLittleEndian<quint16>(v, p + 2 * i) : qToBigEndian<quint16>(v, p + 2 * i);
+      }
+      break;
+    default:
+      for (int i = 0; i < n; ++i) {
+        const quint32 v = toInt<quint32>(src[i], 2147483520.0, 2147483648.0);
+        le ? qToLittleEndian<quint32>(v, p + 4 * i) : qToBigEndian<quint32>(v, p + 4 * i);
+      }
+      break;
+    }
+    break;
+  default:
+    switch (format.sampleSize()) {
+    case 8:
+      for (int i = 0; i < n; ++i) {
+        p[i] = uchar(toInt<qint8>(src[i], 127.0, 0.0));
+      }
+      break;
+    case 16:
+      for (int i = 0; i < n; ++i) {
+        const qint16 v = toInt<qint16>(src[i], 32767.0, 0.0);
+        le ? qToLittleEndian<qint16>(v, p + 2 * i) : qToBigEndian<qint16>(v, p + 2 * i);
+      }
+      break;
+    default:
+      for (int i = 0; i < n; ++i) {
+        const qint32 v = toInt<qint32>(src[i], 2147483520.0, 0.0);
+        le ? qToLittleEndian<qint32>(v, p + 4 * i) : qToBigEndian<qint32>(v, p + 4 * i);
+      }
+      break;
+    }
+    break;
+  }
+}
+
+
+PulseGenerator::PulseGenerator(const QAudioFormat &format, QObject *parent)
+  : QIODevice(parent)
+  , d_ptr(new PulseGeneratorPrivate(format))
+{
+  /* ... */
+}
+
+
+PulseGenerator::~PulseGenerator()
+{
+  /* ... */
+}
+
+
+const QAudioFormat &PulseGenerator::format(void) const
+{
+  return d_ptr->format;
+}
+
+
+void PulseGenerator::setRate(qreal countsPerSecond)
+{
+  Q_D(PulseGenerator);
+  d->rate = countsPerSecond;
+}
+
+
+qreal PulseGenerator::rate(void) const
+{
+  return d_ptr->rate;
+}
+
+
+void PulseGenerator::setAmplitude(qreal amplitude)
+{
+  Q_D(PulseGenerator);
+  d->amplitude = amplitude;
+}
+
+
+qreal PulseGenerator::amplitude(void) const
+{
+  return d_ptr->amplitude;
+}
+
+
+void PulseGenerator::setRiseTimeUs(qreal riseTimeUs)
+{
+  Q_D(PulseGenerator);
+  d->riseTimeUs = riseTimeUs;
+}
+
+
+qreal PulseGenerator::riseTimeUs(void) const
+{
+  return d_ptr->riseTimeUs;
+}
+
+
+void PulseGenerator::setDecayTimeUs(qreal decayTimeUs)
+{
+  Q_D(PulseGenerator);
+  d->decayTimeUs = decayTimeUs;
+}
+
+
+qreal PulseGenerator::decayTimeUs(void) const
+{
+  return d_ptr->decayTimeUs;
+}
+
+
+void PulseGenerator::setDeadTimeNs(qint64 deadTimeNs)
+{
+  Q_D(PulseGenerator);
+  d->deadTimeNs = deadTimeNs;
+}
+
+
+qint64 PulseGenerator::deadTimeNs(void) const
+{
+  return d_ptr->deadTimeNs;
+}
+
+
+void PulseGenerator::setNoiseLevel(qreal noiseLevel)
+{
+  Q_D(PulseGenerator);
+  d->noiseLevel = noiseLevel;
+}
+
+
+qreal PulseGenerator::noiseLevel(void) const
+{
+  return d_ptr->noiseLevel;
+}
+
+
+void PulseGenerator::setHum(qreal amplitude, qreal frequency)
+{
+  Q_D(PulseGenerator);
+  d->humAmplitude = amplitude;
+  d->humFrequency = frequency;
+}
+
+
+qreal PulseGenerator::humAmplitude(void) const
+{
+  return d_ptr->humAmplitude;
+}
+
+
+qreal PulseGenerator::humFrequency(void) const
+{
+  return d_ptr->humFrequency;
+}
+
+
+void PulseGenerator::setSeed(quint64 seed)
+{
+  Q_D(PulseGenerator);
+  d->seed = seed;
+}
+
+
+quint64 PulseGenerator::seed(void) const
+{
+  return d_ptr->seed;
+}
+
+
+qint64 PulseGenerator::framePosition(void) const
+{
+  return d_ptr->frame;
+}
+
+
+qint64 PulseGenerator::pulseCount(void) const
+{
+  return d_ptr->pulses;
+}
+
+
+ReplayStats PulseGenerator::run(AudioInputDevice *device, qint64 frames)
+{
+  Q_D(PulseGenerator);
+  ReplayStats stats;
+  stats.sampleRate = d->format.sampleRate();
+  if (device == Q_NULLPTR)
+    return stats;
+  if (!isOpen() && !open(QIODevice::ReadOnly))
+    return stats;
+  if (!device->isOpen()) {
+    device->start();
+  }
+  const qint64 clicksBefore = device->clickCount();
+  const int frameBytes = d->format.bytesPerFrame();
+  QByteArray buffer(MaxChunkFrames * frameBytes, Qt::Uninitialized);
+  QElapsedTimer t;
+  t.start();
+  qint64 remaining = frames;
+  while (remaining > 0) {
+    const qint64 n = qMin<qint64>(remaining, MaxChunkFrames);
+    const qint64 bytes = read(buffer.data(), n * frameBytes);
+    if (bytes <= 0)
+      break;
+    device->write(buffer.constData(), bytes);
+    remaining -= n;
+  }
+  stats.wallSeconds = 1e-9 * t.nsecsElapsed();
+  stats.frames = frames - remaining;
+  stats.clicks = device->clickCount() - clicksBefore;
+  return stats;
+}
+
+
+bool PulseGenerator::open(OpenMode mode)
+{
+  Q_D(PulseGenerator);
+  if (mode & QIODevice::WriteOnly)
+    return false;
+  d->init();
+  return QIODevice::open(mode | QIODevice::Unbuffered);
+}
+
+
+bool PulseGenerator::isSequential(void) const
+{
+  return true;
+}
+
+
+qint64 PulseGenerator::bytesAvailable(void) const
+{
+  // never runs dry
+  return std::numeric_limits<int>::max() + QIODevice::bytesAvailable();
+}
+
+
+qint64 PulseGenerator::readData(char *data, qint64 maxlen)
+{
+  Q_D(PulseGenerator);
+  const int frameBytes = d->format.bytesPerFrame();
+  if (frameBytes <= 0)
+    return -1;
+  qint64 frames = maxlen / frameBytes;
+  qint64 written = 0;
+  while (frames > 0) {
+    const int n = int(qMin<qint64>(frames, MaxChunkFrames));
+    d->generate(d->chunk.data(), n);
+    d->encode(d->chunk.constData(), n, data + written);
+    written += n * frameBytes;
+    frames -= n;
+  }
+  return written;
+}
+
+
+qint64 PulseGenerator::writeData(const char *data, qint64 len)
+{
+  Q_UNUSED(data)
+  Q_UNUSED(len)
+  return -1;
+}
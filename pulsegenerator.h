@@ -0,0 +1,99 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef __PULSEGENERATOR_H_
+#define __PULSEGENERATOR_H_
+
+#include <QIODevice>
+#include <QAudioFormat>
+#include <QScopedPointer>
+
+class AudioInputDevice;
+class PulseGeneratorPrivate;
+struct ReplayStats;
+
+// Endless stream of synthetic Geiger counter pulses in a given
+// QAudioFormat, for testing without a tube or a sound card.
+//
+// Decays arrive as a Poisson process with rate() counts per second.
+// The counter is non-paralyzable: decays within deadTimeNs() after a
+// registered pulse are lost, so the registered rate is
+// rate / (1 + rate * deadTime). Each registered pulse has a
+// double-exponential shape, rising with riseTimeUs() and decaying
+// with decayTimeUs(). Gaussian noise and mains hum are added on top.
+// Every channel is a counter of its own, with pulses independent of
+// the other channels' but the same hum.
+//
+// The output is fully determined by the seed and the parameters.
+// Set all parameters before open().
+class PulseGenerator : public QIODevice
+{
+  Q_OBJECT
+
+public:
+  PulseGenerator(const QAudioFormat &format, QObject *parent = Q_NULLPTR);
+  ~PulseGenerator();
+
+  const QAudioFormat &format(void) const;
+
+  void setRate(qreal countsPerSecond);
+  qreal rate(void) const;
+  // Peak amplitude relative to full scale; negative values invert
+  // the pulses.
+  void setAmplitude(qreal);
+  qreal amplitude(void) const;
+  void setRiseTimeUs(qreal);
+  qreal riseTimeUs(void) const;
+  void setDecayTimeUs(qreal);
+  qreal decayTimeUs(void) const;
+  void setDeadTimeNs(qint64);
+  qint64 deadTimeNs(void) const;
+  // Standard deviation of the noise, relative to full scale
+  void setNoiseLevel(qreal);
+  qreal noiseLevel(void) const;
+  void setHum(qreal amplitude, qreal frequency = 50.0);
+  qreal humAmplitude(void) const;
+  qreal humFrequency(void) const;
+  void setSeed(quint64);
+  quint64 seed(void) const;
+
+  // Frames and registered pulses (on all channels) generated so far
+  qint64 framePosition(void) const;
+  qint64 pulseCount(void) const;
+
+  // Writes `frames` frames into `device` as fast as the pipeline takes
+  // them, like ReplaySource::run(). Opens the generator if necessary.
+  ReplayStats run(AudioInputDevice *device, qint64 frames);
+
+  bool open(OpenMode mode);
+  bool isSequential(void) const;
+  qint64 bytesAvailable(void) const;
+
+protected:
+  qint64 readData(char *data, qint64 maxlen);
+  qint64 writeData(const char *data, qint64 len);
+
+private:
+  QScopedPointer<PulseGeneratorPrivate> d_ptr;
+  Q_DECLARE_PRIVATE(PulseGenerator)
+  Q_DISABLE_COPY(PulseGenerator)
+};
+
+#endif // __PULSEGENERATOR_H_
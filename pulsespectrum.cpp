@@ -0,0 +1,79 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "pulsespectrum.h"
+
+
+PulseSpectrum::PulseSpectrum(void)
+{
+  setRanges(Bins, Bins, Bins);
+}
+
+
+void PulseSpectrum::setRanges(int maxHeight, int maxWidth, qint64 maxArea)
+{
+  mRange[Height] = qMax(1, maxHeight);
+  mRange[Width] = qMax(1, maxWidth);
+  mRange[Area] = qMax(qint64(1), maxArea);
+  clear();
+}
+
+
+qint64 PulseSpectrum::range(Quantity quantity) const
+{
+  return mRange[quantity];
+}
+
+
+qreal PulseSpectrum::binStart(Quantity quantity, int bin) const
+{
+  return qreal(bin) * mRange[quantity] / Bins;
+}
+
+
+void PulseSpectrum::clear(void)
+{
+  for (int q = 0; q < QuantityCount; ++q) {
+    for (int bin = 0; bin < Bins; ++bin) {
+      mCounts[q][bin].store(0, std::memory_order_relaxed);
+    }
+  }
+  mPulseCount.store(0, std::memory_order_relaxed);
+}
+
+
+quint32 PulseSpectrum::count(Quantity quantity, int bin) const
+{
+  return mCounts[quantity][bin].load(std::memory_order_relaxed);
+}
+
+
+void PulseSpectrum::counts(Quantity quantity, quint32 *dst) const
+{
+  for (int bin = 0; bin < Bins; ++bin) {
+    dst[bin] = mCounts[quantity][bin].load(std::memory_order_relaxed);
+  }
+}
+
+
+qint64 PulseSpectrum::pulseCount(void) const
+{
+  return mPulseCount.load(std::memory_order_relaxed);
+}
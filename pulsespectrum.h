@@ -0,0 +1,86 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef __PULSESPECTRUM_H_
+#define __PULSESPECTRUM_H_
+
+#include <QtGlobal>
+#include <atomic>
+
+
+// Pulse-height spectrum, as a multichannel analyzer records it:
+// histograms of the peak height, the width and the area of the pulses
+// a ClickDetector measured. The bins are allocated along with the
+// spectrum and counted atomically, so that the capture thread can add
+// pulses without allocating or locking while e.g. the GUI reads them.
+class PulseSpectrum
+{
+public:
+  enum Quantity {
+    Height,
+    Width,
+    Area,
+    QuantityCount
+  };
+
+  static const int Bins = 256;
+
+  PulseSpectrum(void);
+
+  // Exclusive upper ends of the ranges the bins cover; larger values
+  // are counted in the last bin. Heights are in sample units, widths
+  // in frames and areas in sample units times frames. Clears the
+  // spectrum, so don't call it while pulses are being added.
+  void setRanges(int maxHeight, int maxWidth, qint64 maxArea);
+  qint64 range(Quantity) const;
+  // Lower end of `bin`
+  qreal binStart(Quantity, int bin) const;
+
+  // Producer only
+  inline void addPulse(int height, int width, qint64 area)
+  {
+    add(Height, height);
+    add(Width, width);
+    add(Area, area);
+    mPulseCount.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Any thread
+  void clear(void);
+  quint32 count(Quantity, int bin) const;
+  // Copies the Bins counts of `quantity` to `dst`
+  void counts(Quantity, quint32 *dst) const;
+  qint64 pulseCount(void) const;
+
+private:
+  inline void add(Quantity quantity, qint64 value)
+  {
+    const qint64 bin = value * Bins / mRange[quantity];
+    mCounts[quantity][qBound(qint64(0), bin, qint64(Bins - 1))].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  qint64 mRange[QuantityCount];
+  std::atomic<quint32> mCounts[QuantityCount][Bins];
+  std::atomic<qint64> mPulseCount;
+
+  Q_DISABLE_COPY(PulseSpectrum)
+};
+
+#endif // __PULSESPECTRUM_H_
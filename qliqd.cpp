@@ -0,0 +1,352 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "entropyengine.h"
+#include "audioinputdevice.h"
+#include "clickdetector.h"
+#include "replaysource.h"
+#include "pulsegenerator.h"
+#include "pulsespectrum.h"
+#include "intervalstatistics.h"
+#include "global.h"
+#include <QDebug>
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QSettings>
+#include <QDateTime>
+#include <QTextStream>
+#include <QScopedPointer>
+#include <QAudioFormat>
+#include <QFile>
+#include <QTimer>
+#include <cstdlib>
+
+#ifdef Q_OS_UNIX
+#include <QSocketNotifier>
+#include <sys/socket.h>
+#include <signal.h>
+#include <unistd.h>
+
+// SIGINT and SIGTERM are turned into a write to a socket pair, which
+// the event loop picks up, because hardly anything is allowed inside
+// a signal handler.
+static int gSignalFd[2];
+
+static void onUnixSignal(int)
+{
+  char c = 1;
+  ssize_t rc = ::write(gSignalFd[0], &c, sizeof(c));
+  Q_UNUSED(rc)
+}
+
+static void installSignalHandlers(QCoreApplication &app)
+{
+  if (::socketpair(AF_UNIX, SOCK_STREAM, 0, gSignalFd) != 0)
+    return;
+  QSocketNotifier *notifier = new QSocketNotifier(gSignalFd[1], QSocketNotifier::Read, &app);
+  QObject::connect(notifier, SIGNAL(activated(int)), &app, SLOT(quit()));
+  struct sigaction sa;
+  sa.sa_handler = onUnixSignal;
+  sigemptyset(&sa.sa_mask);
+  sa.sa_flags = SA_RESTART;
+  sigaction(SIGINT, &sa, Q_NULLPTR);
+  sigaction(SIGTERM, &sa, Q_NULLPTR);
+}
+#endif
+
+
+// One line per channel and bin, with the lower end of the bin and the
+// number of pulses in it for each quantity
+static bool writePulseSpectra(const EntropyEngine &engine, const QString &fileName)
+{
+  QFile file(fileName);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+    return false;
+  QTextStream out(&file);
+  out << "channel,bin,height,pulses_by_height,width_frames,pulses_by_width,area,pulses_by_area" << endl;
+  for (int c = 0; c < engine.channelCount(); ++c) {
+    const PulseSpectrum *spectrum = engine.clickDetector(c)->pulseSpectrum();
+    for (int bin = 0; bin < PulseSpectrum::Bins; ++bin) {
+      out << c << ',' << bin;
+      for (int q = 0; q < PulseSpectrum::QuantityCount; ++q) {
+        const PulseSpectrum::Quantity quantity = PulseSpectrum::Quantity(q);
+        out << ',' << spectrum->binStart(quantity, bin) << ',' << spectrum->count(quantity, bin);
+      }
+      out << endl;
+    }
+  }
+  return out.status() == QTextStream::Ok;
+}
+
+
+static QString intervalStatisticsSummary(const EntropyEngine &engine, int channel)
+{
+  return QObject::tr("Channel %1: %2")
+      .arg(channel + 1)
+      .arg(engine.intervalStatistics(channel)->summary(engine.audioFormat().sampleRate()));
+}
+
+
+int main(int argc, char *argv[])
+{
+  checkPortable();
+
+  QCoreApplication a(argc, argv);
+  a.setOrganizationName(AppCompanyName);
+  a.setOrganizationDomain(AppCompanyDomain);
+  a.setApplicationName(AppName);
+  a.setApplicationVersion(AppVersion);
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription(QObject::tr("Collects random bits from a Geiger counter without a user interface. "
+                                               "Reads the same settings as the GUI."));
+  parser.addHelpOption();
+  parser.addVersionOption();
+  QCommandLineOption quietOption(QStringList() << "q" << "quiet", QObject::tr("Don't log to stdout."));
+  parser.addOption(quietOption);
+  QCommandLineOption egdOption(QStringList() << "e" << "egd",
+                               QObject::tr("Serve random bytes via the EGD protocol on <socket> "
+                                           "(default: the server/socket setting)."),
+                               QObject::tr("socket"));
+  parser.addOption(egdOption);
+  QCommandLineOption noServerOption("no-server", QObject::tr("Don't start the EGD server."));
+  parser.addOption(noServerOption);
+  QCommandLineOption deviceOption("device",
+                                  QObject::tr("Capture from the audio input <name>. Repeat to capture from several "
+                                              "sound cards at once (default: the audio/devices setting, or the "
+                                              "default input)."),
+                                  QObject::tr("name"));
+  parser.addOption(deviceOption);
+  QCommandLineOption listDevicesOption("list-devices", QObject::tr("List the audio inputs, then exit."));
+  parser.addOption(listDevicesOption);
+  QCommandLineOption replayOption("replay",
+                                  QObject::tr("Push a WAV or raw recording through the pipeline as fast as possible "
+                                              "instead of capturing, then exit."),
+                                  QObject::tr("file"));
+  parser.addOption(replayOption);
+  QCommandLineOption simulateOption("simulate",
+                                    QObject::tr("Feed the pipeline with synthetic Geiger pulses arriving at <rate> "
+                                                "counts per second instead of capturing."),
+                                    QObject::tr("rate"));
+  parser.addOption(simulateOption);
+  QCommandLineOption durationOption("duration",
+                                    QObject::tr("Simulate <seconds> of audio as fast as possible, then exit "
+                                                "(default: run in real time until stopped)."),
+                                    QObject::tr("seconds"));
+  parser.addOption(durationOption);
+  QCommandLineOption seedOption("seed", QObject::tr("Seed of the simulation (default: 0)."), QObject::tr("n"), "0");
+  parser.addOption(seedOption);
+  QCommandLineOption deadTimeOption("dead-time-ns", QObject::tr("Dead time of the simulated counter (default: 100000)."),
+                                    QObject::tr("ns"), "100000");
+  parser.addOption(deadTimeOption);
+  QCommandLineOption amplitudeOption("amplitude", QObject::tr("Simulated pulse height relative to full scale (default: 0.8)."),
+                                     QObject::tr("fraction"), "0.8");
+  parser.addOption(amplitudeOption);
+  QCommandLineOption riseTimeOption("rise-time-us", QObject::tr("Rise time of the simulated pulses (default: 20)."),
+                                    QObject::tr("us"), "20");
+  parser.addOption(riseTimeOption);
+  QCommandLineOption decayTimeOption("decay-time-us", QObject::tr("Decay time of the simulated pulses (default: 150)."),
+                                     QObject::tr("us"), "150");
+  parser.addOption(decayTimeOption);
+  QCommandLineOption noiseOption("noise", QObject::tr("Standard deviation of the simulated noise relative to full scale (default: 0.005)."),
+                                 QObject::tr("fraction"), "0.005");
+  parser.addOption(noiseOption);
+  QCommandLineOption humOption("hum", QObject::tr("Amplitude of the simulated mains hum relative to full scale (default: 0)."),
+                               QObject::tr("fraction"), "0");
+  parser.addOption(humOption);
+  QCommandLineOption humFrequencyOption("hum-frequency", QObject::tr("Mains frequency (default: 50)."),
+                                        QObject::tr("Hz"), "50");
+  parser.addOption(humFrequencyOption);
+  QCommandLineOption sampleRateOption("sample-rate", QObject::tr("Sample rate to capture at, or of a raw recording or the simulation. "
+                                                                 "Higher rates give finer timestamps (default: 11025)."),
+                                      QObject::tr("Hz"), "11025");
+  parser.addOption(sampleRateOption);
+  QCommandLineOption channelsOption("channels", QObject::tr("Channels to capture, or of a raw recording or the simulation, "
+                                                            "each with a counter tube of its own (default: 1)."),
+                                    QObject::tr("n"), "1");
+  parser.addOption(channelsOption);
+  QCommandLineOption sampleSizeOption("sample-size", QObject::tr("Bits per sample of a raw recording or the simulation, "
+                                                                 "signed little endian (default: 16)."),
+                                      QObject::tr("bits"), "16");
+  parser.addOption(sampleSizeOption);
+  QCommandLineOption thresholdOption("threshold", QObject::tr("Override the click threshold of all channels."), QObject::tr("amplitude"));
+  parser.addOption(thresholdOption);
+  QCommandLineOption lockTimeOption("lock-time-ns", QObject::tr("Override the dead time after a click on all channels."), QObject::tr("ns"));
+  parser.addOption(lockTimeOption);
+  QCommandLineOption pulseSpectrumOption("pulse-spectrum", QObject::tr("Record the pulse-height spectrum of every channel "
+                                                                       "and write it to <file> as CSV on exit."),
+                                         QObject::tr("file"));
+  parser.addOption(pulseSpectrumOption);
+  QCommandLineOption statsIntervalOption("stats-interval", QObject::tr("Log the statistics of the intervals between clicks "
+                                                                       "of every channel every <seconds> (default: 0, never)."),
+                                         QObject::tr("seconds"), "0");
+  parser.addOption(statsIntervalOption);
+  parser.process(a);
+
+  if (parser.isSet(listDevicesOption)) {
+    QTextStream out(stdout);
+    foreach (const QString &name, EntropyEngine::availableInputDevices()) {
+      out << name << endl;
+    }
+    return EXIT_SUCCESS;
+  }
+
+  QAudioFormat rawFormat;
+  rawFormat.setCodec("audio/pcm");
+  rawFormat.setByteOrder(QAudioFormat::LittleEndian);
+  rawFormat.setSampleRate(parser.value(sampleRateOption).toInt());
+  rawFormat.setChannelCount(parser.value(channelsOption).toInt());
+  rawFormat.setSampleSize(parser.value(sampleSizeOption).toInt());
+  rawFormat.setSampleType(rawFormat.sampleSize() == 8 ? QAudioFormat::UnSignedInt : QAudioFormat::SignedInt);
+
+  QScopedPointer<ReplaySource> replay;
+  PulseGenerator *generator = Q_NULLPTR;
+  QAudioFormat format;
+  if (parser.isSet(replayOption)) {
+    replay.reset(new ReplaySource(parser.value(replayOption), rawFormat));
+    if (!replay->open()) {
+      QTextStream(stderr) << QObject::tr("Cannot replay %1: %2").arg(parser.value(replayOption)).arg(replay->errorString()) << endl;
+      return EXIT_FAILURE;
+    }
+    format = replay->format();
+  }
+  else if (parser.isSet(simulateOption)) {
+    format = rawFormat;
+    // owned by the application, unless startSimulation() hands it to
+    // the engine
+    generator = new PulseGenerator(format, &a);
+    generator->setRate(parser.value(simulateOption).toDouble());
+    generator->setSeed(parser.value(seedOption).toULongLong());
+    generator->setDeadTimeNs(parser.value(deadTimeOption).toLongLong());
+    generator->setAmplitude(parser.value(amplitudeOption).toDouble());
+    generator->setRiseTimeUs(parser.value(riseTimeOption).toDouble());
+    generator->setDecayTimeUs(parser.value(decayTimeOption).toDouble());
+    generator->setNoiseLevel(parser.value(noiseOption).toDouble());
+    generator->setHum(parser.value(humOption).toDouble(), parser.value(humFrequencyOption).toDouble());
+  }
+  else {
+    format.setChannelCount(rawFormat.channelCount());
+    format.setSampleRate(rawFormat.sampleRate());
+  }
+
+#ifdef Q_OS_UNIX
+  installSignalHandlers(a);
+#endif
+
+  QSettings settings(QSettings::IniFormat, QSettings::UserScope, AppCompanyName, AppName);
+  EntropyEngine engine(format);
+  if (!parser.isSet(quietOption)) {
+    QObject::connect(&engine, &EntropyEngine::message, [](const QString &msg) {
+      QTextStream out(stdout);
+      out << QString("[%1] %2").arg(QDateTime::currentDateTime().toString(Qt::ISODate)).arg(msg) << endl;
+    });
+  }
+  if (replay.isNull() && generator == Q_NULLPTR) {
+    engine.setInputDevices(parser.isSet(deviceOption)
+                           ? parser.values(deviceOption)
+                           : settings.value("audio/devices").toStringList());
+  }
+  engine.restoreSettings(settings);
+  for (int c = 0; c < engine.channelCount(); ++c) {
+    if (parser.isSet(thresholdOption)) {
+      engine.clickDetector(c)->setThreshold(parser.value(thresholdOption).toInt());
+    }
+    if (parser.isSet(lockTimeOption)) {
+      engine.clickDetector(c)->setLockTimeNs(parser.value(lockTimeOption).toLongLong());
+    }
+  }
+  if (parser.isSet(pulseSpectrumOption)) {
+    engine.setPulseAnalysis(true);
+  }
+
+  if (!replay.isNull() || (generator != Q_NULLPTR && parser.isSet(durationOption))) {
+    // never record the recording again
+    engine.setCaptureFile(QString());
+    engine.start();
+    ReplayStats stats;
+    if (generator != Q_NULLPTR) {
+      const qint64 frames = qint64(parser.value(durationOption).toDouble() * format.sampleRate());
+      stats = generator->run(engine.audioInputDevice(), frames);
+    }
+    else {
+      stats = replay->run(engine.audioInputDevice());
+    }
+    // deliver the results of the asynchronous entropy estimates
+    engine.waitForEstimates();
+    a.processEvents();
+    QTextStream out(stdout);
+    out << QObject::tr("%1 frames (%2 s of audio) in %3 s: %4 frames/s, %5x real time")
+           .arg(stats.frames).arg(stats.audioSeconds(), 0, 'f', 1)
+           .arg(stats.wallSeconds, 0, 'f', 3)
+           .arg(stats.framesPerSecond(), 0, 'f', 0)
+           .arg(stats.speedup(), 0, 'f', 0)
+        << endl
+        << QObject::tr("%1 clicks: %2 clicks/s processed, %3 clicks/s in the recording")
+           .arg(stats.clicks)
+           .arg(stats.clicksPerSecond(), 0, 'f', 0)
+           .arg(stats.audioSeconds() > 0.0 ? stats.clicks / stats.audioSeconds() : 0.0, 0, 'f', 2)
+        << endl;
+    if (generator != Q_NULLPTR) {
+      out << QObject::tr("%1 pulses generated, %2 detected")
+             .arg(generator->pulseCount())
+             .arg(stats.clicks)
+          << endl;
+    }
+    out << QObject::tr("%1 random bytes").arg(engine.byteCount())
+        << endl;
+    for (int c = 0; c < engine.channelCount(); ++c) {
+      out << intervalStatisticsSummary(engine, c) << endl;
+    }
+    if (parser.isSet(pulseSpectrumOption) && !writePulseSpectra(engine, parser.value(pulseSpectrumOption))) {
+      QTextStream(stderr) << QObject::tr("Cannot write %1.").arg(parser.value(pulseSpectrumOption)) << endl;
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+
+  if (!parser.isSet(noServerOption)) {
+    engine.startServer(parser.value(egdOption));
+  }
+  if (generator != Q_NULLPTR) {
+    engine.startSimulation(generator);
+  }
+  else {
+    engine.startCapture();
+  }
+  engine.start();
+
+  QTimer statsTimer;
+  const int statsIntervalS = parser.value(statsIntervalOption).toInt();
+  if (statsIntervalS > 0 && !parser.isSet(quietOption)) {
+    QObject::connect(&statsTimer, &QTimer::timeout, [&engine]() {
+      QTextStream out(stdout);
+      for (int c = 0; c < engine.channelCount(); ++c) {
+        out << QString("[%1] %2").arg(QDateTime::currentDateTime().toString(Qt::ISODate)).arg(intervalStatisticsSummary(engine, c)) << endl;
+      }
+    });
+    statsTimer.start(statsIntervalS * 1000);
+  }
+
+  const int rc = a.exec();
+  if (parser.isSet(pulseSpectrumOption) && !writePulseSpectra(engine, parser.value(pulseSpectrumOption))) {
+    QTextStream(stderr) << QObject::tr("Cannot write %1.").arg(parser.value(pulseSpectrumOption)) << endl;
+    return EXIT_FAILURE;
+  }
+  return rc;
+}
@@ -0,0 +1,537 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+// Offline counterpart of the extraction in EntropyEngine: reads dt
+// logs, runs them through a bit extractor and writes the random bytes
+// and the interval statistics.
+//
+// Event logs are memory-mapped and cut into chunks that the thread
+// pool extracts in parallel. Chunks are a multiple of the extractor's
+// period (see BitExtractor::period()) long, so the output is the same
+// as extracting the log in one go; it's written in log order while
+// later chunks are still being extracted.
+//
+// With --benchmark-extractors, the logs are run through every
+// extractor instead, to compare their yield and speed.
+
+#include "bitextractor.h"
+#include "eventlog.h"
+#include "intervalstatistics.h"
+#include "healthcheck.h"
+#include "global.h"
+#include <QDebug>
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QSettings>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QScopedPointer>
+#include <QQueue>
+#include <QThread>
+#include <QThreadPool>
+#include <QFuture>
+#include <QtConcurrent>
+#include <algorithm>
+#include <cstdlib>
+
+
+// Chunks are at least this many intervals long
+static const qint64 ChunkIntervals = 1 << 18;
+// Chunks in flight per thread
+static const int ChunksPerThread = 4;
+static const int OutputBufferBytes = 4 * 1024 * 1024;
+// The extractor benchmark holds the intervals in memory; longer logs
+// are cut short
+static const qint64 MaxBenchmarkIntervals = 1 << 24;
+
+
+// The intervals of one log, in frames. Event logs are decoded from
+// the mapped file, dt.txt files from older versions (one interval in
+// nanoseconds per line) are converted up front.
+class IntervalLog
+{
+public:
+  explicit IntervalLog(const QString &fileName)
+    : mFileName(fileName)
+    , mSampleRate(0)
+  { /* ... */ }
+
+  bool open(int defaultSampleRate)
+  {
+    if (EventLogReader::isEventLog(mFileName)) {
+      mReader.reset(new EventLogReader(mFileName));
+      if (!mReader->open()) {
+        mErrorString = mReader->errorString();
+        return false;
+      }
+      mSampleRate = mReader->header().sampleRate;
+      return true;
+    }
+    mSampleRate = defaultSampleRate;
+    return readText();
+  }
+
+  const QString &fileName(void) const { return mFileName; }
+  const QString &errorString(void) const { return mErrorString; }
+  int sampleRate(void) const { return mSampleRate; }
+  qint64 count(void) const
+  {
+    return mReader.isNull() ? mDtFrames.size() : mReader->eventCount();
+  }
+
+  // Thread-safe
+  qint64 read(qint64 first, qint64 *dtFrames, qint64 maxCount) const
+  {
+    if (!mReader.isNull())
+      return mReader->read(first, dtFrames, maxCount);
+    const qint64 n = qBound(Q_INT64_C(0), mDtFrames.size() - first, maxCount);
+    std::copy(mDtFrames.constBegin() + first, mDtFrames.constBegin() + first + n, dtFrames);
+    return n;
+  }
+
+private:
+  bool readText(void)
+  {
+    QFile file(mFileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+      mErrorString = file.errorString();
+      return false;
+    }
+    const qint64 size = file.size();
+    const uchar *data = (size > 0) ? file.map(0, size) : Q_NULLPTR;
+    if (size > 0 && data == Q_NULLPTR) {
+      mErrorString = file.errorString();
+      return false;
+    }
+    // lines that aren't a number are skipped, like toLongLong() would
+    qint64 dtNs = 0;
+    bool digits = false;
+    bool junk = false;
+    for (qint64 i = 0; i <= size; ++i) {
+      const uchar c = (i < size) ? data[i] : '\n';
+      if (c >= '0' && c <= '9') {
+        dtNs = 10 * dtNs + (c - '0');
+        digits = true;
+      }
+      else if (c == '\n') {
+        if (digits && !junk) {
+          mDtFrames.append((dtNs * mSampleRate + 500000000) / Q_INT64_C(1000000000));
+        }
+        dtNs = 0;
+        digits = false;
+        junk = false;
+      }
+      else if (c != '\r' && c != ' ' && c != '\t') {
+        junk = true;
+      }
+    }
+    return true;
+  }
+
+  QString mFileName;
+  QString mErrorString;
+  int mSampleRate;
+  QScopedPointer<EventLogReader> mReader;
+  QVector<qint64> mDtFrames;
+};
+
+
+// Packs bits least significant bit first, like EntropyEngine::addBit()
+class PackingSink : public BitSink
+{
+public:
+  explicit PackingSink(qint64 reserveBits)
+    : bits(0)
+  {
+    bytes.reserve(int(reserveBits / 8 + 1));
+  }
+  void addBit(int bit)
+  {
+    if ((bits & 7) == 0) {
+      bytes.append(char(bit));
+    }
+    else {
+      bytes.data()[bytes.size() - 1] |= char(bit << (bits & 7));
+    }
+    ++bits;
+  }
+  QByteArray bytes;
+  qint64 bits;
+};
+
+
+struct ChunkResult
+{
+  QByteArray bytes;
+  qint64 bits;
+  IntervalStatistics statistics;
+};
+
+
+struct ExtractionSettings
+{
+  QString extractorId;
+  bool preventBias;
+};
+
+
+static BitExtractor *createExtractor(const ExtractionSettings &settings)
+{
+  BitExtractor *extractor = BitExtractor::create(settings.extractorId);
+  PairComparisonExtractor *pair = dynamic_cast<PairComparisonExtractor*>(extractor);
+  if (pair != Q_NULLPTR) {
+    pair->setPreventBias(settings.preventBias);
+  }
+  return extractor;
+}
+
+
+// Runs on the thread pool; every chunk gets an extractor of its own,
+// which starts out in the state the previous chunk's ended in.
+static ChunkResult extractChunk(const IntervalLog *log, qint64 first, qint64 count, const ExtractionSettings &settings)
+{
+  QVector<qint64> dtFrames(int(count));
+  const qint64 n = log->read(first, dtFrames.data(), count);
+  QScopedPointer<BitExtractor> extractor(createExtractor(settings));
+  PackingSink sink(2 * n);
+  ChunkResult result;
+  for (qint64 i = 0; i < n; ++i) {
+    extractor->addInterval(dtFrames.at(int(i)), &sink);
+    result.statistics.add(dtFrames.at(int(i)));
+  }
+  result.bytes = sink.bytes;
+  result.bits = sink.bits;
+  return result;
+}
+
+
+// Joins the chunks' bits into bytes, runs the FIPS 140-2 tests on
+// them if asked to and writes them in large pieces. Like the engine,
+// it only writes whole bytes.
+class RandomOutput
+{
+public:
+  RandomOutput(QFile *file, bool healthCheck, bool onlySaveHealthyData)
+    : mFile(file)
+    , mHealthCheck(healthCheck || onlySaveHealthyData)
+    , mOnlySaveHealthyData(onlySaveHealthyData)
+    , mBlockStart(0)
+    , mCarry(0)
+    , mCarryBits(0)
+    , mBytes(0)
+    , mBytesWritten(0)
+    , mFailedBlocks(0)
+    , mError(false)
+  {
+    mBuffer.reserve(OutputBufferBytes + Fips140Test::BlockBytes);
+  }
+
+  void append(const QByteArray &bytes, qint64 bits)
+  {
+    const uchar *p = reinterpret_cast<const uchar*>(bytes.constData());
+    const qint64 wholeBytes = bits / 8;
+    if (mCarryBits == 0) {
+      for (qint64 i = 0; i < wholeBytes; ++i) {
+        addByte(p[i]);
+      }
+    }
+    else {
+      for (qint64 i = 0; i < wholeBytes; ++i) {
+        mCarry |= quint32(p[i]) << mCarryBits;
+        addByte(quint8(mCarry));
+        mCarry >>= 8;
+      }
+    }
+    const int rest = int(bits % 8);
+    if (rest > 0) {
+      mCarry |= quint32(p[wholeBytes] & ((1 << rest) - 1)) << mCarryBits;
+      mCarryBits += rest;
+      if (mCarryBits >= 8) {
+        addByte(quint8(mCarry));
+        mCarry >>= 8;
+        mCarryBits -= 8;
+      }
+    }
+  }
+
+  // Writes what's left; an incomplete block only if unhealthy data
+  // may be saved
+  bool finish(void)
+  {
+    if (!mOnlySaveHealthyData) {
+      mBlockStart = mBuffer.size();
+    }
+    flush();
+    return !mError;
+  }
+
+  qint64 bytes(void) const { return mBytes; }
+  qint64 bytesWritten(void) const { return mBytesWritten; }
+  qint64 blocks(void) const { return mFipsTest.blockCount(); }
+  qint64 failedBlocks(void) const { return mFailedBlocks; }
+
+private:
+  inline void addByte(quint8 byte)
+  {
+    mBuffer.append(char(byte));
+    ++mBytes;
+    if (!mHealthCheck) {
+      if (mBuffer.size() >= OutputBufferBytes) {
+        mBlockStart = mBuffer.size();
+        flush();
+      }
+      return;
+    }
+    if (mFipsTest.addByte(byte)) {
+      if (mFipsTest.passed() || !mOnlySaveHealthyData) {
+        mBlockStart = mBuffer.size();
+      }
+      else {
+        mBuffer.truncate(mBlockStart);
+      }
+      if (!mFipsTest.passed()) {
+        ++mFailedBlocks;
+      }
+      if (mBlockStart >= OutputBufferBytes) {
+        flush();
+      }
+    }
+  }
+
+  // Writes the buffer up to mBlockStart
+  void flush(void)
+  {
+    if (mFile != Q_NULLPTR && mBlockStart > 0 && !mError) {
+      mError = (mFile->write(mBuffer.constData(), mBlockStart) != mBlockStart);
+    }
+    mBytesWritten += mBlockStart;
+    mBuffer.remove(0, mBlockStart);
+    mBlockStart = 0;
+  }
+
+  QFile *mFile;
+  const bool mHealthCheck;
+  const bool mOnlySaveHealthyData;
+  QByteArray mBuffer;
+  // end of the data that may be written
+  int mBlockStart;
+  quint32 mCarry;
+  int mCarryBits;
+  qint64 mBytes;
+  qint64 mBytesWritten;
+  qint64 mFailedBlocks;
+  bool mError;
+  Fips140Test mFipsTest;
+};
+
+
+static void writeHistogram(QTextStream &out, const QString &fileName, const IntervalStatistics &statistics, int sampleRate)
+{
+  for (int bucket = 0; bucket < IntervalStatistics::Buckets; ++bucket) {
+    const quint64 n = statistics.bucketCount(bucket);
+    if (n > 0) {
+      const qint64 start = IntervalStatistics::bucketStart(bucket);
+      out << fileName << ',' << start << ',' << 1e3 * start / sampleRate << ',' << n << endl;
+    }
+  }
+}
+
+
+static void printExtractorBenchmark(QTextStream &out, const IntervalLog &log)
+{
+  QVector<qint64> dtFrames(int(qMin(log.count(), MaxBenchmarkIntervals)));
+  dtFrames.resize(int(log.read(0, dtFrames.data(), dtFrames.size())));
+  foreach (const ExtractorBenchmarkResult &r, benchmarkExtractors(dtFrames, log.sampleRate())) {
+    out << QString("  %1\t%2 bits\t%3 bit/click\t%4 bit/s\t%5 Mbit/s extraction\t(%6)")
+           .arg(r.id, -10)
+           .arg(r.bits)
+           .arg(r.bitsPerClick, 0, 'f', 4)
+           .arg(r.bitsPerSecond, 0, 'f', 3)
+           .arg(1e-6 * r.extractionBitsPerSecond, 0, 'f', 1)
+           .arg(r.name)
+        << endl;
+  }
+}
+
+
+int main(int argc, char *argv[])
+{
+  checkPortable();
+
+  QCoreApplication a(argc, argv);
+  a.setOrganizationName(AppCompanyName);
+  a.setOrganizationDomain(AppCompanyDomain);
+  a.setApplicationName(AppName);
+  a.setApplicationVersion(AppVersion);
+
+  QSettings settings(QSettings::IniFormat, QSettings::UserScope, AppCompanyName, AppName);
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription(QObject::tr("Extracts random bits from dt logs and computes the statistics of the intervals, "
+                                               "using as many threads as there are cores. "
+                                               "The extractor settings default to those of the GUI."));
+  parser.addHelpOption();
+  parser.addVersionOption();
+  parser.addPositionalArgument("logs", QObject::tr("Event logs (dt.qdt) or dt.txt files, extracted one after the other."),
+                               QObject::tr("dt-log..."));
+  QCommandLineOption extractorOption(QStringList() << "x" << "extractor",
+                                     QObject::tr("Bit extractor: %1.").arg(BitExtractor::ids().join(", ")),
+                                     QObject::tr("id"), settings.value("options/extractor", "pair").toString());
+  parser.addOption(extractorOption);
+  QCommandLineOption biasOption("prevent-bias", QObject::tr("Invert every other bit of the pair extractor (on or off)."),
+                                QObject::tr("on|off"), settings.value("options/preventBias", true).toBool() ? "on" : "off");
+  parser.addOption(biasOption);
+  QCommandLineOption outputOption(QStringList() << "o" << "output", QObject::tr("Write the random bytes to <file>."), QObject::tr("file"));
+  parser.addOption(outputOption);
+  QCommandLineOption healthOption("health", QObject::tr("Run the FIPS 140-2 tests on every block of %1 bytes.").arg(Fips140Test::BlockBytes));
+  parser.addOption(healthOption);
+  QCommandLineOption onlyHealthyOption("only-healthy", QObject::tr("Only write blocks that pass the FIPS 140-2 tests."));
+  parser.addOption(onlyHealthyOption);
+  QCommandLineOption histogramOption("histogram", QObject::tr("Write the interval histogram of every log to <file> as CSV."),
+                                     QObject::tr("file"));
+  parser.addOption(histogramOption);
+  QCommandLineOption sampleRateOption("sample-rate", QObject::tr("Sample rate of dt.txt files (default: 11025); event logs carry their own."),
+                                      QObject::tr("Hz"), "11025");
+  parser.addOption(sampleRateOption);
+  QCommandLineOption threadsOption(QStringList() << "j" << "threads", QObject::tr("Number of threads (default: one per core)."),
+                                   QObject::tr("n"), QString::number(QThread::idealThreadCount()));
+  parser.addOption(threadsOption);
+  QCommandLineOption benchmarkOption("benchmark-extractors",
+                                     QObject::tr("Compare the yield and speed of all bit extractors on every log instead of extracting."));
+  parser.addOption(benchmarkOption);
+  parser.process(a);
+
+  const QStringList &logFileNames = parser.positionalArguments();
+  if (logFileNames.isEmpty()) {
+    parser.showHelp(EXIT_FAILURE);
+  }
+
+  if (parser.isSet(benchmarkOption)) {
+    QTextStream out(stdout);
+    bool ok = true;
+    foreach (const QString &fileName, logFileNames) {
+      IntervalLog log(fileName);
+      if (!log.open(parser.value(sampleRateOption).toInt())) {
+        QTextStream(stderr) << QObject::tr("Cannot read %1: %2").arg(fileName).arg(log.errorString()) << endl;
+        ok = false;
+        continue;
+      }
+      out << QObject::tr("%1: %2 intervals at %3 Hz").arg(fileName).arg(log.count()).arg(log.sampleRate()) << endl;
+      printExtractorBenchmark(out, log);
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  ExtractionSettings extraction;
+  extraction.extractorId = parser.value(extractorOption);
+  extraction.preventBias = (parser.value(biasOption) != "off");
+  QScopedPointer<BitExtractor> extractor(createExtractor(extraction));
+  if (extractor.isNull()) {
+    QTextStream(stderr) << QObject::tr("Unknown extractor %1.").arg(extraction.extractorId) << endl;
+    return EXIT_FAILURE;
+  }
+  const int threads = qMax(1, parser.value(threadsOption).toInt());
+  QThreadPool::globalInstance()->setMaxThreadCount(threads);
+  // a multiple of the period, so that every chunk starts afresh
+  const qint64 period = extractor->period();
+  const qint64 chunkIntervals = (ChunkIntervals + period - 1) / period * period;
+
+  QScopedPointer<QFile> outputFile;
+  if (parser.isSet(outputOption)) {
+    outputFile.reset(new QFile(parser.value(outputOption)));
+    if (!outputFile->open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+      QTextStream(stderr) << QObject::tr("Cannot open %1: %2").arg(outputFile->fileName()).arg(outputFile->errorString()) << endl;
+      return EXIT_FAILURE;
+    }
+  }
+  QScopedPointer<QFile> histogramFile;
+  QTextStream histogram;
+  if (parser.isSet(histogramOption)) {
+    histogramFile.reset(new QFile(parser.value(histogramOption)));
+    if (!histogramFile->open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+      QTextStream(stderr) << QObject::tr("Cannot open %1: %2").arg(histogramFile->fileName()).arg(histogramFile->errorString()) << endl;
+      return EXIT_FAILURE;
+    }
+    histogram.setDevice(histogramFile.data());
+    histogram << "log,dt_frames,dt_ms,intervals" << endl;
+  }
+
+  QTextStream out(stdout);
+  out << QObject::tr("Extracting by %1 on %2 thread(s).").arg(extractor->name()).arg(threads) << endl;
+  RandomOutput output(outputFile.data(), parser.isSet(healthOption), parser.isSet(onlyHealthyOption));
+  QElapsedTimer t;
+  t.start();
+  qint64 totalIntervals = 0;
+  qint64 totalLogBytes = 0;
+  bool ok = true;
+  foreach (const QString &fileName, logFileNames) {
+    IntervalLog log(fileName);
+    if (!log.open(parser.value(sampleRateOption).toInt())) {
+      QTextStream(stderr) << QObject::tr("Cannot read %1: %2").arg(fileName).arg(log.errorString()) << endl;
+      ok = false;
+      continue;
+    }
+    IntervalStatistics statistics;
+    qint64 bits = 0;
+    QQueue<QFuture<ChunkResult> > chunks;
+    qint64 next = 0;
+    while (next < log.count() || !chunks.isEmpty()) {
+      while (next < log.count() && chunks.size() < ChunksPerThread * threads) {
+        const qint64 count = qMin(chunkIntervals, log.count() - next);
+        chunks.enqueue(QtConcurrent::run(extractChunk, &log, next, count, extraction));
+        next += count;
+      }
+      const ChunkResult &result = chunks.dequeue().result();
+      output.append(result.bytes, result.bits);
+      statistics.merge(result.statistics);
+      bits += result.bits;
+    }
+    totalIntervals += log.count();
+    totalLogBytes += QFileInfo(fileName).size();
+    out << QObject::tr("%1: %2 intervals at %3 Hz, %4 bits (%5 bit/interval)")
+           .arg(fileName)
+           .arg(log.count())
+           .arg(log.sampleRate())
+           .arg(bits)
+           .arg(log.count() > 0 ? qreal(bits) / log.count() : 0.0, 0, 'f', 4)
+        << endl
+        << "  " << statistics.summary(log.sampleRate()) << endl;
+    if (!histogramFile.isNull()) {
+      writeHistogram(histogram, fileName, statistics, log.sampleRate());
+    }
+  }
+  if (!output.finish()) {
+    QTextStream(stderr) << QObject::tr("Cannot write %1: %2").arg(outputFile->fileName()).arg(outputFile->errorString()) << endl;
+    return EXIT_FAILURE;
+  }
+  const qreal seconds = qMax<qint64>(1, t.nsecsElapsed()) * 1e-9;
+  out << QObject::tr("%1 random bytes, %2 written").arg(output.bytes()).arg(output.bytesWritten()) << endl;
+  if (parser.isSet(healthOption) || parser.isSet(onlyHealthyOption)) {
+    out << QObject::tr("%1 of %2 FIPS 140-2 blocks failed").arg(output.failedBlocks()).arg(output.blocks()) << endl;
+  }
+  out << QObject::tr("%1 intervals in %2 s: %3 M intervals/s, %4 MB/s of logs")
+         .arg(totalIntervals)
+         .arg(seconds, 0, 'f', 3)
+         .arg(1e-6 * totalIntervals / seconds, 0, 'f', 1)
+         .arg(1e-6 * totalLogBytes / seconds, 0, 'f', 1)
+      << endl;
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,30 @@
+# Copyright (c) 2015 Oliver Lau <ola@ct.de>
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# Offline extraction and statistics from dt logs, with the extractors
+# of the GUI and the daemon.
+
+TARGET = qliqtool
+TEMPLATE = app
+QT = core multimedia concurrent network
+CONFIG += console
+CONFIG -= app_bundle
+
+include(QliqCore.pri)
+
+OBJECTS_DIR = .obj/qliqtool
+MOC_DIR = .moc/qliqtool
+
+SOURCES += qliqtool.cpp
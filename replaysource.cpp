@@ -0,0 +1,227 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "replaysource.h"
+#include "audioinputdevice.h"
+#include "sampledecoder.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QObject>
+#include <QElapsedTimer>
+#include <QtEndian>
+#include <cstring>
+
+
+// Chunks of this duration are written at once. Must stay well below
+// the capacity of the device's sample ring, or the detector would
+// lose samples before it gets to see them.
+static const qint64 ChunkDurationUs = 250 * 1000;
+
+static const quint16 WaveFormatPcm = 0x0001;
+static const quint16 WaveFormatFloat = 0x0003;
+static const quint16 WaveFormatExtensible = 0xfffe;
+
+
+class ReplaySourcePrivate {
+public:
+  ReplaySourcePrivate(const QString &filename, const QAudioFormat &rawFormat)
+    : file(filename)
+    , format(rawFormat)
+    , data(Q_NULLPTR)
+    , dataOffset(0)
+    , dataSize(0)
+  { /* ... */ }
+  QFile file;
+  QAudioFormat format;
+  QString errorString;
+  const uchar *data;
+  qint64 dataOffset;
+  qint64 dataSize;
+
+  bool parseWav(const uchar *p, qint64 size);
+};
+
+
+// RIFF/WAVE: a sequence of chunks, each with a four character id
+// and a 32 bit little endian length, padded to even size.
+bool ReplaySourcePrivate::parseWav(const uchar *p, qint64 size)
+{
+  if (size < 12 || memcmp(p, "RIFF", 4) != 0 || memcmp(p + 8, "WAVE", 4) != 0) {
+    errorString = QObject::tr("not a WAV file");
+    return false;
+  }
+  bool haveFormat = false;
+  qint64 pos = 12;
+  while (pos + 8 <= size) {
+    const uchar *chunk = p + pos;
+    const qint64 chunkSize = qFromLittleEndian<quint32>(chunk + 4);
+    pos += 8;
+    if (memcmp(chunk, "fmt ", 4) == 0) {
+      if (chunkSize < 16 || pos + 16 > size) {
+        errorString = QObject::tr("truncated fmt chunk");
+        return false;
+      }
+      quint16 tag = qFromLittleEndian<quint16>(p + pos);
+      const int channels = qFromLittleEndian<quint16>(p + pos + 2);
+      const int sampleRate = int(qFromLittleEndian<quint32>(p + pos + 4));
+      const int bitsPerSample = qFromLittleEndian<quint16>(p + pos + 14);
+      if (tag == WaveFormatExtensible && chunkSize >= 26 && pos + 26 <= size) {
+        // the first two bytes of the sub format GUID are the tag
+        tag = qFromLittleEndian<quint16>(p + pos + 24);
+      }
+      format.setCodec("audio/pcm");
+      format.setByteOrder(QAudioFormat::LittleEndian);
+      format.setChannelCount(channels);
+      format.setSampleRate(sampleRate);
+      format.setSampleSize(bitsPerSample);
+      if (tag == WaveFormatFloat) {
+        format.setSampleType(QAudioFormat::Float);
+      }
+      else if (tag == WaveFormatPcm) {
+        format.setSampleType(bitsPerSample == 8 ? QAudioFormat::UnSignedInt : QAudioFormat::SignedInt);
+      }
+      else {
+        errorString = QObject::tr("unsupported WAV format tag 0x%1").arg(tag, 4, 16, QChar('0'));
+        return false;
+      }
+      haveFormat = true;
+    }
+    else if (memcmp(chunk, "data", 4) == 0) {
+      if (!haveFormat) {
+        errorString = QObject::tr("data chunk before fmt chunk");
+        return false;
+      }
+      dataOffset = pos;
+      // streaming writers leave the size at 0 or 0xffffffff
+      dataSize = (chunkSize == 0 || pos + chunkSize > size) ? size - pos : chunkSize;
+      return true;
+    }
+    pos += chunkSize + (chunkSize & 1);
+  }
+  errorString = QObject::tr("no data chunk");
+  return false;
+}
+
+
+ReplaySource::ReplaySource(const QString &filename, const QAudioFormat &rawFormat)
+  : d_ptr(new ReplaySourcePrivate(filename, rawFormat))
+{
+  /* ... */
+}
+
+
+ReplaySource::~ReplaySource()
+{
+  Q_D(ReplaySource);
+  if (d->data != Q_NULLPTR) {
+    d->file.unmap(const_cast<uchar*>(d->data));
+  }
+}
+
+
+bool ReplaySource::open(void)
+{
+  Q_D(ReplaySource);
+  if (!d->file.open(QIODevice::ReadOnly)) {
+    d->errorString = d->file.errorString();
+    return false;
+  }
+  const qint64 size = d->file.size();
+  d->data = d->file.map(0, size);
+  if (d->data == Q_NULLPTR) {
+    d->errorString = d->file.errorString();
+    return false;
+  }
+  if (size >= 4 && memcmp(d->data, "RIFF", 4) == 0) {
+    if (!d->parseWav(d->data, size))
+      return false;
+  }
+  else {
+    if (!d->format.isValid()) {
+      d->errorString = QObject::tr("raw file without a sample format");
+      return false;
+    }
+    d->dataOffset = 0;
+    d->dataSize = size;
+  }
+  const int frameBytes = d->format.bytesPerFrame();
+  if (frameBytes <= 0) {
+    d->errorString = QObject::tr("invalid sample format");
+    return false;
+  }
+  // AudioInputDevice would silently drop every buffer, e.g. of a
+  // 24 bit WAV file
+  if (sampleDecoderForFormat(d->format) == Q_NULLPTR) {
+    d->errorString = QObject::tr("unsupported sample format (%1 bit %2)")
+        .arg(d->format.sampleSize())
+        .arg(d->format.sampleType() == QAudioFormat::Float ? "float" : "integer");
+    return false;
+  }
+  // ignore a trailing partial frame
+  d->dataSize -= d->dataSize % frameBytes;
+  return true;
+}
+
+
+QString ReplaySource::errorString(void) const
+{
+  return d_ptr->errorString;
+}
+
+
+const QAudioFormat &ReplaySource::format(void) const
+{
+  return d_ptr->format;
+}
+
+
+qint64 ReplaySource::frameCount(void) const
+{
+  const int frameBytes = d_ptr->format.bytesPerFrame();
+  return frameBytes > 0 ? d_ptr->dataSize / frameBytes : 0;
+}
+
+
+ReplayStats ReplaySource::run(AudioInputDevice *device)
+{
+  Q_D(ReplaySource);
+  ReplayStats stats;
+  stats.sampleRate = d->format.sampleRate();
+  if (d->data == Q_NULLPTR || device == Q_NULLPTR)
+    return stats;
+  if (!device->isOpen()) {
+    device->start();
+  }
+  const qint64 clicksBefore = device->clickCount();
+  const qint64 chunkBytes = qMax(1, d->format.framesForDuration(ChunkDurationUs)) * d->format.bytesPerFrame();
+  const char *p = reinterpret_cast<const char *>(d->data + d->dataOffset);
+  const char *end = p + d->dataSize;
+  QElapsedTimer t;
+  t.start();
+  while (p < end) {
+    const qint64 n = qMin(chunkBytes, qint64(end - p));
+    device->write(p, n);
+    p += n;
+  }
+  stats.wallSeconds = 1e-9 * t.nsecsElapsed();
+  stats.frames = frameCount();
+  stats.clicks = device->clickCount() - clicksBefore;
+  return stats;
+}
@@ -0,0 +1,93 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef __REPLAYSOURCE_H_
+#define __REPLAYSOURCE_H_
+
+#include <QtGlobal>
+#include <QString>
+#include <QAudioFormat>
+#include <QScopedPointer>
+
+class AudioInputDevice;
+class ReplaySourcePrivate;
+
+
+struct ReplayStats
+{
+  ReplayStats(void)
+    : frames(0)
+    , clicks(0)
+    , sampleRate(0)
+    , wallSeconds(0.0)
+  { /* ... */ }
+  qint64 frames;
+  qint64 clicks;
+  int sampleRate;
+  qreal wallSeconds;
+
+  qreal audioSeconds(void) const
+  {
+    return sampleRate > 0 ? qreal(frames) / sampleRate : 0.0;
+  }
+  qreal framesPerSecond(void) const
+  {
+    return wallSeconds > 0.0 ? frames / wallSeconds : 0.0;
+  }
+  qreal clicksPerSecond(void) const
+  {
+    return wallSeconds > 0.0 ? clicks / wallSeconds : 0.0;
+  }
+  qreal speedup(void) const
+  {
+    return wallSeconds > 0.0 ? audioSeconds() / wallSeconds : 0.0;
+  }
+};
+
+
+// Plays a recorded capture into an AudioInputDevice as fast as the
+// pipeline takes it, so that detection, extraction and the health
+// tests see exactly what they would have seen live. Reads WAV files
+// (PCM or float) and headerless raw files such as the captures
+// recorded through AudioInputDevice::setCaptureStream(); the latter
+// need their format given explicitly.
+class ReplaySource
+{
+public:
+  explicit ReplaySource(const QString &filename, const QAudioFormat &rawFormat = QAudioFormat());
+  ~ReplaySource();
+
+  bool open(void);
+  QString errorString(void) const;
+  // Valid after open()
+  const QAudioFormat &format(void) const;
+  qint64 frameCount(void) const;
+
+  // Writes the whole file into `device`, which must have been created
+  // for format(). Clicks are counted if the device has a detector.
+  ReplayStats run(AudioInputDevice *device);
+
+private:
+  QScopedPointer<ReplaySourcePrivate> d_ptr;
+  Q_DECLARE_PRIVATE(ReplaySource)
+  Q_DISABLE_COPY(ReplaySource)
+};
+
+#endif // __REPLAYSOURCE_H_
@@ -0,0 +1,205 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef __RINGBUFFER_H_
+#define __RINGBUFFER_H_
+
+#include <QtGlobal>
+#include <QVector>
+#include <atomic>
+#include <cstring>
+
+
+// Lock-free ring buffer with a single producer and any number of
+// consumers. Every consumer reads through its own RingBuffer::Reader,
+// so consumers neither block the producer nor each other. The producer
+// never waits: a reader that falls behind by more than capacity()
+// elements loses the oldest ones, which it learns from Reader::lost().
+//
+// Positions are 64-bit and grow monotonically, so they double as a
+// running index of every element ever written.
+//
+// T must be trivially copyable.
+template <typename T>
+class RingBuffer
+{
+public:
+  explicit RingBuffer(int minCapacity)
+    : mCapacity(1)
+    , mReserved(0)
+    , mWritten(0)
+  {
+    while (mCapacity < minCapacity)
+      mCapacity <<= 1;
+    mMask = mCapacity - 1;
+    mBuffer.resize(mCapacity);
+    mData = mBuffer.data();
+  }
+
+  int capacity(void) const
+  {
+    return mCapacity;
+  }
+
+  // Position one past the last element that's safe to read.
+  qint64 writePosition(void) const
+  {
+    return mWritten.load(std::memory_order_acquire);
+  }
+
+  // Producer only: returns a pointer to up to `count` contiguous slots
+  // in `*dst` and the number of slots actually available there (less
+  // than `count` if the request wraps around the end of the storage).
+  // Fill them, then publish them with endWrite().
+  int beginWrite(int count, T **dst)
+  {
+    const qint64 w = mWritten.load(std::memory_order_relaxed);
+    const int offset = int(w & mMask);
+    const int n = qMin(count, mCapacity - offset);
+    mReserved.store(w + n, std::memory_order_relaxed);
+    // readers must see the reservation before any of the slots change
+    std::atomic_thread_fence(std::memory_order_release);
+    *dst = mData + offset;
+    return n;
+  }
+
+  void endWrite(int count)
+  {
+    mWritten.store(mWritten.load(std::memory_order_relaxed) + count, std::memory_order_release);
+  }
+
+  void write(const T *src, int count)
+  {
+    while (count > 0) {
+      T *dst;
+      const int n = beginWrite(count, &dst);
+      memcpy(dst, src, n * sizeof(T));
+      endWrite(n);
+      src += n;
+      count -= n;
+    }
+  }
+
+  class Reader
+  {
+  public:
+    explicit Reader(const RingBuffer<T> *ring = Q_NULLPTR)
+      : mRing(ring)
+      , mPos(ring != Q_NULLPTR ? ring->writePosition() : 0)
+      , mLost(0)
+    { /* ... */ }
+
+    void attach(const RingBuffer<T> *ring)
+    {
+      mRing = ring;
+      mPos = (ring != Q_NULLPTR) ? ring->writePosition() : 0;
+      mLost = 0;
+    }
+
+    bool isAttached(void) const
+    {
+      return mRing != Q_NULLPTR;
+    }
+
+    // Position of the next element read() will return.
+    qint64 position(void) const
+    {
+      return mPos;
+    }
+
+    // Number of elements this reader has skipped because the producer
+    // overwrote them before they were read.
+    qint64 lost(void) const
+    {
+      return mLost;
+    }
+
+    qint64 available(void) const
+    {
+      return (mRing != Q_NULLPTR) ? qMin(mRing->writePosition() - mPos, qint64(mRing->capacity())) : 0;
+    }
+
+    // Moves the cursor, clamped to what's still in the buffer.
+    void seek(qint64 pos)
+    {
+      if (mRing == Q_NULLPTR)
+        return;
+      const qint64 w = mRing->writePosition();
+      mPos = qBound(qMax(qint64(0), w - mRing->capacity()), pos, w);
+    }
+
+    // Moves the cursor so that the `count` newest elements can be read.
+    void seekLatest(int count)
+    {
+      if (mRing != Q_NULLPTR) {
+        seek(mRing->writePosition() - count);
+      }
+    }
+
+    int read(T *dst, int maxCount)
+    {
+      if (mRing == Q_NULLPTR || maxCount <= 0)
+        return 0;
+      const qint64 w = mRing->writePosition();
+      const qint64 cap = mRing->capacity();
+      if (w - mPos > cap) {
+        mLost += w - cap - mPos;
+        mPos = w - cap;
+      }
+      int n = int(qMin(w - mPos, qint64(maxCount)));
+      const int offset = int(mPos & mRing->mMask);
+      const int n1 = qMin(n, mRing->mCapacity - offset);
+      memcpy(dst, mRing->mData + offset, n1 * sizeof(T));
+      memcpy(dst + n1, mRing->mData, (n - n1) * sizeof(T));
+      // Check whether the producer started overwriting the slots
+      // while they were being copied. If so, drop the stale ones.
+      std::atomic_thread_fence(std::memory_order_acquire);
+      const qint64 firstValid = mRing->mReserved.load(std::memory_order_relaxed) - cap;
+      if (mPos < firstValid) {
+        const int stale = int(qMin(firstValid - mPos, qint64(n)));
+        memmove(dst, dst + stale, (n - stale) * sizeof(T));
+        mLost += stale;
+        mPos += stale;
+        n -= stale;
+      }
+      mPos += n;
+      return n;
+    }
+
+  private:
+    const RingBuffer<T> *mRing;
+    qint64 mPos;
+    qint64 mLost;
+  };
+
+private:
+  Q_DISABLE_COPY(RingBuffer)
+  int mCapacity;
+  int mMask;
+  QVector<T> mBuffer;
+  T *mData;
+  std::atomic<qint64> mReserved;
+  std::atomic<qint64> mWritten;
+};
+
+
+typedef RingBuffer<int> SampleRingBuffer;
+
+#endif // __RINGBUFFER_H_
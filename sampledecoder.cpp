@@ -0,0 +1,273 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "sampledecoder.h"
+
+#include <QtEndian>
+#include <cstring>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define QLIQ_SSE2
+#include <emmintrin.h>
+#endif
+
+
+namespace {
+
+// Largest float below 2^31, so that a full-scale float sample doesn't
+// overflow when converted to int.
+const float FloatScale = 2147483520.0f;
+
+
+template <typename T, QAudioFormat::Endian E> struct Pcm;
+
+template <typename T> struct Pcm<T, QAudioFormat::LittleEndian>
+{
+  static inline int read(const uchar *src) { return int(qFromLittleEndian<T>(src)); }
+};
+
+template <typename T> struct Pcm<T, QAudioFormat::BigEndian>
+{
+  static inline int read(const uchar *src) { return int(qFromBigEndian<T>(src)); }
+};
+
+
+inline int peakOf(int hi, int lo)
+{
+  // -lo would overflow for lo == INT_MIN
+  const qint64 peak = qMax(qint64(hi), -qint64(lo));
+  return int(qMin(peak, qint64(std::numeric_limits<int>::max())));
+}
+
+
+inline int floatToPcm(float value)
+{
+  return int(qBound(-1.0f, value, 1.0f) * FloatScale);
+}
+
+
+template <typename T, QAudioFormat::Endian E>
+inline void decodeScalar(const uchar *src, int *dst, int count, int &hi, int &lo)
+{
+  for (int i = 0; i < count; ++i) {
+    const int value = Pcm<T, E>::read(src);
+    hi = qMax(hi, value);
+    lo = qMin(lo, value);
+    dst[i] = value;
+    src += sizeof(T);
+  }
+}
+
+
+inline void decodeFloatScalar(const uchar *src, int *dst, int count, int &hi, int &lo)
+{
+  for (int i = 0; i < count; ++i) {
+    float f;
+    memcpy(&f, src, sizeof(f));
+    const int value = floatToPcm(f);
+    hi = qMax(hi, value);
+    lo = qMin(lo, value);
+    dst[i] = value;
+    src += sizeof(float);
+  }
+}
+
+
+template <typename T, QAudioFormat::Endian E>
+int decodePcm(const uchar *src, int *dst, int count)
+{
+  int hi = 0;
+  int lo = 0;
+  decodeScalar<T, E>(src, dst, count, hi, lo);
+  return peakOf(hi, lo);
+}
+
+
+#ifdef QLIQ_SSE2
+
+// SSE2 is only available on x86, which is little endian, so the
+// kernels below can load LE samples as they are.
+
+template <>
+int decodePcm<qint16, QAudioFormat::LittleEndian>(const uchar *src, int *dst, int count)
+{
+  __m128i vhi = _mm_setzero_si128();
+  __m128i vlo = _mm_setzero_si128();
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+    vhi = _mm_max_epi16(vhi, v);
+    vlo = _mm_min_epi16(vlo, v);
+    // sign-extend to 32 bit by shifting the duplicated halves back down
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 4), _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+    src += 8 * sizeof(qint16);
+  }
+  qint16 his[8];
+  qint16 los[8];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(his), vhi);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(los), vlo);
+  int hi = 0;
+  int lo = 0;
+  for (int j = 0; j < 8; ++j) {
+    hi = qMax(hi, int(his[j]));
+    lo = qMin(lo, int(los[j]));
+  }
+  decodeScalar<qint16, QAudioFormat::LittleEndian>(src, dst + i, count - i, hi, lo);
+  return peakOf(hi, lo);
+}
+
+
+inline __m128i maxEpi32(__m128i a, __m128i b)
+{
+  const __m128i gt = _mm_cmpgt_epi32(a, b);
+  return _mm_or_si128(_mm_and_si128(gt, a), _mm_andnot_si128(gt, b));
+}
+
+
+inline __m128i minEpi32(__m128i a, __m128i b)
+{
+  const __m128i lt = _mm_cmplt_epi32(a, b);
+  return _mm_or_si128(_mm_and_si128(lt, a), _mm_andnot_si128(lt, b));
+}
+
+
+template <>
+int decodePcm<qint32, QAudioFormat::LittleEndian>(const uchar *src, int *dst, int count)
+{
+  __m128i vhi = _mm_setzero_si128();
+  __m128i vlo = _mm_setzero_si128();
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+    vhi = maxEpi32(vhi, v);
+    vlo = minEpi32(vlo, v);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), v);
+    src += 4 * sizeof(qint32);
+  }
+  qint32 his[4];
+  qint32 los[4];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(his), vhi);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(los), vlo);
+  int hi = 0;
+  int lo = 0;
+  for (int j = 0; j < 4; ++j) {
+    hi = qMax(hi, int(his[j]));
+    lo = qMin(lo, int(los[j]));
+  }
+  decodeScalar<qint32, QAudioFormat::LittleEndian>(src, dst + i, count - i, hi, lo);
+  return peakOf(hi, lo);
+}
+
+
+int decodeFloat(const uchar *src, int *dst, int count)
+{
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 minusOne = _mm_set1_ps(-1.0f);
+  const __m128 scale = _mm_set1_ps(FloatScale);
+  __m128 vhi = _mm_setzero_ps();
+  __m128 vlo = _mm_setzero_ps();
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const __m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(reinterpret_cast<const float*>(src)), minusOne), one);
+    vhi = _mm_max_ps(vhi, v);
+    vlo = _mm_min_ps(vlo, v);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_cvttps_epi32(_mm_mul_ps(v, scale)));
+    src += 4 * sizeof(float);
+  }
+  float his[4];
+  float los[4];
+  _mm_storeu_ps(his, vhi);
+  _mm_storeu_ps(los, vlo);
+  int hi = 0;
+  int lo = 0;
+  for (int j = 0; j < 4; ++j) {
+    hi = qMax(hi, floatToPcm(his[j]));
+    lo = qMin(lo, floatToPcm(los[j]));
+  }
+  decodeFloatScalar(src, dst + i, count - i, hi, lo);
+  return peakOf(hi, lo);
+}
+
+#else
+
+int decodeFloat(const uchar *src, int *dst, int count)
+{
+  int hi = 0;
+  int lo = 0;
+  decodeFloatScalar(src, dst, count, hi, lo);
+  return peakOf(hi, lo);
+}
+
+#endif // QLIQ_SSE2
+
+
+template <typename T>
+SampleDecodeFunction decoderForByteOrder(QAudioFormat::Endian byteOrder)
+{
+  return (byteOrder == QAudioFormat::LittleEndian)
+      ? &decodePcm<T, QAudioFormat::LittleEndian>
+      : &decodePcm<T, QAudioFormat::BigEndian>;
+}
+
+}
+
+
+SampleDecodeFunction sampleDecoderForFormat(const QAudioFormat &format)
+{
+  switch (format.sampleSize()) {
+  case 8:
+    switch (format.sampleType()) {
+    case QAudioFormat::UnSignedInt:
+      return &decodePcm<quint8, QAudioFormat::LittleEndian>;
+    case QAudioFormat::SignedInt:
+      return &decodePcm<qint8, QAudioFormat::LittleEndian>;
+    default:
+      break;
+    }
+    break;
+  case 16:
+    switch (format.sampleType()) {
+    case QAudioFormat::UnSignedInt:
+      return decoderForByteOrder<quint16>(format.byteOrder());
+    case QAudioFormat::SignedInt:
+      return decoderForByteOrder<qint16>(format.byteOrder());
+    default:
+      break;
+    }
+    break;
+  case 32:
+    switch (format.sampleType()) {
+    case QAudioFormat::UnSignedInt:
+      return decoderForByteOrder<quint32>(format.byteOrder());
+    case QAudioFormat::SignedInt:
+      return decoderForByteOrder<qint32>(format.byteOrder());
+    case QAudioFormat::Float:
+      return &decodeFloat;
+    default:
+      break;
+    }
+    break;
+  default:
+    break;
+  }
+  return Q_NULLPTR;
+}
@@ -0,0 +1,37 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef __SAMPLEDECODER_H_
+#define __SAMPLEDECODER_H_
+
+#include <QtGlobal>
+#include <QAudioFormat>
+
+// Converts `count` raw PCM values (all channels, interleaved) from `src`
+// to int and stores them in `dst`. Returns the peak amplitude of the
+// converted values, so that callers don't need a second pass to
+// determine the input level.
+typedef int (*SampleDecodeFunction)(const uchar *src, int *dst, int count);
+
+// Returns the kernel matching `format`, or Q_NULLPTR if the format isn't
+// supported. Look the kernel up once per format, not once per buffer.
+extern SampleDecodeFunction sampleDecoderForFormat(const QAudioFormat &format);
+
+#endif // __SAMPLEDECODER_H_
@@ -0,0 +1,115 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "spectrumrenderarea.h"
+#include "clickdetector.h"
+#include "pulsespectrum.h"
+
+#include <QDebug>
+#include <QPainter>
+#include <algorithm>
+#include <cmath>
+
+
+class SpectrumRenderAreaPrivate
+{
+public:
+  SpectrumRenderAreaPrivate(void)
+    : clickDetector(Q_NULLPTR)
+    , pulseCount(0)
+  {
+    std::fill(counts, counts + PulseSpectrum::Bins, 0);
+  }
+  ~SpectrumRenderAreaPrivate() { /* ... */ }
+  ClickDetector *clickDetector;
+  // copied from the detector's spectrum on refresh()
+  quint32 counts[PulseSpectrum::Bins];
+  qint64 pulseCount;
+};
+
+
+SpectrumRenderArea::SpectrumRenderArea(QWidget *parent)
+  : QWidget(parent)
+  , d_ptr(new SpectrumRenderAreaPrivate)
+{
+  setSizePolicy(QSizePolicy::MinimumExpanding, QSizePolicy::MinimumExpanding);
+  setMinimumHeight(56);
+}
+
+
+SpectrumRenderArea::~SpectrumRenderArea() { /* ... */ }
+
+
+QSize SpectrumRenderArea::sizeHint(void) const
+{
+  return QSize(512, 96);
+}
+
+
+void SpectrumRenderArea::paintEvent(QPaintEvent *)
+{
+  Q_D(SpectrumRenderArea);
+  QPainter p(this);
+  static const QColor BackgroundColor(17, 33, 17);
+  p.fillRect(rect(), BackgroundColor);
+  if (d->clickDetector == Q_NULLPTR)
+    return;
+  const PulseSpectrum *spectrum = d->clickDetector->pulseSpectrum();
+  const quint32 maxCount = *std::max_element(d->counts, d->counts + PulseSpectrum::Bins);
+  if (maxCount > 0) {
+    static const QColor BarColor(54, 255, 54);
+    const qreal yScale = height() / std::log1p(qreal(maxCount));
+    for (int bin = 0; bin < PulseSpectrum::Bins; ++bin) {
+      if (d->counts[bin] == 0)
+        continue;
+      const int x0 = bin * width() / PulseSpectrum::Bins;
+      const int x1 = (bin + 1) * width() / PulseSpectrum::Bins;
+      const int h = qMax(1, int(std::log1p(qreal(d->counts[bin])) * yScale));
+      p.fillRect(x0, height() - h, qMax(1, x1 - x0), h, BarColor);
+    }
+  }
+  const qreal xScale = qreal(width()) / spectrum->range(PulseSpectrum::Height);
+  static const QColor FloorColor(255, 155, 54);
+  static const QColor ThresholdColor(255, 255, 255);
+  p.setPen(FloorColor);
+  p.drawLine(QPointF(d->clickDetector->pulseFloor() * xScale, 0), QPointF(d->clickDetector->pulseFloor() * xScale, height()));
+  p.setPen(ThresholdColor);
+  p.drawLine(QPointF(d->clickDetector->threshold() * xScale, 0), QPointF(d->clickDetector->threshold() * xScale, height()));
+  p.drawText(rect().adjusted(4, 2, -4, -2), Qt::AlignTop | Qt::AlignRight, tr("%1 pulses").arg(d->pulseCount));
+}
+
+
+void SpectrumRenderArea::setClickDetector(ClickDetector *clickDetector)
+{
+  Q_D(SpectrumRenderArea);
+  d->clickDetector = clickDetector;
+  refresh();
+}
+
+
+void SpectrumRenderArea::refresh(void)
+{
+  Q_D(SpectrumRenderArea);
+  if (d->clickDetector != Q_NULLPTR) {
+    d->clickDetector->pulseSpectrum()->counts(PulseSpectrum::Height, d->counts);
+    d->pulseCount = d->clickDetector->pulseSpectrum()->pulseCount();
+  }
+  update();
+}
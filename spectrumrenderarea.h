@@ -0,0 +1,53 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef __SPECTRUMRENDERAREA_H_
+#define __SPECTRUMRENDERAREA_H_
+
+#include <QWidget>
+#include <QScopedPointer>
+
+class SpectrumRenderAreaPrivate;
+class ClickDetector;
+
+// Live pulse-height spectrum of one channel: the pulses per height bin
+// of the detector's PulseSpectrum on a logarithmic scale, with the
+// pulse floor and the click threshold marked. refresh() picks up the
+// current counts.
+class SpectrumRenderArea : public QWidget
+{
+  Q_OBJECT
+public:
+  explicit SpectrumRenderArea(QWidget *parent = Q_NULLPTR);
+  ~SpectrumRenderArea();
+  void setClickDetector(ClickDetector *);
+  void refresh(void);
+
+protected:
+  virtual QSize sizeHint(void) const;
+  void paintEvent(QPaintEvent *);
+
+private:
+  QScopedPointer<SpectrumRenderAreaPrivate> d_ptr;
+  Q_DECLARE_PRIVATE(SpectrumRenderArea)
+  Q_DISABLE_COPY(SpectrumRenderArea)
+};
+
+#endif // __SPECTRUMRENDERAREA_H_
@@ -0,0 +1,30 @@
+# Copyright (c) 2015 Oliver Lau <ola@ct.de>
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# Functional tests of the core. `make check` runs them.
+
+TARGET = qliqtest
+TEMPLATE = app
+QT += testlib
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+include(../QliqCore.pri)
+
+OBJECTS_DIR = .obj
+MOC_DIR = .moc
+
+SOURCES += \
+    tst_core.cpp
@@ -0,0 +1,198 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <QtTest>
+#include <QAudioFormat>
+#include <QSettings>
+#include <QTemporaryDir>
+#include <QLocalSocket>
+#include <QCoreApplication>
+
+#include "audioinputdevice.h"
+#include "pulsegenerator.h"
+#include "entropyengine.h"
+#include "entropyserver.h"
+
+
+static const quint64 Seed = 0x51u;
+
+
+static QAudioFormat makeFormat(int sampleRate, int sampleSize, QAudioFormat::SampleType sampleType, int channels = 1)
+{
+  QAudioFormat format;
+  format.setCodec("audio/pcm");
+  format.setByteOrder(QAudioFormat::LittleEndian);
+  format.setChannelCount(channels);
+  format.setSampleRate(sampleRate);
+  format.setSampleSize(sampleSize);
+  format.setSampleType(sampleType);
+  return format;
+}
+
+
+// `durationMs` of Geiger pulses at `rate` counts per second
+static QByteArray makePulses(const QAudioFormat &format, qreal rate, int durationMs)
+{
+  PulseGenerator generator(format);
+  generator.setRate(rate);
+  generator.setSeed(Seed);
+  generator.open(QIODevice::ReadOnly);
+  return generator.read(qint64(format.bytesForDuration(1000 * qint64(durationMs))));
+}
+
+
+// Counts the heap allocations made on the thread that armed the
+// counter, by interposing glibc's allocator, which operator new and
+// Qt's containers go through as well
+#if defined(__GLIBC__)
+#define COUNT_ALLOCATIONS
+
+extern "C" {
+void *__libc_malloc(size_t);
+void *__libc_calloc(size_t, size_t);
+void *__libc_realloc(void *, size_t);
+}
+
+static thread_local bool allocationCounting = false;
+static thread_local qint64 allocationCount = 0;
+
+extern "C" void *malloc(size_t size) __THROW
+{
+  if (allocationCounting) {
+    ++allocationCount;
+  }
+  return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t n, size_t size) __THROW
+{
+  if (allocationCounting) {
+    ++allocationCount;
+  }
+  return __libc_calloc(n, size);
+}
+
+extern "C" void *realloc(void *p, size_t size) __THROW
+{
+  if (allocationCounting) {
+    ++allocationCount;
+  }
+  return __libc_realloc(p, size);
+}
+#endif
+
+
+class Core : public QObject
+{
+  Q_OBJECT
+
+private slots:
+  void allocations_data(void);
+  void allocations(void);
+  void egdSplitCommand(void);
+};
+
+
+void Core::allocations_data(void)
+{
+  QTest::addColumn<int>("channels");
+  QTest::addColumn<qreal>("rate");
+  QTest::addColumn<bool>("pulseAnalysis");
+  QTest::newRow("s16") << 1 << qreal(1000) << false;
+  QTest::newRow("s16+spectrum") << 1 << qreal(1000) << true;
+  QTest::newRow("s16x4") << 4 << qreal(250) << false;
+}
+
+
+// Once warmed up, an audio buffer must make its way through decoding,
+// detection, the click rings, extraction, byte assembly, the dt logs
+// and the raw capture without a single heap allocation. What's done once per block (health tests, conditioning,
+// messages) or per entropy estimate may allocate; at these rates
+// neither comes due within the three seconds fed.
+void Core::allocations(void)
+{
+#ifndef COUNT_ALLOCATIONS
+  QSKIP("Counting allocations requires glibc");
+#else
+  QFETCH(int, channels);
+  QFETCH(qreal, rate);
+  QFETCH(bool, pulseAnalysis);
+  QTemporaryDir dir;
+  QVERIFY(dir.isValid());
+  QSettings settings(dir.path() + "/qliq.ini", QSettings::IniFormat);
+  settings.setValue("output/directory", dir.path());
+  settings.setValue("capture/rawFile", "capture.raw");
+  settings.setValue("analysis/threshold", 8000);
+  settings.setValue("analysis/lockTimeNs", 50 * 1000);
+  settings.setValue("analysis/pulseAnalysis", pulseAnalysis);
+
+  const QAudioFormat &format = makeFormat(48000, 16, QAudioFormat::SignedInt, channels);
+  const QByteArray &audio = makePulses(format, rate, 3000);
+  const int chunkBytes = format.bytesForDuration(100 * 1000);
+  // the dt logs are opened on the first click of their channel
+  const int warmUpBytes = format.bytesForDuration(1000 * 1000);
+  EntropyEngine engine(format);
+  engine.restoreSettings(settings);
+  engine.audioInputDevice()->start();
+  engine.start();
+  for (int i = 0; i < warmUpBytes; i += chunkBytes) {
+    engine.audioInputDevice()->write(audio.constData() + i, chunkBytes);
+  }
+  const qint64 clicksBefore = engine.audioInputDevice()->clickCount();
+  allocationCount = 0;
+  allocationCounting = true;
+  for (int i = warmUpBytes; i < audio.size(); i += chunkBytes) {
+    engine.audioInputDevice()->write(audio.constData() + i, qMin(chunkBytes, audio.size() - i));
+  }
+  allocationCounting = false;
+  engine.stop();
+  QVERIFY(engine.audioInputDevice()->clickCount() > clicksBefore);
+  QCOMPARE(allocationCount, qint64(0));
+#endif
+}
+
+
+// A command that reaches the EGD server in pieces must be answered
+// once it's complete
+void Core::egdSplitCommand(void)
+{
+  EntropyServer server(Q_NULLPTR);
+  server.setSource(EntropyServer::RawSource);
+  server.addHealthyBytes(QByteArray(64, '\x5a'));
+  const QString &name = QString("qliqtest-egd-%1").arg(QCoreApplication::applicationPid());
+  QVERIFY(server.listen(name));
+  QLocalSocket client;
+  client.connectToServer(name);
+  QVERIFY(client.waitForConnected(1000));
+  // read 16 bytes without blocking, one byte at a time
+  client.write("\x01", 1);
+  client.flush();
+  QTRY_COMPARE(server.clientCount(), 1);
+  QTest::qWait(50);
+  QCOMPARE(client.bytesAvailable(), qint64(0));
+  client.write("\x10", 1);
+  client.flush();
+  QTRY_COMPARE(client.bytesAvailable(), qint64(1 + 16));
+  QCOMPARE(quint8(client.read(1).at(0)), quint8(16));
+  QCOMPARE(server.reservoirLevel(), 64 - 16);
+}
+
+
+QTEST_MAIN(Core)
+#include "tst_core.moc"
@@ -19,63 +19,51 @@
 
 
 #include "waverenderarea.h"
-#include "audioinputdevice.h"
+#include "clickdetector.h"
 
 #include <QDebug>
 #include <QPainter>
-#include <QPixmap>
-#include <QPointF>
-#include <QLineF>
-#include <QMutexLocker>
-#include <QDateTime>
-#include <qmath.h>
-#include <limits>
+#include <QThread>
+
 
 class WaveRenderAreaPrivate
 {
 public:
-  explicit WaveRenderAreaPrivate(QMutex *mutex)
-    : doWritePixmap(false)
-    , maxAmplitude(-1)
-    , sampleBufferMutex(mutex)
-    , threshold(std::numeric_limits<int>::max())
+  WaveRenderAreaPrivate(void)
+    : renderer(new WaveRenderer)
+    , clickDetector(Q_NULLPTR)
     , mouseDown(false)
     , pos1(0)
     , pos2(0)
-    , lockTimeNs(4 * 1000 * 1000)
-    , lastClickTimestampNs(0)
-    , frameTimestampNs(0)
-    , lastFrameTimestampNs(0)
+  { /* ... */ }
+  ~WaveRenderAreaPrivate()
   {
-    Q_ASSERT(mutex != Q_NULLPTR);
+    // the renderer deletes itself on the way out
+    renderThread.quit();
+    renderThread.wait();
   }
-  ~WaveRenderAreaPrivate() { /* ... */ }
-  QAudioFormat audioFormat;
-  QPixmap pixmap;
-  bool doWritePixmap;
-  quint32 maxAmplitude;
-  QMutex *sampleBufferMutex;
-  SampleBufferType sampleBuffer;
-  int threshold;
-  QVector<int> peakPos;
-  QVector<qint64> dt;
+  QThread renderThread;
+  // no parent, so that it can be moved to the render thread
+  WaveRenderer *renderer;
+  QImage frame;
+  ClickDetector *clickDetector;
   bool mouseDown;
   int pos1;
   int pos2;
-  qint64 lockTimeNs;
-  qint64 lastClickTimestampNs;
-  qint64 frameTimestampNs;
-  qint64 lastFrameTimestampNs;
 };
 
 
-WaveRenderArea::WaveRenderArea(QMutex *mutex, QWidget *parent)
+WaveRenderArea::WaveRenderArea(QWidget *parent)
   : QWidget(parent)
-  , d_ptr(new WaveRenderAreaPrivate(mutex))
+  , d_ptr(new WaveRenderAreaPrivate)
 {
+  Q_D(WaveRenderArea);
   setSizePolicy(QSizePolicy::MinimumExpanding, QSizePolicy::MinimumExpanding);
   setMinimumHeight(56);
-  reset();
+  d->renderer->moveToThread(&d->renderThread);
+  QObject::connect(&d->renderThread, SIGNAL(finished()), d->renderer, SLOT(deleteLater()));
+  QObject::connect(d->renderer, SIGNAL(frameReady(QImage)), SLOT(onFrameReady(QImage)));
+  d->renderThread.start();
 }
 
 
@@ -92,17 +80,19 @@ void WaveRenderArea::paintEvent(QPaintEvent *)
 {
   Q_D(WaveRenderArea);
   QPainter p(this);
-  QMutexLocker(d->sampleBufferMutex);
-  p.drawPixmap(0, 0, d->pixmap);
+  p.drawImage(0, 0, d->frame);
+  if (d->mouseDown) {
+    static const QBrush MarkerBrush(QColor(255, 255, 0, 72), Qt::SolidPattern);
+    p.fillRect(QRectF(d->pos1, 0, (d->pos2 - d->pos1), height()), MarkerBrush);
+  }
 }
 
 
 void WaveRenderArea::resizeEvent(QResizeEvent *e)
 {
   Q_D(WaveRenderArea);
-  QMutexLocker(d->sampleBufferMutex);
-  d->pixmap = QPixmap(e->size());
-  drawPixmap();
+  QMetaObject::invokeMethod(d->renderer, "setSize", Qt::QueuedConnection, Q_ARG(QSize, e->size()));
+  QMetaObject::invokeMethod(d->renderer, "render", Qt::QueuedConnection);
 }
 
 
@@ -113,7 +103,7 @@ void WaveRenderArea::mousePressEvent(QMouseEvent *e)
     d->mouseDown = true;
     d->pos1 = e->x();
     d->pos2 = d->pos1;
-    drawPixmap();
+    update();
   }
 }
 
@@ -123,8 +113,10 @@ void WaveRenderArea::mouseReleaseEvent(QMouseEvent *e)
   Q_D(WaveRenderArea);
   if (e->button() == Qt::LeftButton) {
     d->mouseDown = false;
-    drawPixmap();
-    d->lockTimeNs = (qMax(d->pos1, d->pos2) - qMin(d->pos1, d->pos2)) * 1000 * d->audioFormat.durationForFrames(d->sampleBuffer.size()) / width();
+    update();
+    if (d->clickDetector != Q_NULLPTR) {
+      d->clickDetector->setLockTimeNs((qMax(d->pos1, d->pos2) - qMin(d->pos1, d->pos2)) * 1000 * WaveRenderer::WindowDurationUs / width());
+    }
   }
 }
 
@@ -134,146 +126,80 @@ void WaveRenderArea::mouseMoveEvent(QMouseEvent *e)
   Q_D(WaveRenderArea);
   if (d->mouseDown) {
     d->pos2 = e->x();
-    drawPixmap();
+    update();
   }
 }
 
 
-void WaveRenderArea::setThreshold(int threshold)
+// Shows the new threshold or lock time even while rendering is stopped
+void WaveRenderArea::onDetectorChanged(void)
 {
   Q_D(WaveRenderArea);
-  d->threshold = threshold;
-  drawPixmap();
+  QMetaObject::invokeMethod(d->renderer, "render", Qt::QueuedConnection);
 }
 
 
-void WaveRenderArea::setLockTimeNs(qint64 lockTimeNs)
+void WaveRenderArea::onFrameReady(const QImage &frame)
 {
   Q_D(WaveRenderArea);
-  d->lockTimeNs = lockTimeNs;
-  drawPixmap();
+  d->frame = frame;
+  d->renderer->frameConsumed();
+  update();
 }
 
 
-void WaveRenderArea::drawPixmap(void)
+void WaveRenderArea::startRendering(int fps)
 {
   Q_D(WaveRenderArea);
-  if (!d->pixmap.isNull()) {
-    Q_ASSERT(d->audioFormat.channelCount() == 1);
-    QPainter p(&d->pixmap);
-    static const QColor BackgroundColor(17, 33, 17);
-    p.fillRect(d->pixmap.rect(), BackgroundColor);
-    if (d->audioFormat.isValid() && d->maxAmplitude > 0 && !d->sampleBuffer.isEmpty()) {
-      const int halfHeight = d->pixmap.height() / 2;
-      QPointF origin(0, halfHeight);
-      QLineF waveLine(origin, origin);
-      const qreal xd = qreal(d->pixmap.width()) / d->sampleBuffer.size();
-      const qreal skipWidth = xd * d->audioFormat.framesForDuration(d->lockTimeNs / 1000);
-      if (!d->peakPos.isEmpty()) {
-        for (int i = 0; i < d->peakPos.size(); ++i) {
-          const int x = int(d->peakPos.at(i) * xd);
-          static const QBrush SkipBrush(QColor(255, 155, 54).darker());
-          p.fillRect(x, 0, skipWidth, height(), SkipBrush);
-        }
-      }
-      qreal x = 0.0;
-      for (int i = 0; i < d->sampleBuffer.size(); ++i) {
-        p.setRenderHint(QPainter::Antialiasing, true);
-        const qreal y = qreal(d->sampleBuffer.at(i)) / d->maxAmplitude;
-        waveLine.setP2(QPointF(x, halfHeight - y * halfHeight));
-        static const QPen WaveLinePen(QBrush(QColor(54, 255, 54)), 0.5);
-        p.setPen(WaveLinePen);
-        p.drawLine(waveLine);
-        waveLine.setP1(waveLine.p2());
-        x += xd;
-      }
-      static const QBrush ThresholdBrush(QColor(255, 255, 255, 72), Qt::SolidPattern);
-      p.setRenderHint(QPainter::Antialiasing, false);
-      p.fillRect(QRectF(0, 0, width(), halfHeight - qreal(d->threshold) / d->maxAmplitude * halfHeight), ThresholdBrush);
-      if (d->mouseDown) {
-        static const QBrush MarkerBrush(QColor(255, 255, 0, 72), Qt::SolidPattern);
-        p.fillRect(QRectF(d->pos1, 0, (d->pos2 - d->pos1), height()), MarkerBrush);
-      }
-      if (d->doWritePixmap && !d->peakPos.isEmpty()) {
-        p.end();
-        d->pixmap.save(QString("..\\Qliq\\screenshots\\%1.png").arg(d->frameTimestampNs / 1000 / 1000, 12, 10, QChar('0')));
-      }
-    }
-    update();
-  }
+  QMetaObject::invokeMethod(d->renderer, "start", Qt::QueuedConnection, Q_ARG(int, fps));
 }
 
 
-void WaveRenderArea::findPeaks(void)
+void WaveRenderArea::stopRendering(void)
 {
   Q_D(WaveRenderArea);
-  d->peakPos.clear();
-  d->dt.clear();
-  const qint64 nsPerBuffer = 1000 * d->audioFormat.durationForFrames(d->sampleBuffer.size());
-  const qint64 skipLength = d->audioFormat.framesForDuration(d->lockTimeNs / 1000);
-  int i = 0;
-  while (i < d->sampleBuffer.size()) {
-    const int sample = d->sampleBuffer.at(i);
-    const qint64 sampleOffsetNs = i * nsPerBuffer / d->sampleBuffer.size();
-    const qint64 currentTimestampNs = d->frameTimestampNs + sampleOffsetNs;
-    const qint64 dtNs = currentTimestampNs - d->lastClickTimestampNs;
-    if (sample > d->threshold && dtNs > d->lockTimeNs) {
-      emit click(dtNs);
-      d->lastClickTimestampNs = currentTimestampNs;
-      d->peakPos.append(i);
-      d->dt.append(dtNs);
-      i += skipLength;
-    }
-    else {
-      ++i;
-    }
-  }
-}
-
-
-void WaveRenderArea::setData(const SampleBufferType &data, qint64 processedUSecs)
-{
-  Q_D(WaveRenderArea);
-  QMutexLocker(d->sampleBufferMutex);
-  d->sampleBuffer = data;
-  d->frameTimestampNs = 1000 * processedUSecs;
-  findPeaks();
-  d->lastFrameTimestampNs = d->frameTimestampNs;
-  drawPixmap();
+  QMetaObject::invokeMethod(d->renderer, "stop", Qt::QueuedConnection);
 }
 
 
 void WaveRenderArea::setAudioFormat(const QAudioFormat &format)
 {
   Q_D(WaveRenderArea);
-  Q_ASSERT(format.channelCount() == 1);
-  d->audioFormat = format;
-  d->maxAmplitude = AudioInputDevice::maxAmplitudeForFormat(d->audioFormat);
+  QMetaObject::invokeMethod(d->renderer, "setAudioFormat", Qt::QueuedConnection, Q_ARG(QAudioFormat, format));
 }
 
 
-void WaveRenderArea::setWritePixmap(bool doWritePixmap)
+void WaveRenderArea::setSampleRing(const SampleRingBuffer *sampleRing)
 {
   Q_D(WaveRenderArea);
-  d->doWritePixmap = doWritePixmap;
+  QMetaObject::invokeMethod(d->renderer, "setSampleRing", Qt::QueuedConnection, Q_ARG(const SampleRingBuffer*, sampleRing));
 }
 
 
-void WaveRenderArea::reset(void)
+void WaveRenderArea::setClickDetector(ClickDetector *clickDetector)
 {
   Q_D(WaveRenderArea);
-  d->frameTimestampNs = 0;
-  d->lastClickTimestampNs = 0;
+  if (d->clickDetector != Q_NULLPTR) {
+    QObject::disconnect(d->clickDetector, Q_NULLPTR, this, Q_NULLPTR);
+  }
+  d->clickDetector = clickDetector;
+  QMetaObject::invokeMethod(d->renderer, "setClickDetector", Qt::QueuedConnection, Q_ARG(ClickDetector*, clickDetector));
+  if (d->clickDetector != Q_NULLPTR) {
+    QObject::connect(d->clickDetector, SIGNAL(thresholdChanged(int)), SLOT(onDetectorChanged()));
+    QObject::connect(d->clickDetector, SIGNAL(lockTimeChanged(qint64)), SLOT(onDetectorChanged()));
+  }
 }
 
 
-qint64 WaveRenderArea::lockTimeNs(void) const
+void WaveRenderArea::setWritePixmap(bool doWritePixmap)
 {
-  return d_ptr->lockTimeNs;
+  Q_D(WaveRenderArea);
+  QMetaObject::invokeMethod(d->renderer, "setWritePixmap", Qt::QueuedConnection, Q_ARG(bool, doWritePixmap));
 }
 
 
-int WaveRenderArea::threshold(void) const
+void WaveRenderArea::setScreenshotDirectory(const QString &directory)
 {
-  return d_ptr->threshold;
+  Q_D(WaveRenderArea);
+  QMetaObject::invokeMethod(d->renderer, "setScreenshotDirectory", Qt::QueuedConnection, Q_ARG(QString, directory));
 }
@@ -22,29 +22,34 @@
 #define __WAVERENDERAREA_H_
 
 #include <QWidget>
-#include <QByteArray>
+#include <QImage>
 #include <QAudioFormat>
 #include <QResizeEvent>
 #include <QMouseEvent>
-#include <QMutex>
-#include <QPixmap>
 #include "global.h"
+#include "ringbuffer.h"
+#include "waverenderer.h"
 
 class WaveRenderAreaPrivate;
+class ClickDetector;
 
+// Shows the latest samples of one channel along with that channel's
+// clicks and threshold. Pass the channel's sample ring and detector.
+// The frames are drawn by a WaveRenderer on a thread of its own; the
+// widget only puts the newest one on screen.
 class WaveRenderArea : public QWidget
 {
   Q_OBJECT
 public:
-  WaveRenderArea(QMutex *mutex, QWidget *parent = Q_NULLPTR);
+  explicit WaveRenderArea(QWidget *parent = Q_NULLPTR);
   ~WaveRenderArea();
-  void setData(const SampleBufferType &, qint64 processedUSecs);
+  void startRendering(int fps = WaveRenderer::DefaultFps);
+  void stopRendering(void);
   void setAudioFormat(const QAudioFormat &format);
+  void setSampleRing(const SampleRingBuffer *);
+  void setClickDetector(ClickDetector *);
   void setWritePixmap(bool);
-  void reset(void);
-
-  qint64 lockTimeNs(void) const;
-  int threshold(void) const;
+  void setScreenshotDirectory(const QString &);
 
 protected:
   virtual QSize sizeHint(void) const;
@@ -54,21 +59,14 @@ protected:
   void mouseReleaseEvent(QMouseEvent *);
   void mouseMoveEvent(QMouseEvent *);
 
-signals:
-  void click(qint64 nsElapsed);
-
-public slots:
-  void setThreshold(int);
-  void setLockTimeNs(qint64);
+private slots:
+  void onDetectorChanged(void);
+  void onFrameReady(const QImage &);
 
 private:
   QScopedPointer<WaveRenderAreaPrivate> d_ptr;
   Q_DECLARE_PRIVATE(WaveRenderArea)
   Q_DISABLE_COPY(WaveRenderArea)
-
-private: // methods
-  void drawPixmap(void);
-  void findPeaks(void);
 };
 
 #endif // __WAVERENDERAREA_H_
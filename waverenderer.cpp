@@ -0,0 +1,330 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "waverenderer.h"
+#include "audioinputdevice.h"
+#include "clickdetector.h"
+#include "decimator.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QPainter>
+#include <QRectF>
+#include <QTimer>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include <qmath.h>
+
+
+// Captures at higher rates are decimated for display, so that drawing
+// doesn't get more expensive with the sample rate.
+static const int MaxDisplayRate = 24000;
+
+
+class WaveRendererPrivate
+{
+public:
+  WaveRendererPrivate(void)
+    : waveEnd(-1)
+    , samplesPerColumn(0)
+    , doWritePixmap(false)
+    , maxAmplitude(-1)
+    , windowLength(0)
+    , firstFrame(0)
+    , decimatedCount(0)
+    , clickDetector(Q_NULLPTR)
+    , timer(Q_NULLPTR)
+    , framePending(false)
+  { /* ... */ }
+  ~WaveRendererPrivate() { /* ... */ }
+  QAudioFormat audioFormat;
+  // New columns are drawn at the right edge after scrolling the older
+  // ones to the left.
+  QImage wave;
+  // column right of the newest one in `wave`, or -1 if `wave` must be
+  // redrawn. Columns are counted from the last restartDecimator().
+  qint64 waveEnd;
+  qreal samplesPerColumn;
+  bool doWritePixmap;
+  QString screenshotDirectory;
+  quint32 maxAmplitude;
+  // in decimated samples
+  int windowLength;
+  // decimated samples
+  SampleBufferType sampleBuffer;
+  // full rate samples
+  SampleBufferType inputBuffer;
+  SampleRingBuffer::Reader sampleReader;
+  Decimator decimator;
+  // frame the decimator was reset at
+  qint64 firstFrame;
+  // samples the decimator has put out since
+  qint64 decimatedCount;
+  ClickRingBuffer::Reader clickReader;
+  QVector<qint64> recentClicks;
+  ClickDetector *clickDetector;
+  QTimer *timer;
+  std::atomic<bool> framePending;
+
+  void restartDecimator(void)
+  {
+    decimator.reset();
+    sampleBuffer.clear();
+    firstFrame = sampleReader.position();
+    decimatedCount = 0;
+    waveEnd = -1;
+  }
+
+  void resetWave(void)
+  {
+    samplesPerColumn = (wave.width() > 0) ? qreal(windowLength) / wave.width() : 0;
+    waveEnd = -1;
+  }
+
+  // first decimated sample in `column`
+  qint64 columnStart(qint64 column) const
+  {
+    return qint64(qFloor(column * samplesPerColumn));
+  }
+
+  // frame of the left edge of `wave`
+  qint64 leftFrame(void) const
+  {
+    return firstFrame + columnStart(waveEnd - wave.width()) * decimator.factor() - decimator.delay();
+  }
+};
+
+
+WaveRenderer::WaveRenderer(QObject *parent)
+  : QObject(parent)
+  , d_ptr(new WaveRendererPrivate)
+{
+  qRegisterMetaType<QAudioFormat>("QAudioFormat");
+  qRegisterMetaType<const SampleRingBuffer*>("const SampleRingBuffer*");
+}
+
+
+WaveRenderer::~WaveRenderer() { /* ... */ }
+
+
+void WaveRenderer::frameConsumed(void)
+{
+  d_ptr->framePending = false;
+}
+
+
+void WaveRenderer::setAudioFormat(const QAudioFormat &format)
+{
+  Q_D(WaveRenderer);
+  d->audioFormat = format;
+  d->maxAmplitude = AudioInputDevice::maxAmplitudeForFormat(d->audioFormat);
+  d->decimator.setFactor(Decimator::factorFor(d->audioFormat.sampleRate(), MaxDisplayRate));
+  d->windowLength = d->audioFormat.framesForDuration(WindowDurationUs) / d->decimator.factor();
+  d->sampleBuffer.reserve(2 * d->windowLength + Decimator::TapsPerPhase + 2);
+  d->restartDecimator();
+  d->resetWave();
+}
+
+
+void WaveRenderer::setSampleRing(const SampleRingBuffer *sampleRing)
+{
+  Q_D(WaveRenderer);
+  d->sampleReader.attach(sampleRing);
+  d->restartDecimator();
+}
+
+
+void WaveRenderer::setClickDetector(ClickDetector *clickDetector)
+{
+  Q_D(WaveRenderer);
+  d->clickDetector = clickDetector;
+  d->recentClicks.clear();
+  d->clickReader.attach(d->clickDetector != Q_NULLPTR ? d->clickDetector->clickRing() : Q_NULLPTR);
+}
+
+
+void WaveRenderer::setSize(const QSize &size)
+{
+  Q_D(WaveRenderer);
+  d->wave = QImage(size, QImage::Format_RGB32);
+  d->resetWave();
+}
+
+
+void WaveRenderer::setWritePixmap(bool doWritePixmap)
+{
+  Q_D(WaveRenderer);
+  d->doWritePixmap = doWritePixmap;
+}
+
+
+void WaveRenderer::setScreenshotDirectory(const QString &directory)
+{
+  Q_D(WaveRenderer);
+  d->screenshotDirectory = directory;
+}
+
+
+void WaveRenderer::start(int fps)
+{
+  Q_D(WaveRenderer);
+  if (d->timer == Q_NULLPTR) {
+    // created here, so that it lives on the render thread
+    d->timer = new QTimer(this);
+    QObject::connect(d->timer, &QTimer::timeout, [this]() {
+      if (!d_ptr->framePending) {
+        render();
+      }
+    });
+  }
+  d->timer->start(1000 / qMax(1, fps));
+}
+
+
+void WaveRenderer::stop(void)
+{
+  Q_D(WaveRenderer);
+  if (d->timer != Q_NULLPTR) {
+    d->timer->stop();
+  }
+}
+
+
+// Scrolls the waveform by the number of columns that have been
+// completed since the last call and draws them as vertical spans from
+// their minimum to their maximum. Each span starts at the last sample
+// of the column before, so that the waveform stays connected where a
+// column holds less than two samples.
+void WaveRenderer::drawWave(void)
+{
+  Q_D(WaveRenderer);
+  if (d->wave.isNull())
+    return;
+  static const QRgb BackgroundColor = qRgb(17, 33, 17);
+  static const QRgb WaveColor = qRgb(54, 255, 54);
+  const int w = d->wave.width();
+  const int h = d->wave.height();
+  const qint64 end = (d->samplesPerColumn > 0) ? qint64(qFloor(d->decimatedCount / d->samplesPerColumn)) : 0;
+  const int shift = (d->waveEnd >= 0) ? int(qMin(end - d->waveEnd, qint64(w))) : w;
+  if (shift == 0)
+    return;
+  uchar *bits = d->wave.bits();
+  const int bytesPerLine = d->wave.bytesPerLine();
+  for (int y = 0; y < h; ++y) {
+    QRgb *line = reinterpret_cast<QRgb*>(bits + y * bytesPerLine);
+    memmove(line, line + shift, (w - shift) * sizeof(QRgb));
+    std::fill(line + w - shift, line + w, BackgroundColor);
+  }
+  d->waveEnd = end;
+  if (d->maxAmplitude == 0 || d->sampleBuffer.isEmpty())
+    return;
+  const qreal halfHeight = 0.5 * h;
+  const qreal yScale = halfHeight / d->maxAmplitude;
+  const qint64 bufferStart = d->decimatedCount - d->sampleBuffer.size();
+  for (int x = w - shift; x < w; ++x) {
+    const qint64 column = end - w + x;
+    const qint64 s0 = qMax(d->columnStart(column) - 1, bufferStart);
+    const qint64 s1 = d->columnStart(column + 1);
+    if (s1 <= s0)
+      continue;
+    int lo = std::numeric_limits<int>::max();
+    int hi = std::numeric_limits<int>::min();
+    for (qint64 s = s0; s < s1; ++s) {
+      const int value = d->sampleBuffer.at(int(s - bufferStart));
+      lo = qMin(lo, value);
+      hi = qMax(hi, value);
+    }
+    const int top = qBound(0, int(halfHeight - hi * yScale), h - 1);
+    const int bottom = qBound(0, int(halfHeight - lo * yScale), h - 1);
+    for (int y = top; y <= bottom; ++y) {
+      reinterpret_cast<QRgb*>(bits + y * bytesPerLine)[x] = WaveColor;
+    }
+  }
+}
+
+
+void WaveRenderer::render(void)
+{
+  Q_D(WaveRenderer);
+  if (!d->sampleReader.isAttached() || d->windowLength == 0 || d->wave.isNull())
+    return;
+  const int factor = d->decimator.factor();
+  // Input older than a window plus what the filter needs to settle
+  // won't be shown. Skip it, which also gets the reader past samples
+  // it may have lost.
+  const int inputLength = (d->windowLength + Decimator::TapsPerPhase) * factor;
+  if (d->sampleReader.available() > inputLength) {
+    d->sampleReader.seekLatest(inputLength);
+    d->restartDecimator();
+  }
+  d->inputBuffer.resize(inputLength);
+  const int n = d->sampleReader.read(d->inputBuffer.data(), inputLength);
+  const int oldSize = d->sampleBuffer.size();
+  d->sampleBuffer.resize(oldSize + n / factor + 1);
+  const int m = d->decimator.process(d->inputBuffer.constData(), n, d->sampleBuffer.data() + oldSize);
+  d->sampleBuffer.resize(oldSize + m);
+  d->decimatedCount += m;
+  // a window plus a column, so that full redraws find the leftmost
+  // column and the sample before it
+  const int keep = d->windowLength + qCeil(d->samplesPerColumn) + 2;
+  if (d->sampleBuffer.size() > keep) {
+    d->sampleBuffer.remove(0, d->sampleBuffer.size() - keep);
+  }
+  drawWave();
+
+  const qint64 leftFrame = d->leftFrame();
+  int oldClicks = 0;
+  while (oldClicks < d->recentClicks.size() && d->recentClicks.at(oldClicks) < leftFrame)
+    ++oldClicks;
+  d->recentClicks.remove(0, oldClicks);
+  bool hasNewClicks = false;
+  ClickEvent event;
+  while (d->clickReader.read(&event, 1) == 1) {
+    d->recentClicks.append(event.frame);
+    hasNewClicks = true;
+  }
+
+  // the clicks and the threshold go on top of a copy, so that the
+  // cached waveform stays clean
+  QImage frame = d->wave.copy();
+  if (d->clickDetector != Q_NULLPTR && d->maxAmplitude > 0) {
+    QPainter p(&frame);
+    const int halfHeight = frame.height() / 2;
+    const qreal framesPerColumn = d->samplesPerColumn * factor;
+    const qreal skipWidth = d->audioFormat.framesForDuration(d->clickDetector->lockTimeNs() / 1000) / framesPerColumn;
+    static const QBrush SkipBrush(QColor(255, 155, 54, 96));
+    foreach (qint64 click, d->recentClicks) {
+      p.fillRect(QRectF((click - leftFrame) / framesPerColumn, 0, skipWidth, frame.height()), SkipBrush);
+    }
+    static const QBrush ThresholdBrush(QColor(255, 255, 255, 72), Qt::SolidPattern);
+    p.fillRect(QRectF(0, 0, frame.width(), halfHeight - qreal(d->clickDetector->threshold()) / d->maxAmplitude * halfHeight), ThresholdBrush);
+  }
+  if (d->doWritePixmap && hasNewClicks && !d->screenshotDirectory.isEmpty() && d->audioFormat.sampleRate() > 0) {
+    // named after the time of the newest click in ms; in 64 bits, as
+    // QAudioFormat::durationForFrames() takes 32-bit frame counts
+    const qint64 ms = d->recentClicks.last() * 1000 / d->audioFormat.sampleRate();
+    QDir().mkpath(d->screenshotDirectory);
+    frame.save(QDir(d->screenshotDirectory).filePath(QString("%1.png").arg(ms, 12, 10, QChar('0'))));
+  }
+  d->framePending = true;
+  emit frameReady(frame);
+}
@@ -0,0 +1,88 @@
+/*
+
+    Copyright (c) 2015 Oliver Lau <ola@ct.de>, Heise Medien GmbH & Co. KG
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef __WAVERENDERER_H_
+#define __WAVERENDERER_H_
+
+#include <QObject>
+#include <QImage>
+#include <QSize>
+#include <QAudioFormat>
+#include <QScopedPointer>
+#include "global.h"
+#include "ringbuffer.h"
+
+class WaveRendererPrivate;
+class ClickDetector;
+
+
+// Draws the waveform of one channel, its clicks and its threshold into
+// a QImage. Once start()ed, it renders at most `fps` frames a second
+// from whatever the sample ring received in the meantime, so the cost
+// follows the frame rate instead of the rate of audio buffers. Move it
+// to a thread of its own and call its slots through queued connections;
+// neither the capture thread nor the GUI then ever wait for it.
+//
+// The waveform is the envelope of the samples in each pixel column.
+// Captures at high sample rates are low-pass filtered and decimated
+// first, and only the columns that filled up since the last frame get
+// drawn, into a cached image that scrolls to the left.
+class WaveRenderer : public QObject
+{
+  Q_OBJECT
+public:
+  static const int DefaultFps = 30;
+  // Time span shown
+  static const qint64 WindowDurationUs = 100 * 1000;
+
+  explicit WaveRenderer(QObject *parent = Q_NULLPTR);
+  ~WaveRenderer();
+
+  // Thread-safe. Until the receiver of frameReady() calls this, timed
+  // frames are skipped, so that they can't pile up in its event queue.
+  void frameConsumed(void);
+
+public slots:
+  void setAudioFormat(const QAudioFormat &);
+  void setSampleRing(const SampleRingBuffer *);
+  void setClickDetector(ClickDetector *);
+  void setSize(const QSize &);
+  // Saves a frame whenever new clicks are drawn, into
+  // setScreenshotDirectory()
+  void setWritePixmap(bool);
+  void setScreenshotDirectory(const QString &);
+  void start(int fps = DefaultFps);
+  void stop(void);
+  // Renders a frame right away
+  void render(void);
+
+signals:
+  void frameReady(const QImage &);
+
+private:
+  QScopedPointer<WaveRendererPrivate> d_ptr;
+  Q_DECLARE_PRIVATE(WaveRenderer)
+  Q_DISABLE_COPY(WaveRenderer)
+
+private: // methods
+  void drawWave(void);
+};
+
+#endif // __WAVERENDERER_H_